@@ -13,28 +13,48 @@
 
 #include "net/socket_manager.hpp"
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
 namespace net {
 
 /// Manages the lifetime of a socket.
 class acceptor : public socket_manager {
 public:
+  /// The default number of connections accepted per read event.
+  static constexpr std::size_t default_accept_budget = 64;
+
+  /// The time the acceptor pauses after running out of file descriptors.
+  static constexpr std::chrono::milliseconds retry_delay{10};
+
   acceptor(tcp_accept_socket handle, multiplexer* mpx,
            socket_manager_factory_ptr factory);
 
   ~acceptor() override = default;
 
+  /// Reads the number of connections accepted per read event from
+  /// `multiplexer.accept-budget`.
   util::error init(const util::config& cfg) override;
 
   // -- properties -------------------------------------------------------------
 
+  /// Accepts pending connections until the backlog is drained or the accept
+  /// budget is exhausted. Stops reading for `retry_delay` once the process
+  /// runs out of file descriptors.
   event_result handle_read_event() override;
 
   event_result handle_write_event() override;
 
+  /// Resumes accepting after running out of file descriptors.
   event_result handle_timeout(uint64_t timeout_id) override;
 
 private:
   socket_manager_factory_ptr factory_;
+  std::size_t accept_budget_{default_accept_budget};
+  /// The timeout that resumes accepting, set while the acceptor pauses.
+  std::optional<uint64_t> retry_timeout_;
 };
 
 } // namespace net
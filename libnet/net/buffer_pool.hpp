@@ -0,0 +1,72 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      buffer_pool.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "util/byte_buffer.hpp"
+#include "util/byte_span.hpp"
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace net {
+
+/// Pool of I/O buffers shared by the transports of a multiplexer. Transports
+/// borrow buffers while they have data to read or write and return them once
+/// drained, so idle connections do not hold any buffers. Buffers are recycled
+/// in fixed size classes. Additionally, the pool holds a scratch buffer that
+/// transports can read into before handing the data to their layers.
+/// @warning Must only be used on the multiplexer thread.
+class buffer_pool {
+public:
+  /// The capacities of the pooled buffers.
+  static constexpr std::array<std::size_t, 3> size_classes{4096, 16384, 65536};
+
+  /// Default number of buffers that are kept per size class.
+  static constexpr std::size_t default_max_cached = 256;
+
+  // -- constructors, destructors, and assignment operators --------------------
+
+  explicit buffer_pool(std::size_t max_cached = default_max_cached);
+
+  buffer_pool(const buffer_pool&) = delete;
+
+  buffer_pool& operator=(const buffer_pool&) = delete;
+
+  buffer_pool(buffer_pool&&) = default;
+
+  buffer_pool& operator=(buffer_pool&&) = default;
+
+  // -- buffer management ------------------------------------------------------
+
+  /// Returns an empty buffer with a capacity of at least `min_capacity`.
+  /// Buffers larger than the largest size class are not pooled.
+  util::byte_buffer acquire(std::size_t min_capacity);
+
+  /// Returns `buf` to the pool. Buffers are freed if they are smaller than the
+  /// smallest size class, or if enough buffers of their class are cached.
+  void release(util::byte_buffer&& buf);
+
+  /// Returns the scratch buffer resized to at least `size` bytes. The buffer
+  /// is shared by all users of the pool, its content is only valid until the
+  /// next call.
+  util::byte_span scratch(std::size_t size);
+
+  // -- properties -------------------------------------------------------------
+
+  /// Returns the number of cached buffers.
+  std::size_t num_cached() const noexcept;
+
+private:
+  std::size_t max_cached_;
+  std::array<std::vector<util::byte_buffer>, size_classes.size()> free_;
+  util::byte_buffer scratch_;
+};
+
+} // namespace net
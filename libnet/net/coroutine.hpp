@@ -0,0 +1,263 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      coroutine.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "net/fwd.hpp"
+#include "util/fwd.hpp"
+
+#include "net/event_result.hpp"
+#include "net/layer.hpp"
+#include "net/receive_policy.hpp"
+#include "net/transport.hpp"
+
+#include "util/byte_span.hpp"
+#include "util/error.hpp"
+
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace net {
+
+/// Coroutine type of connection handlers. Handlers start suspended and are
+/// started by their `coroutine_layer`. Frames are allocated from the manager
+/// pool of the multiplexer if they are created inside a `frame_pool_scope`.
+class task {
+public:
+  struct promise_type {
+    task get_return_object() noexcept {
+      return task{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    std::suspend_always final_suspend() noexcept { return {}; }
+
+    void return_void() noexcept {
+      // nop
+    }
+
+    void unhandled_exception() noexcept;
+
+    // Not overloaded for the arguments of the coroutine, the compiler would
+    // pair that overload with the sized delete and report a mismatch
+    static void* operator new(std::size_t size);
+
+    static void operator delete(void* ptr, std::size_t size) noexcept;
+  };
+
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  // -- constructors, destructors, and assignment operators --------------------
+
+  task() noexcept = default;
+
+  explicit task(handle_type handle) noexcept : handle_{handle} {
+    // nop
+  }
+
+  task(task&& other) noexcept : handle_{std::exchange(other.handle_, {})} {
+    // nop
+  }
+
+  task& operator=(task&& other) noexcept {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+
+  ~task() {
+    if (handle_)
+      handle_.destroy();
+  }
+
+  // -- properties -------------------------------------------------------------
+
+  /// Checks whether the coroutine ran to completion.
+  bool done() const noexcept { return !handle_ || handle_.done(); }
+
+  handle_type handle() const noexcept { return handle_; }
+
+private:
+  handle_type handle_;
+};
+
+/// Allocates the frames of tasks that are created on this thread from the
+/// manager pool of the multiplexer of `conn` while the scope is alive.
+class frame_pool_scope {
+public:
+  explicit frame_pool_scope(connection& conn) noexcept;
+
+  ~frame_pool_scope();
+
+  frame_pool_scope(const frame_pool_scope&) = delete;
+
+  frame_pool_scope& operator=(const frame_pool_scope&) = delete;
+
+private:
+  manager_pool* prev_;
+};
+
+/// The interface of a connection for coroutines. Coroutines are resumed by
+/// the read events and timeouts of their transport, i.e., on the thread of
+/// the multiplexer. A coroutine waits for at most one operation at a time.
+/// Received data stays in the read buffer of the transport, which pauses
+/// reading while the coroutine sleeps.
+class connection {
+public:
+  /// Waits until enough data for `policy` was received.
+  struct read_awaitable {
+    connection& conn;
+    receive_policy policy;
+
+    bool await_ready() const noexcept;
+
+    void await_suspend(std::coroutine_handle<> handle);
+
+    util::const_byte_span await_resume() noexcept;
+  };
+
+  /// Waits until the timeout of a `sleep_for` expired.
+  struct sleep_awaitable {
+    connection& conn;
+    std::chrono::milliseconds duration;
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle);
+
+    void await_resume() const noexcept {
+      // nop
+    }
+  };
+
+  // -- constructors, destructors, and assignment operators --------------------
+
+  explicit connection(transport& parent);
+
+  connection(const connection&) = delete;
+
+  connection& operator=(const connection&) = delete;
+
+  // -- coroutine interface ----------------------------------------------------
+
+  /// Returns received data according to `policy`, i.e., at least `min_size`
+  /// and at most `max_size` bytes. The data points into the read buffer of
+  /// the transport and is valid until the coroutine suspends.
+  read_awaitable read(receive_policy policy) noexcept;
+
+  /// Enqueues `bytes` at the transport. Never suspends, the data is sent
+  /// once the socket is writable.
+  std::suspend_never write(util::const_byte_span bytes);
+
+  /// Suspends the coroutine for `duration`.
+  sleep_awaitable sleep_for(std::chrono::milliseconds duration) noexcept {
+    return {*this, duration};
+  }
+
+  /// Returns the transport of this connection.
+  transport& parent() const noexcept { return parent_; }
+
+  // -- layer interface --------------------------------------------------------
+
+  /// Runs `handler` until it suspends for the first time.
+  void start(task handler);
+
+  /// Resumes a coroutine that waits for `bytes` and returns the number of
+  /// bytes it read. The rest stays buffered at the transport. Data that
+  /// arrives after the coroutine finished is an error.
+  std::ptrdiff_t consume(util::const_byte_span bytes);
+
+  /// Resumes a coroutine that waits for the timeout `id`.
+  event_result handle_timeout(uint64_t id);
+
+  /// Checks whether the coroutine ran to completion.
+  bool done() const noexcept { return handler_.done(); }
+
+private:
+  enum class waiting_for {
+    nothing,
+    data,
+    timeout,
+  };
+
+  /// Returns the number of received bytes that were not yet read.
+  std::size_t available() const noexcept {
+    return input_.size() - delivered_;
+  }
+
+  void resume();
+
+  transport& parent_;
+  task handler_;
+  std::coroutine_handle<> waiting_;
+  waiting_for reason_ = waiting_for::nothing;
+  receive_policy policy_ = receive_policy::stop();
+  uint64_t timeout_id_ = 0;
+  /// The data passed to `consume`, only set while it runs. The first
+  /// `delivered_` bytes were handed to reads.
+  util::const_byte_span input_;
+  std::size_t delivered_ = 0;
+};
+
+/// Runs a coroutine for each connection. `Handler` is invoked with the
+/// `connection` and returns a `task`, e.g.,
+/// `stream_transport<coroutine_layer<echo>>`. As a `framing_layer`, it
+/// requires a transport that keeps data that was not consumed.
+template <class Handler>
+class coroutine_layer {
+public:
+  /// Transports are asked for this many bytes until the coroutine reads.
+  static constexpr std::uint32_t default_read_size = 4096;
+
+  template <class... Ts>
+  explicit coroutine_layer(transport& parent, Ts&&... xs)
+    : handler_{std::forward<Ts>(xs)...}, conn_{parent} {
+    static_assert(std::is_invocable_r_v<task, Handler&, connection&>);
+  }
+
+  // -- upfacing interface -----------------------------------------------------
+
+  util::error init(const util::config&) {
+    conn_.parent().configure_next_read(
+      receive_policy::up_to(default_read_size));
+    task handler;
+    {
+      frame_pool_scope scope{conn_};
+      handler = handler_(conn_);
+    }
+    conn_.start(std::move(handler));
+    return util::none;
+  }
+
+  bool has_more_data() const noexcept { return false; }
+
+  event_result produce() const noexcept { return event_result::done; }
+
+  std::ptrdiff_t consume(util::const_byte_span bytes) {
+    return conn_.consume(bytes);
+  }
+
+  event_result handle_timeout(uint64_t id) { return conn_.handle_timeout(id); }
+
+  // -- properties -------------------------------------------------------------
+
+  connection& conn() noexcept { return conn_; }
+
+  Handler& handler() noexcept { return handler_; }
+
+private:
+  Handler handler_;
+  /// Declared after the handler, which the coroutine may refer to.
+  connection conn_;
+};
+
+} // namespace net
@@ -18,6 +18,9 @@ enum class event_result : std::uint8_t {
   ok = 0,
   done,
   error,
+  /// The manager stopped before the socket would block. Edge-triggered
+  /// managers are handled again without waiting for another event.
+  again,
 };
 
 std::string to_string(event_result op);
@@ -26,18 +26,27 @@ namespace net {
 // -- classes ------------------------------------------------------------------
 
 class acceptor;
+class buffer_pool;
+class connection;
+class manager_pool;
 class multiplexer_impl;
 class multiplexer;
+class offload_job;
+class offload_pool;
 class pollset_updater;
 class socket_manager_factory;
 class socket_manager;
+class task;
+class timing_wheel;
 class uri;
+class uring_multiplexer;
+class uring_transport;
+class write_queue;
 
 // -- structs ------------------------------------------------------------------
 
 struct application;
 struct datagram_socket;
-struct layer;
 struct pipe_socket;
 struct raw_socket;
 struct receive_policy;
@@ -45,7 +54,6 @@ struct socket;
 struct stream_socket;
 struct tcp_accept_socket;
 struct tcp_stream_socket;
-struct timeout_entry;
 
 // -- enums --------------------------------------------------------------------
 
@@ -58,13 +66,16 @@ using acceptor_pair = std::pair<tcp_accept_socket, std::uint16_t>;
 using datagram_socket_pair = std::pair<datagram_socket, datagram_socket>;
 using pipe_socket_pair = std::pair<pipe_socket, pipe_socket>;
 using multiplexer_ptr = std::shared_ptr<multiplexer>;
+using offload_pool_ptr = std::shared_ptr<offload_pool>;
 using socket_manager_factory_ptr = std::shared_ptr<socket_manager_factory>;
 
 // -- template types -----------------------------------------------------------
 
 template <meta::derived_from<socket> Socket>
 class socket_guard;
-template <class NextLayer>
+template <template <class> class NextLayer, class Parent>
+class tls;
+template <template <class> class NextLayer>
 class transport_adaptor;
 
 } // namespace net
@@ -12,17 +12,13 @@
 #include "util/fwd.hpp"
 
 #include "net/multiplexer.hpp"
-#include "net/socket/pipe_socket.hpp"
-#include "net/timeout_entry.hpp"
-
-#include "util/binary_serializer.hpp"
-#include "util/byte_buffer.hpp"
+#include "net/pollset_updater.hpp"
+#include "net/timing_wheel.hpp"
 
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
-#include <optional>
-#include <set>
 #include <span>
 #include <sys/event.h>
 #include <thread>
@@ -44,10 +40,6 @@ class kqueue_multiplexer : public multiplexer {
   using event_span = std::span<event_type>;
   using manager_map = std::unordered_map<socket_id, socket_manager_ptr>;
 
-  // Timeout handling types
-  using optional_timepoint
-    = std::optional<std::chrono::system_clock::time_point>;
-  using timeout_entry_set = std::set<timeout_entry>;
 
 public:
   // -- constructors, destructors ----------------------------------------------
@@ -73,6 +65,11 @@ public:
 
   bool running() const override;
 
+  bool is_multiplexer_thread() const override {
+    return std::this_thread::get_id()
+           == mpx_thread_id_.load(std::memory_order_relaxed);
+  }
+
   void set_thread_id(std::thread::id tid = {}) noexcept;
 
   // -- members ----------------------------------------------------------------
@@ -89,16 +86,22 @@ public:
   void add(socket_manager_ptr mgr, operation initial) override;
 
   /// Enables an operation `op` for socket manager `mgr`.
-  void enable(socket_manager_ptr, operation op) override;
+  void enable(socket_manager*, operation op) override;
 
   /// Disables an operation `op` for socket manager `mgr`.
   /// If `mgr` is not registered for any operation after disabling it, it is
   /// removed if `remove` is set.
-  void disable(socket_manager_ptr mgr, operation op, bool remove) override;
+  void disable(socket_manager* mgr, operation op, bool remove) override;
+
+  std::uint64_t set_timeout(socket_manager* mgr, time_point when) override;
+
+  void add_timeout(socket_manager* mgr, time_point when,
+                   std::uint64_t timeout_id) override;
 
-  std::uint64_t
-  set_timeout(socket_manager_ptr mgr,
-              std::chrono::system_clock::time_point when) override;
+  bool cancel_timeout(std::uint64_t timeout_id) override;
+
+  /// Completes `job` on the multiplexer thread.
+  void post(offload_job_ptr job) override;
 
   /// Main multiplexing loop.
   util::error poll_once(bool blocking) override;
@@ -123,22 +126,8 @@ private:
   /// Modifies the epollset for existing fds.
   void mod(int fd, int op, operation events);
 
-  /// Writes the pollset_update code to the pipe
-  template <class... Ts>
-  ptrdiff_t write_to_pipe(Ts&&... ts) {
-    util::byte_buffer buf;
-    util::binary_serializer bs{buf};
-    bs(std::forward<Ts>(ts)...);
-    return write(pipe_writer_, util::as_const_bytes(buf));
-  }
-
-  bool is_multiplexer_thread() {
-    return std::this_thread::get_id() == mpx_thread_id_;
-  }
-
-  // pipe for synchronous access to mpx
-  pipe_socket pipe_writer_{invalid_socket_id};
-  pipe_socket pipe_reader_{invalid_socket_id};
+  // Thread-safe access to the mpx
+  pollset_updater_ptr updater_;
 
   // Multiplexing variables
   mpx_fd mpx_fd_{invalid_socket_id};
@@ -147,15 +136,14 @@ private:
   manager_map managers_;
 
   // timeout handling
-  timeout_entry_set timeouts_;
-  optional_timepoint current_timeout_{std::nullopt};
-  std::uint64_t current_timeout_id_{0};
+  timing_wheel timeouts_;
 
   // thread variables
   bool shutting_down_{false};
   bool running_{false};
   std::thread mpx_thread_;
-  std::thread::id mpx_thread_id_;
+  /// Only ever equals the id of the thread reading it if that thread set it.
+  std::atomic<std::thread::id> mpx_thread_id_;
 
   const util::config* cfg_ = nullptr;
 };
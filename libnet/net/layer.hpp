@@ -11,53 +11,66 @@
 #include "net/fwd.hpp"
 #include "util/fwd.hpp"
 
+#include "meta/concepts.hpp"
+
 #include "util/byte_buffer.hpp"
 
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 
 namespace net {
 
-struct layer {
-  // -- Upfacing interface (towards application) -------------------------------
-
-  /// Initializes the application.
-  virtual util::error init(const util::config&) = 0;
-
-  /// Checks wether the application has more data to send.
-  virtual bool has_more_data() = 0;
-
-  /// Produces more data and enqueues it at their parent.
-  virtual event_result produce() = 0;
-
-  /// Consumes previously received data.
-  virtual event_result consume(util::const_byte_span bytes) = 0;
-
-  /// Handles a timeout.
-  virtual event_result handle_timeout(uint64_t id) = 0;
-
-  // -- Downfacing interface (towards transport) -------------------------------
-
-  /// Configures the amount to be read next
-  virtual void configure_next_read(receive_policy policy) = 0;
-
-  /// Returns a reference to the send_buffer
-  virtual util::byte_buffer& write_buffer() = 0;
-
-  /// Enqueues data to the transport extension
-  virtual void enqueue(util::const_byte_span bytes) = 0;
-
-  /// Called when an error occurs
-  virtual void handle_error(const util::error& err) = 0;
+// Layers are stacked at compile time. Each layer owns the layer above it and
+// holds a reference to the layer below, both by their concrete types. Calls
+// in either direction can therefore be inlined. The following concepts
+// describe what a layer has to offer in each direction.
+
+/// Upfacing interface, i.e., what a transport or layer requires from the
+/// layer on top of it, apart from `consume`.
+template <class T>
+concept upper_layer_base = requires(T& x, const util::config& cfg,
+                                    uint64_t id) {
+  { x.init(cfg) } -> meta::same_as<util::error>;
+  { x.has_more_data() } -> meta::same_as<bool>;
+  { x.produce() } -> meta::same_as<event_result>;
+  { x.handle_timeout(id) } -> meta::same_as<event_result>;
+};
 
-  /// Registers the stack for write events
-  virtual void register_writing() = 0;
+/// Upper layer that consumes all data passed to `consume` at once.
+template <class T>
+concept event_layer = upper_layer_base<T>
+                      && requires(T& x, util::const_byte_span bytes) {
+  { x.consume(bytes) } -> meta::same_as<event_result>;
+};
 
-  /// Sets a timeout in `duration` milliseconds with the id `timeout_id`
-  virtual uint64_t set_timeout_in(std::chrono::milliseconds duration) = 0;
+/// Upper layer that returns the number of bytes it consumed, which is
+/// negative on error. Only transports that keep the rest support it.
+template <class T>
+concept framing_layer = upper_layer_base<T>
+                        && requires(T& x, util::const_byte_span bytes) {
+  { x.consume(bytes) } -> meta::same_as<std::ptrdiff_t>;
+};
 
-  /// Sets a timeout at timepoint `point` with the id `timeout_id`
-  virtual uint64_t set_timeout_at(std::chrono::system_clock::time_point point)
-    = 0;
+/// Any upper layer.
+template <class T>
+concept upper_layer = event_layer<T> || framing_layer<T>;
+
+/// Downfacing interface, i.e., what a layer requires from the transport or
+/// layer below it.
+template <class T>
+concept lower_layer = requires(T& x, receive_policy policy,
+                               util::const_byte_span bytes,
+                               const util::error& err,
+                               std::chrono::milliseconds duration,
+                               std::chrono::steady_clock::time_point point) {
+  x.configure_next_read(policy);
+  { x.write_buffer() } -> meta::same_as<util::byte_buffer&>;
+  x.enqueue(bytes);
+  x.handle_error(err);
+  x.register_writing();
+  { x.set_timeout_in(duration) } -> meta::same_as<uint64_t>;
+  { x.set_timeout_at(point) } -> meta::same_as<uint64_t>;
 };
 
 } // namespace net
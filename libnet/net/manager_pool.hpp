@@ -0,0 +1,141 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      manager_pool.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "util/intrusive_ptr.hpp"
+#include "util/ref_counted.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace net {
+
+/// Free list for the memory of the socket managers of a multiplexer. Objects
+/// created by `make_pooled` return their memory to the pool once their last
+/// reference is dropped, so that managers that are created later reuse it
+/// instead of allocating. Blocks are recycled per object size. Objects may be
+/// released on any thread and outlive the pool, their memory is only returned
+/// on the thread that owns the pool and freed otherwise.
+/// @warning Must only be used on the thread that owns it.
+class manager_pool {
+public:
+  /// Default number of blocks that are kept per object size.
+  static constexpr std::size_t default_max_cached = 1024;
+
+  /// Shared with all objects created from the pool to find it on release.
+  struct control_block {
+    /// Reset once the pool is destroyed.
+    std::atomic<manager_pool*> pool;
+    std::atomic<std::thread::id> owner;
+  };
+
+  using control_ptr = std::shared_ptr<control_block>;
+
+  // -- constructors, destructors, and assignment operators --------------------
+
+  explicit manager_pool(std::size_t max_cached = default_max_cached);
+
+  ~manager_pool();
+
+  manager_pool(const manager_pool&) = delete;
+
+  manager_pool& operator=(const manager_pool&) = delete;
+
+  // -- memory management ------------------------------------------------------
+
+  /// Returns a block of `size` bytes.
+  void* allocate(std::size_t size);
+
+  /// Returns the block `ptr` of `size` bytes to the pool. The block is freed
+  /// if enough blocks of its size are cached.
+  void deallocate(void* ptr, std::size_t size) noexcept;
+
+  /// Returns the block `ptr` of `size` bytes to the pool of `ctrl` if it still
+  /// exists and is owned by the calling thread, frees the block otherwise.
+  static void release(const control_block& ctrl, void* ptr,
+                      std::size_t size) noexcept;
+
+  // -- properties -------------------------------------------------------------
+
+  /// Sets the number of blocks that are kept per object size.
+  void max_cached(std::size_t value) noexcept { max_cached_ = value; }
+
+  /// Sets the thread that owns the pool, initially the one that created it.
+  void owner(std::thread::id tid) noexcept { ctrl_->owner = tid; }
+
+  const control_ptr& control() const noexcept { return ctrl_; }
+
+  /// Returns the number of cached blocks.
+  std::size_t num_cached() const noexcept;
+
+private:
+  struct free_list {
+    std::size_t size;
+    std::vector<void*> blocks;
+  };
+
+  std::vector<free_list>::iterator find_list(std::size_t size) noexcept;
+
+  /// Returns the list for `size`, creating it if necessary.
+  free_list& list_for(std::size_t size);
+
+  std::size_t max_cached_;
+  /// Pools only ever see a handful of object sizes.
+  std::vector<free_list> free_;
+  control_ptr ctrl_;
+};
+
+namespace detail {
+
+/// Wraps `T` to return its memory to a pool instead of deleting it.
+template <class T>
+class pooled final : public T {
+public:
+  template <class... Ts>
+  explicit pooled(manager_pool& pool, Ts&&... xs)
+    : T(std::forward<Ts>(xs)...), ctrl_(pool.control()) {
+    // nop
+  }
+
+private:
+  void dispose() noexcept override {
+    auto ctrl = std::move(ctrl_);
+    this->~pooled();
+    manager_pool::release(*ctrl, this, sizeof(pooled));
+  }
+
+  manager_pool::control_ptr ctrl_;
+};
+
+} // namespace detail
+
+/// Constructs a `T` from `xs` in memory from `pool`.
+template <util::ref_countable T, class... Ts>
+util::intrusive_ptr<T> make_pooled(manager_pool& pool, Ts&&... xs) {
+  using type = detail::pooled<T>;
+  static_assert(alignof(type) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+                "pooled types must not be over-aligned");
+  auto mem = pool.allocate(sizeof(type));
+  type* ptr = nullptr;
+  try {
+    ptr = new (mem) type(pool, std::forward<Ts>(xs)...);
+  } catch (...) {
+    pool.deallocate(mem, sizeof(type));
+    throw;
+  }
+  // Objects start with a reference count of one
+  return util::intrusive_ptr<T>{ptr, false};
+}
+
+} // namespace net
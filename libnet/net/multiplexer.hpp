@@ -12,6 +12,9 @@
 
 #include "net/ip/v4_endpoint.hpp"
 
+#include "net/buffer_pool.hpp"
+#include "net/manager_pool.hpp"
+#include "net/offload_pool.hpp"
 #include "net/operation.hpp"
 #include "net/socket/tcp_stream_socket.hpp"
 #include "net/socket_manager.hpp"
@@ -21,13 +24,19 @@
 #include "util/error_or.hpp"
 #include "util/intrusive_ptr.hpp"
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <utility>
 
 namespace net {
 
 class multiplexer {
 public:
+  /// The monotonic clock that drives all timeouts.
+  using clock_type = std::chrono::steady_clock;
+  using time_point = clock_type::time_point;
+
   virtual ~multiplexer() = default;
 
   /// Initializes the multiplexer.
@@ -46,6 +55,10 @@ public:
 
   virtual bool running() const = 0;
 
+  /// Checks whether the caller runs on the multiplexer thread. Multiplexers
+  /// without a thread of their own are driven by the calling thread.
+  virtual bool is_multiplexer_thread() const { return true; }
+
   // -- Error Handling ---------------------------------------------------------
 
   /// Handles an error `err`.
@@ -56,26 +69,41 @@ public:
   /// The main multiplexing loop.
   virtual util::error poll_once(bool blocking) = 0;
 
-  /// Adds a new fd to the multiplexer for operation `initial`.
-  /// @warning This function is *NOT* thread-safe.
+  // The following functions may be called from any thread. Calls from other
+  // threads are forwarded to the multiplexer thread and applied in order.
+  // Managers are only passed by pointer, forwarded calls keep a reference
+  // until they were applied.
+
+  /// Adds a new fd to the multiplexer for operation `initial`. The handle of
+  /// `mgr` has to be in nonblocking mode already.
   virtual void add(socket_manager_ptr mgr, operation initial) = 0;
 
   /// Enables an operation `op` for socket manager `mgr`.
-  /// @warning This function is *NOT* thread-safe.
-  virtual void enable(socket_manager_ptr mgr, operation op) = 0;
+  virtual void enable(socket_manager* mgr, operation op) = 0;
 
   /// Disables an operation `op` for socket manager `mgr`.
   /// If `mgr` is not registered for any operation after disabling it, it is
   /// removed if `remove` is set.
-  /// @warning This function is *NOT* thread-safe.
-  virtual void disable(socket_manager_ptr mgr, operation op, bool remove) = 0;
+  virtual void disable(socket_manager* mgr, operation op, bool remove) = 0;
 
   /// Sets a timeout for socket_manager `mgr` at timepoint `when` and returns
   /// the id.
-  /// @warning This function is *NOT* thread-safe.
-  virtual uint64_t set_timeout(socket_manager_ptr mgr,
-                               std::chrono::system_clock::time_point when)
-    = 0;
+  virtual uint64_t set_timeout(socket_manager* mgr, time_point when) = 0;
+
+  /// Registers the timeout `timeout_id` that `set_timeout` reserved on another
+  /// thread.
+  /// @warning Must only be called on the multiplexer thread.
+  virtual void add_timeout(socket_manager* mgr, time_point when,
+                           uint64_t timeout_id) = 0;
+
+  /// Cancels the timeout with the id `timeout_id`. Returns false if the
+  /// timeout has already been handled or does not exist. Cancelling from
+  /// another thread always returns true.
+  virtual bool cancel_timeout(uint64_t timeout_id) = 0;
+
+  /// Calls `complete` on the finished `job` on the multiplexer thread. Called
+  /// by the workers of an `offload_pool`.
+  virtual void post(offload_job_ptr job) = 0;
 
   template <class Manager, class... Ts>
   util::error
@@ -83,8 +111,14 @@ public:
     auto sock = make_connected_tcp_stream_socket(ep);
     if (auto err = util::get_error(sock))
       return *err;
-    auto mgr = util::make_intrusive<Manager>(std::get<tcp_stream_socket>(sock),
-                                             this, std::forward<Ts>(xs)...);
+    auto hdl = std::get<tcp_stream_socket>(sock);
+    if (!nonblocking(hdl, true)) {
+      close(hdl);
+      return util::error{util::error_code::socket_operation_failed,
+                         "Failed to set nonblocking on sock={0}", hdl.id};
+    }
+    auto mgr = util::make_intrusive<Manager>(hdl, this,
+                                             std::forward<Ts>(xs)...);
     add(mgr, initial_op);
     return util::none;
   }
@@ -94,8 +128,41 @@ public:
   /// Returns the port the multiplexer is listening on.
   constexpr std::uint16_t port() const noexcept { return port_; }
 
+  /// Returns the time sampled once per iteration of the multiplexer loop,
+  /// right after waiting for events. Only the multiplexer thread may call
+  /// this.
+  time_point now() const noexcept { return now_; }
+
+  /// Returns the pool of I/O buffers shared by the transports of this
+  /// multiplexer.
+  /// @warning Must only be used on the multiplexer thread.
+  buffer_pool& buffers() noexcept { return buffer_pool_; }
+
+  /// Returns the pool that recycles the memory of socket managers created by
+  /// `make_pooled_manager`.
+  /// @warning Must only be used on the multiplexer thread.
+  manager_pool& pooled_managers() noexcept { return manager_pool_; }
+
+  /// Returns the pool that runs CPU-bound work of the managers, or `nullptr`
+  /// if `multiplexer.offload-threads` is not set.
+  offload_pool* offload() const noexcept { return offload_pool_.get(); }
+
+  /// Shares the pool `pool` with this multiplexer. The last multiplexer that
+  /// refers to a pool stops it.
+  void offload(offload_pool_ptr pool) {
+    if (offload_pool_)
+      offload_pool_->detach(this);
+    offload_pool_ = std::move(pool);
+  }
+
 protected:
   std::uint16_t port_{0};
+  time_point now_{clock_type::now()};
+  /// Counts the timeout ids reserved by threads other than the multiplexer.
+  std::atomic<std::uint64_t> next_timeout_id_{0};
+  buffer_pool buffer_pool_;
+  manager_pool manager_pool_;
+  offload_pool_ptr offload_pool_;
 };
 
 } // namespace net
@@ -0,0 +1,84 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      multiplexer_group.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "net/fwd.hpp"
+#include "util/fwd.hpp"
+
+#include "util/config.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+namespace net {
+
+/// Runs multiple multiplexers, one thread each, that accept connections on the
+/// same port. Every multiplexer owns its own acceptor which is bound using
+/// SO_REUSEPORT, leaving the distribution of new connections to the kernel.
+/// With `multiplexer.cpu-steering` enabled, the multiplexer with index `i` is
+/// pinned to cpu `i` and accepts the connections received by that cpu, which
+/// keeps the socket state of a connection local to a single core as long as
+/// there is one multiplexer per core.
+class multiplexer_group {
+public:
+  using multiplexer_list = std::vector<multiplexer_ptr>;
+
+  // -- constructors, destructors ----------------------------------------------
+
+  multiplexer_group() = default;
+
+  ~multiplexer_group();
+
+  multiplexer_group(const multiplexer_group&) = delete;
+
+  multiplexer_group& operator=(const multiplexer_group&) = delete;
+
+  /// Initializes `multiplexer.num-threads` multiplexers, defaulting to the
+  /// number of cores. The backend of each multiplexer is selected using
+  /// `multiplexer.backend`. All multiplexers share a single offload pool of
+  /// `multiplexer.offload-threads` workers.
+  /// @warning `factory` is shared by all multiplexers and has to be
+  /// thread-safe.
+  util::error init(socket_manager_factory_ptr factory, const util::config& cfg);
+
+  // -- Thread functions -------------------------------------------------------
+
+  /// Starts the threads of all multiplexers.
+  void start();
+
+  /// Shuts all multiplexers down.
+  void shutdown();
+
+  /// Joins with all multiplexers.
+  void join();
+
+  /// Checks whether any of the multiplexers is running.
+  bool running() const;
+
+  // -- members ----------------------------------------------------------------
+
+  /// Returns the port all multiplexers are listening on.
+  std::uint16_t port() const noexcept { return port_; }
+
+  /// Returns the number of multiplexers in this group.
+  std::size_t size() const noexcept { return mpxs_.size(); }
+
+  /// Returns the multiplexers in this group.
+  const multiplexer_list& multiplexers() const noexcept { return mpxs_; }
+
+private:
+  /// The configs of the multiplexers, which only keep a reference.
+  std::list<util::config> cfgs_;
+  multiplexer_list mpxs_;
+  std::uint16_t port_{0};
+};
+
+} // namespace net
@@ -12,20 +12,19 @@
 #include "util/fwd.hpp"
 
 #include "net/multiplexer.hpp"
-#include "net/socket/pipe_socket.hpp"
-#include "net/timeout_entry.hpp"
-
-#include "util/binary_serializer.hpp"
-#include "util/byte_buffer.hpp"
+#include "net/pollset_updater.hpp"
+#include "net/timing_wheel.hpp"
 
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <optional>
-#include <set>
 #include <span>
 #include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #if defined(__linux__)
 #  define EPOLL_MPX
@@ -55,11 +54,10 @@ class multiplexer_impl : public multiplexer {
   using update_list = std::vector<event_type>;
   using event_span = std::span<event_type>;
   using manager_map = std::unordered_map<socket_id, socket_manager_ptr>;
+#if defined(EPOLL_MPX)
+  using ready_list = std::vector<std::pair<socket_manager_ptr, operation>>;
+#endif
 
-  // Timeout handling types
-  using optional_timepoint
-    = std::optional<std::chrono::system_clock::time_point>;
-  using timeout_entry_set = std::set<timeout_entry>;
 
 public:
   // -- constructors, destructors ----------------------------------------------
@@ -85,12 +83,25 @@ public:
 
   bool running() const override;
 
+  bool is_multiplexer_thread() const override {
+    return std::this_thread::get_id()
+           == mpx_thread_id_.load(std::memory_order_relaxed);
+  }
+
   void set_thread_id(std::thread::id tid = {}) noexcept;
 
   // -- members ----------------------------------------------------------------
 
   std::uint16_t num_socket_managers() const { return managers_.size(); }
 
+#if defined(EPOLL_MPX)
+  /// Returns the number of mask changes that did not need an epoll_ctl call,
+  /// since they were coalesced with other changes of the same iteration.
+  std::uint64_t num_coalesced_updates() const noexcept {
+    return num_coalesced_updates_;
+  }
+#endif
+
   // -- Error Handling ---------------------------------------------------------
 
   void handle_error(const util::error& err) override;
@@ -101,16 +112,22 @@ public:
   void add(socket_manager_ptr mgr, operation initial) override;
 
   /// Enables an operation `op` for socket manager `mgr`.
-  void enable(socket_manager_ptr, operation op) override;
+  void enable(socket_manager*, operation op) override;
 
   /// Disables an operation `op` for socket manager `mgr`.
   /// If `mgr` is not registered for any operation after disabling it, it is
   /// removed if `remove` is set.
-  void disable(socket_manager_ptr mgr, operation op, bool remove) override;
+  void disable(socket_manager* mgr, operation op, bool remove) override;
+
+  std::uint64_t set_timeout(socket_manager* mgr, time_point when) override;
+
+  void add_timeout(socket_manager* mgr, time_point when,
+                   std::uint64_t timeout_id) override;
 
-  std::uint64_t
-  set_timeout(socket_manager_ptr mgr,
-              std::chrono::system_clock::time_point when) override;
+  bool cancel_timeout(std::uint64_t timeout_id) override;
+
+  /// Completes `job` on the multiplexer thread.
+  void post(offload_job_ptr job) override;
 
   /// Main multiplexing loop.
   util::error poll_once(bool blocking) override;
@@ -132,46 +149,89 @@ private:
   /// manager_map.
   manager_map::iterator del(manager_map::iterator it);
 
+#if defined(EPOLL_MPX)
+  /// Modifies the epollset for the handle of `mgr` using its current mask.
+  /// Events carry a pointer to `mgr`, which stays valid until the manager is
+  /// deleted from the epollset.
+  void mod(socket_manager* mgr, int op);
+
+  /// Records a change of the mask of `mgr`, which is applied to the epollset
+  /// before waiting for the next events.
+  void mark_dirty(socket_manager* mgr, operation registered);
+
+  /// Applies the net changes of all dirty managers to the epollset.
+  void apply_updates();
+
+  /// Handles the result `res` of handling `op` on `mgr`. Returns false if the
+  /// manager was deleted.
+  bool handle_result(socket_manager* mgr, event_result res, operation op);
+
+  /// Handles the managers of `ready` once, in the order they became ready.
+  void handle_ready(ready_list ready);
+
+  /// Sets up high-resolution timeouts using epoll_pwait2, or a timerfd if the
+  /// kernel does not support it.
+  util::error init_high_resolution_timers();
+
+  /// Waits for events until `deadline` with the configured precision.
+  int wait(bool blocking, std::optional<time_point> deadline);
+#elif defined(KQUEUE_MPX)
   /// Modifies the epollset for existing fds.
   void mod(int fd, int op, operation events);
+#endif
 
-  /// Writes the pollset_update code to the pipe
-  template <class... Ts>
-  ptrdiff_t write_to_pipe(Ts&&... ts) {
-    util::byte_buffer buf;
-    util::binary_serializer bs{buf};
-    bs(std::forward<Ts>(ts)...);
-    return write(pipe_writer_, util::as_const_bytes(buf));
-  }
-
-  bool is_multiplexer_thread() {
-    return std::this_thread::get_id() == mpx_thread_id_;
+  /// Checks whether `mgr` is registered. Managers may be passed to `enable`
+  /// and friends after they were deleted, e.g. by commands or jobs that
+  /// completed late.
+  bool is_registered(socket_manager* mgr) const {
+    const auto it = managers_.find(mgr->handle().id);
+    return (it != managers_.end()) && (it->second.get() == mgr);
   }
 
-  // pipe for synchronous access to mpx
-  pipe_socket pipe_writer_{invalid_socket_id};
-  pipe_socket pipe_reader_{invalid_socket_id};
+  // Thread-safe access to the mpx
+  pollset_updater_ptr updater_;
 
   // Multiplexing variables
   mpx_fd mpx_fd_{invalid_socket_id};
   pollset pollset_;
   update_list update_cache_;
+#if defined(EPOLL_MPX)
+  /// Managers whose mask changed, each manager stores the mask known to
+  /// epoll. Entries keep their manager alive until the changes are applied,
+  /// the storage is reused by the next iteration.
+  std::vector<socket_manager_ptr> dirty_;
+  std::uint64_t num_pending_updates_{0};
+  std::uint64_t num_coalesced_updates_{0};
+  /// Edge-triggered managers that stopped before their socket would block.
+  /// They are handled round-robin without polling for new events.
+  ready_list ready_;
+#endif
   manager_map managers_;
+  /// Keeps managers deleted while handling events alive until the current
+  /// batch of events is handled.
+  std::vector<socket_manager_ptr> graveyard_;
 
   // timeout handling
-  timeout_entry_set timeouts_;
-  optional_timepoint current_timeout_{std::nullopt};
-  std::uint64_t current_timeout_id_{0};
+  timing_wheel timeouts_;
+#if defined(EPOLL_MPX)
+  bool high_resolution_timers_{false};
+  /// Wakes up epoll_wait at the next timeout if epoll_pwait2 is unavailable.
+  int timer_fd_{invalid_socket_id};
+  time_point timer_deadline_{};
+#endif
 
   // thread variables
   bool shutting_down_{false};
   bool running_{false};
   std::thread mpx_thread_;
-  std::thread::id mpx_thread_id_;
+  /// Only ever equals the id of the thread reading it if that thread set it.
+  std::atomic<std::thread::id> mpx_thread_id_;
 
   const util::config* cfg_ = nullptr;
 };
 
+/// Creates the multiplexer backend selected by `multiplexer.backend`. Either
+/// "native" (epoll or kqueue, default) or "io_uring" (linux only).
 util::error_or<multiplexer_ptr>
 make_multiplexer(socket_manager_factory_ptr factory, const util::config& cfg);
 
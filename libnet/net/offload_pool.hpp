@@ -0,0 +1,182 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      offload_pool.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "net/fwd.hpp"
+
+#include "net/socket_manager.hpp"
+
+#include "util/intrusive_ptr.hpp"
+#include "util/ref_counted.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace net {
+
+/// CPU-bound work of a socket manager. `run` is called on a worker thread of
+/// an `offload_pool`, `complete` afterwards on the multiplexer thread of the
+/// manager, which is kept alive in between.
+class offload_job : public util::ref_counted {
+public:
+  explicit offload_job(socket_manager_ptr mgr) : mgr_{std::move(mgr)} {
+    // nop
+  }
+
+  /// Does the work. Must not touch the state of the manager.
+  virtual void run() = 0;
+
+  /// Hands the result to the manager, e.g. to resume writing. The manager
+  /// may have been removed from its multiplexer in the meantime.
+  virtual void complete() = 0;
+
+  socket_manager* manager() const noexcept { return mgr_.get(); }
+
+private:
+  socket_manager_ptr mgr_;
+};
+
+using offload_job_ptr = util::intrusive_ptr<offload_job>;
+
+namespace detail {
+
+/// Job that passes the result of `Work` to `Done`.
+template <class Work, class Done>
+class lambda_job final : public offload_job {
+public:
+  using result_type = std::invoke_result_t<Work&>;
+
+  lambda_job(socket_manager_ptr mgr, Work work, Done done)
+    : offload_job(std::move(mgr)),
+      work_(std::move(work)),
+      done_(std::move(done)) {
+    // nop
+  }
+
+  void run() override {
+    if constexpr (std::is_void_v<result_type>)
+      work_();
+    else
+      result_.emplace(work_());
+  }
+
+  void complete() override {
+    if constexpr (std::is_void_v<result_type>)
+      done_();
+    else
+      done_(std::move(*result_));
+  }
+
+private:
+  using storage_type = std::conditional_t<std::is_void_v<result_type>, bool,
+                                          std::optional<result_type>>;
+
+  Work work_;
+  Done done_;
+  storage_type result_{};
+};
+
+} // namespace detail
+
+/// Creates a job for `mgr` that calls `done` with the result of `work`.
+template <class Work, class Done>
+offload_job_ptr make_offload_job(socket_manager* mgr, Work work, Done done) {
+  using job_type = detail::lambda_job<Work, Done>;
+  return util::make_intrusive<job_type>(socket_manager_ptr{mgr},
+                                        std::move(work), std::move(done));
+}
+
+/// Work-stealing thread pool for CPU-bound work that would otherwise stall
+/// the multiplexer thread. Every worker has its own queue. Jobs submitted by
+/// a multiplexer are distributed round-robin, jobs submitted by a running job
+/// stay with its worker. Workers take their own jobs newest first and steal
+/// the oldest jobs of other workers once their queue ran empty. Finished jobs
+/// are posted back to the multiplexer of their manager, which calls
+/// `complete` on its own thread.
+class offload_pool {
+public:
+  // -- constructors, destructors, and assignment operators --------------------
+
+  /// Starts `num_workers` worker threads.
+  explicit offload_pool(std::size_t num_workers);
+
+  ~offload_pool();
+
+  offload_pool(const offload_pool&) = delete;
+
+  offload_pool& operator=(const offload_pool&) = delete;
+
+  // -- thread-safe interface --------------------------------------------------
+
+  /// Schedules `job` on one of the workers. Returns false and drops the job
+  /// if the pool was stopped.
+  bool submit(offload_job_ptr job);
+
+  /// Schedules `work` for `mgr` and calls `done` with its result on the
+  /// multiplexer thread of `mgr`. Returns false if the pool was stopped.
+  template <class Work, class Done>
+  bool submit(socket_manager* mgr, Work work, Done done) {
+    return submit(make_offload_job(mgr, std::move(work), std::move(done)));
+  }
+
+  /// Drops the queued jobs of the managers of `mpx` and waits until its
+  /// running jobs were posted. Called by multiplexers that share this pool
+  /// before they are destroyed.
+  void detach(multiplexer* mpx);
+
+  /// Stops and joins all workers, called by the destructor. Jobs that did not
+  /// run yet are dropped without completing them.
+  /// @warning All multiplexers have to be detached already.
+  void stop();
+
+  // -- properties -------------------------------------------------------------
+
+  std::size_t num_workers() const noexcept { return workers_.size(); }
+
+private:
+  struct worker {
+    std::mutex mtx;
+    std::deque<offload_job_ptr> jobs;
+    /// The multiplexer of the job that this worker runs, set while holding
+    /// the lock of the queue the job was taken from.
+    std::atomic<multiplexer*> running{nullptr};
+  };
+
+  /// The loop of the worker with index `id`.
+  void run(std::size_t id);
+
+  /// Returns the next job for worker `id`, stealing one if its queue is empty.
+  offload_job_ptr take(std::size_t id);
+
+  /// Appends `job` to the queue of worker `id`. Returns false if the pool was
+  /// stopped.
+  bool push(std::size_t id, offload_job_ptr job);
+
+  std::vector<std::unique_ptr<worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::atomic<std::size_t> next_worker_{0};
+  /// The number of queued jobs.
+  std::atomic<std::size_t> pending_{0};
+  /// The number of workers waiting for jobs.
+  std::atomic<std::size_t> sleeping_{0};
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::atomic<bool> stopping_{false};
+};
+
+} // namespace net
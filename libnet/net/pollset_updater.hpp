@@ -11,15 +11,25 @@
 #include "net/fwd.hpp"
 #include "util/fwd.hpp"
 
+#include "net/operation.hpp"
 #include "net/socket_manager.hpp"
 
+#include "util/intrusive_ptr.hpp"
+#include "util/mpsc_queue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 
 namespace net {
 
 /// Manages the pollset of the multiplexer implementation. Handles adding,
 /// enabling, disabling, and shutting down the multiplexer in a thread-safe
-/// manner.
+/// manner. Other threads push commands into a lock-free queue and wake up the
+/// multiplexer using an eventfd (a pipe on other platforms), which is only
+/// signalled when the queue was empty. The multiplexer drains all pending
+/// commands at once.
 class pollset_updater : public socket_manager {
 public:
   // -- member types -----------------------------------------------------------
@@ -27,21 +37,57 @@ public:
   /// Type for the opcodes used by this pollset_updater
   using opcode = std::uint8_t;
 
+  /// A command for the multiplexer. Commands that refer to a manager or a job
+  /// own a reference to it.
+  struct command {
+    opcode code = 0;
+    socket_manager* mgr = nullptr;
+    operation op = operation::none;
+    bool remove = false;
+    std::uint64_t timeout_id = 0;
+    std::chrono::steady_clock::time_point when{};
+    offload_job* job = nullptr;
+  };
+
   // -- constants --------------------------------------------------------------
 
   /// Opcode for adding a socket_manager to the pollset.
   static constexpr const opcode add_code = 0x00;
-  /// Opcode for triggering a shutdown of the multiplexer.
-  static constexpr const opcode shutdown_code = 0x01;
+  /// Opcode for enabling an operation of a socket_manager.
+  static constexpr const opcode enable_code = 0x01;
+  /// Opcode for disabling an operation of a socket_manager.
+  static constexpr const opcode disable_code = 0x02;
+  /// Opcode for registering a timeout of a socket_manager.
+  static constexpr const opcode set_timeout_code = 0x03;
+  /// Opcode for cancelling a timeout.
+  static constexpr const opcode cancel_timeout_code = 0x04;
+  /// Opcode for completing a job that ran on an offload_pool.
+  static constexpr const opcode complete_code = 0x05;
+
+  /// Default number of commands that can be pending at once.
+  static constexpr const std::size_t default_queue_size = 4096;
 
   // -- constructors, destructors, and assignment operators --------------------
 
-  /// Constructs a pollset updater
-  pollset_updater(pipe_socket read_handle, multiplexer* parent);
+  /// Constructs a pollset updater that is woken up by `read_handle`, which
+  /// is signalled using `write_handle`. Both are the same for an eventfd.
+  pollset_updater(socket read_handle, socket write_handle, multiplexer* parent,
+                  std::size_t queue_size = default_queue_size);
+
+  ~pollset_updater() override;
 
   /// Initializes the pollset updater.
   util::error init(const util::config& cfg) override;
 
+  // -- thread-safe interface --------------------------------------------------
+
+  /// Enqueues `cmd` for the multiplexer. Blocks while the queue is full.
+  void push(command cmd);
+
+  /// Requests the multiplexer to shut down after handling all pending
+  /// commands.
+  void request_shutdown();
+
   // -- interface functions ----------------------------------------------------
 
   /// Handles a read event, managing the pollset afterwards
@@ -52,6 +98,23 @@ public:
 
   /// Handles a timeout event
   event_result handle_timeout(uint64_t timeout_id) override;
+
+private:
+  /// Wakes up the multiplexer unless it was already signalled.
+  void signal();
+
+  socket write_handle_;
+  util::mpsc_queue<command> commands_;
+  std::atomic<bool> signalled_{false};
+  std::atomic<bool> shutdown_requested_{false};
 };
 
+using pollset_updater_ptr = util::intrusive_ptr<pollset_updater>;
+
+/// Creates a pollset updater for `mpx` along with its wakeup handle.
+util::error_or<pollset_updater_ptr>
+make_pollset_updater(multiplexer* mpx,
+                     std::size_t queue_size
+                     = pollset_updater::default_queue_size);
+
 } // namespace net
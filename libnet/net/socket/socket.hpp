@@ -85,4 +85,8 @@ util::error_or<uint16_t> port_of(socket x);
 /// Enables or disables reuseaddr I/O on `x`.
 bool reuseaddr(socket x, bool new_value);
 
+/// Enables or disables reuseport on `x`, which allows multiple sockets to
+/// bind to the same port and lets the kernel balance connections among them.
+bool reuseport(socket x, bool new_value);
+
 } // namespace net
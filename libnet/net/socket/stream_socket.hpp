@@ -14,8 +14,11 @@
 #include "util/fwd.hpp"
 
 #include <cstddef>
+#include <span>
 #include <utility>
 
+struct iovec;
+
 namespace net {
 
 /// Stream oriented socket.
@@ -40,4 +43,7 @@ ptrdiff_t read(stream_socket x, util::byte_span buf);
 /// Sends data to `x`.
 ptrdiff_t write(stream_socket x, util::const_byte_span buf);
 
+/// Sends the data of all buffers in `bufs` to `x` using a single system call.
+ptrdiff_t write(stream_socket x, std::span<const iovec> bufs);
+
 } // namespace net
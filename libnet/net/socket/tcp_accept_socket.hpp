@@ -30,11 +30,20 @@ using acceptor_pair = std::pair<tcp_accept_socket, uint16_t>;
 /// Sets `sock` to listen for incoming connections
 util::error listen(tcp_accept_socket sock, int conn_backlog);
 
-/// Accepts an incoming connection from sock
+/// Accepts an incoming connection from sock. The accepted socket is already
+/// in nonblocking mode.
 tcp_stream_socket accept(tcp_accept_socket sock);
 
-/// Creates a tcp_accept_socket that is bound to `port`
+/// Creates a nonblocking tcp_accept_socket that is bound to `port`. Sets
+/// SO_REUSEPORT before binding if `reuse_port` is set.
 util::error_or<acceptor_pair>
-make_tcp_accept_socket(const ip::v4_endpoint& ep, const int conn_backlog = 10);
+make_tcp_accept_socket(const ip::v4_endpoint& ep, const int conn_backlog = 10,
+                       bool reuse_port = false);
+
+/// Attaches a classic BPF program to the SO_REUSEPORT group of `sock`, that
+/// hands new connections to the socket with the index `cpu % group_size`,
+/// where `cpu` is the cpu that received the connection request. Sockets are
+/// indexed in the order they joined the group.
+util::error steer_by_cpu(tcp_accept_socket sock, std::uint32_t group_size);
 
 } // namespace net
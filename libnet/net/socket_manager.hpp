@@ -70,19 +70,43 @@ public:
   /// Tries to clear given flag(s) from the event mask.
   bool mask_del(operation flag) noexcept;
 
+  /// Records `registered` as the mask known to the pollset unless changes of
+  /// the mask are pending already. Returns whether this is the first change.
+  bool mark_dirty(operation registered) noexcept;
+
+  /// Checks whether the multiplexer has pending changes of the mask.
+  bool dirty() const noexcept { return dirty_; }
+
+  /// Clears the pending changes and returns the mask known to the pollset.
+  operation clear_dirty() noexcept;
+
+  /// Checks whether this manager is registered for edge-triggered events.
+  /// Edge-triggered managers handle events until the socket would block, or
+  /// return `event_result::again` if they stop early.
+  bool edge_triggered() const noexcept { return edge_triggered_; }
+
   // -- event loop management --------------------------------------------------
 
-  /// Registers this socket_manager for read-events at the multiplexer
+  /// Registers this socket_manager for read-events at the multiplexer. May be
+  /// called from any thread.
   void register_reading();
 
-  /// Registers this socket_manager for write-events at the multiplexer
-  void register_writing();
+  /// Registers this socket_manager for write-events at the multiplexer. May be
+  /// called from any thread. Transports may override this to write pending
+  /// data right away.
+  virtual void register_writing();
 
-  /// Sets a timeout in `duration` milliseconds with the id `timeout_id`
+  /// Sets a timeout `duration` milliseconds after the current loop time of
+  /// the multiplexer and returns its id. Other threads measure from the
+  /// current time instead.
   uint64_t set_timeout_in(std::chrono::milliseconds duration);
 
   /// Sets a timeout at timepoint `point` with the id `timeout_id`
-  uint64_t set_timeout_at(std::chrono::system_clock::time_point point);
+  uint64_t set_timeout_at(std::chrono::steady_clock::time_point point);
+
+  /// Cancels the timeout with the id `timeout_id`. Returns false if the
+  /// timeout has already been handled or does not exist.
+  bool cancel_timeout(uint64_t timeout_id);
 
   // -- event handling ---------------------------------------------------------
 
@@ -98,6 +122,11 @@ public:
   /// Handles an error
   void handle_error(const util::error& err);
 
+protected:
+  /// Opts into edge-triggered events. Only takes effect before the manager is
+  /// added to the multiplexer, i.e., in `init`.
+  void edge_triggered(bool value) noexcept { edge_triggered_ = value; }
+
 private:
   /// The managed socket
   socket handle_;
@@ -105,6 +134,12 @@ private:
   multiplexer* mpx_;
   /// The mask containing all currently registered events
   operation mask_;
+  /// Whether the manager wants edge-triggered events
+  bool edge_triggered_ = false;
+  /// Whether the multiplexer has pending changes of the mask
+  bool dirty_ = false;
+  /// The mask known to the pollset while changes are pending
+  operation registered_mask_ = operation::none;
 };
 
 using socket_manager_ptr = util::intrusive_ptr<socket_manager>;
@@ -10,6 +10,11 @@
 
 #include "net/fwd.hpp"
 
+#include "net/manager_pool.hpp"
+#include "net/multiplexer.hpp"
+
+#include <utility>
+
 namespace net {
 
 /// Base class for socket manager factory classes.
@@ -20,4 +25,14 @@ public:
   virtual socket_manager_ptr make(socket handle, multiplexer* mpx) = 0;
 };
 
+/// Creates a `Manager` for `handle` in memory from the manager pool of `mpx`.
+/// Factories use this to recycle the managers of closed connections when
+/// connections are short-lived.
+template <class Manager, class Socket, class... Ts>
+socket_manager_ptr make_pooled_manager(Socket handle, multiplexer* mpx,
+                                       Ts&&... xs) {
+  return make_pooled<Manager>(mpx->pooled_managers(), handle, mpx,
+                              std::forward<Ts>(xs)...);
+}
+
 } // namespace net
@@ -11,6 +11,8 @@
 #include "net/fwd.hpp"
 
 #include "net/event_result.hpp"
+#include "net/layer.hpp"
+#include "net/operation.hpp"
 #include "net/receive_policy.hpp"
 #include "net/socket/stream_socket.hpp"
 #include "net/transport.hpp"
@@ -20,17 +22,23 @@
 #include "util/format.hpp"
 #include "util/logger.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <utility>
 
 namespace net {
 
-/// Implements a stream oriented transport.
+/// Implements a stream oriented transport. The next layer is either an
+/// `event_layer`, which consumes all data passed to `consume`, or a
+/// `framing_layer`, which returns the number of bytes it used. Unused bytes
+/// are passed again once more data arrived.
 template <class NextLayer>
 class stream_transport : public transport {
 public:
   template <class... Ts>
   stream_transport(stream_socket handle, multiplexer* mpx, Ts&&... xs)
     : transport(handle, mpx), next_layer_(*this, std::forward<Ts>(xs)...) {
+    static_assert(upper_layer<NextLayer>);
     LOG_DEBUG("Creating stream_transport with ", NET_ARG2("id", handle.id));
   }
 
@@ -38,10 +46,6 @@ public:
     LOG_DEBUG("init stream_transport with ", NET_ARG2("socket", handle().id));
     if (auto err = transport::init(cfg))
       return err;
-    if (!nonblocking(handle(), true))
-      return {util::error_code::runtime_error,
-              util::format("Failed to set nonblocking on sock={0}",
-                           handle().id)};
     return next_layer_.init(cfg);
   }
 
@@ -51,20 +55,38 @@ public:
     LOG_TRACE();
     LOG_DEBUG("handle read_event on ", NET_ARG2("socket", handle().id));
     for (size_t i = 0; i < transport::max_consecutive_reads_; ++i) {
-      auto data = read_buffer_.data() + received_;
-      auto size = read_buffer_.size() - received_;
-      auto read_res = read(handle<stream_socket>(), std::span(data, size));
+      // The next layer paused reading, it registers for reading again once it
+      // configures the next read. Only the read interest is dropped, `done`
+      // would remove the manager once nothing else is pending.
+      if (max_read_size_ == 0) {
+        mpx()->disable(this, operation::read, false);
+        return event_result::ok;
+      }
+      // Buffered data has to be completed before reading into the scratch
+      const bool scratch = scratch_reads_ && (received_ == 0);
+      util::byte_span dest;
+      if (scratch) {
+        dest = mpx()->buffers().scratch(max_read_size_);
+      } else {
+        prepare_read();
+        dest = util::byte_span{read_buffer_}.subspan(received_);
+      }
+      if (dest.empty()) {
+        handle_error({util::error_code::runtime_error,
+                      "[stream_transport::read()] read buffer is full"});
+        return event_result::error;
+      }
+      auto read_res = read(handle<stream_socket>(), dest);
       if (read_res > 0) {
         LOG_DEBUG("Read ", read_res, " bytes from ",
                   NET_ARG2("socket", handle().id));
-        received_ += read_res;
-        if (received_ >= min_read_size_) {
-          if (next_layer_.consume(
-                util::const_byte_span{read_buffer_.data(), received_})
-              == event_result::error)
+        if (scratch) {
+          if (consume_scratch(dest.first(read_res)) == event_result::error)
+            return event_result::error;
+        } else {
+          received_ += read_res;
+          if (consume_buffered() == event_result::error)
             return event_result::error;
-          else
-            received_ = 0; // Data should be consumed completely
         }
       } else if (read_res == 0) {
         return event_result::error;
@@ -75,71 +97,209 @@ public:
                                      + last_socket_error_as_string()));
           return event_result::error;
         }
+        release_buffers();
         return event_result::ok;
       }
     }
-    return event_result::ok;
+    release_buffers();
+    return stopped_early();
   }
 
   event_result handle_write_event() override {
     LOG_TRACE();
     LOG_DEBUG("handle write_event on ", NET_ARG2("socket", handle().id));
+    const auto res = write_some();
+    if (res == event_result::error) {
+      handle_error({util::error_code::socket_operation_failed,
+                    util::format("[stream::write()] errno = {0}: {1}", errno,
+                                 last_socket_error_as_string())});
+    } else if (res == event_result::done) {
+      release_buffers();
+      // A paused transport stays registered until the next layer reads again
+      if (max_read_size_ == 0) {
+        mpx()->disable(this, operation::write, false);
+        return event_result::ok;
+      }
+    }
+    return res;
+  }
+
+  event_result handle_timeout(uint64_t id) override {
+    return next_layer_.handle_timeout(id);
+  }
+
+  // -- properties -------------------------------------------------------------
+
+  NextLayer& next_layer() noexcept { return next_layer_; }
+
+  // -- public API -------------------------------------------------------------
+
+  /// Registers this transport for writing. In write-through mode, pending data
+  /// is written right away on the multiplexer thread and the multiplexer only
+  /// waits for the socket to become writable after a partial write. Other
+  /// threads always leave the write to the multiplexer.
+  void register_writing() override {
+    LOG_TRACE();
+    if (!mpx()->is_multiplexer_thread()) {
+      socket_manager::register_writing();
+      return;
+    }
+    if (writing_)
+      return; // The ongoing write picks up the new data
+    if (write_through_
+        && ((mask() & operation::write) == operation::none)) {
+      writing_ = true;
+      const auto res = write_some();
+      writing_ = false;
+      if (res == event_result::done) {
+        release_buffers();
+        return;
+      } else if (res == event_result::error) {
+        handle_error({util::error_code::socket_operation_failed,
+                      util::format("[stream::write()] errno = {0}: {1}", errno,
+                                   last_socket_error_as_string())});
+        return;
+      }
+    }
+    socket_manager::register_writing();
+  }
+
+  /// Configures the amount to be read next. Unconsumed data stays buffered,
+  /// the buffer is resized before the next read. `receive_policy::stop()`
+  /// pauses reading until the next layer registers for reading again.
+  void configure_next_read(receive_policy policy) override {
+    min_read_size_ = policy.min_size;
+    max_read_size_ = policy.max_size;
+    LOG_DEBUG("Configuring next read on ", NET_ARG2("socket", handle().id),
+              ": ", NET_ARG(min_read_size_), ", ",
+              NET_ARG2("max_read_size_", policy.max_size));
+  }
+
+private:
+  /// Returns the unconsumed data in the read buffer.
+  util::const_byte_span buffered() const noexcept {
+    return {read_buffer_.data() + read_offset_, received_ - read_offset_};
+  }
+
+  /// Applies the configured size to the read buffer and makes room after the
+  /// unconsumed data. Data is only moved if the buffer has no room left.
+  void prepare_read() {
+    const auto size = std::max(max_read_size_, received_ - read_offset_);
+    if (pooled_buffers_ && (read_buffer_.capacity() == 0))
+      read_buffer_ = mpx()->buffers().acquire(size);
+    if ((read_buffer_.size() == size) && (received_ < read_buffer_.size()))
+      return;
+    if (read_offset_ > 0) {
+      std::memmove(read_buffer_.data(), read_buffer_.data() + read_offset_,
+                   received_ - read_offset_);
+      received_ -= std::exchange(read_offset_, 0);
+    }
+    read_buffer_.resize(size);
+  }
+
+  /// Hands `data` to the next layer until it waits for more data. Layers that
+  /// return the number of bytes they used leave the rest of the data, e.g.,
+  /// the start of the next frame. All other layers consume all data at once.
+  /// Returns the number of consumed bytes or a negative value on error, which
+  /// includes layers that claim to have used more data than they received.
+  std::ptrdiff_t consume_some(util::const_byte_span data) {
+    size_t consumed = 0;
+    while ((consumed < data.size())
+           && ((data.size() - consumed) >= min_read_size_)) {
+      const auto rest = data.subspan(consumed);
+      if constexpr (event_layer<NextLayer>) {
+        if (next_layer_.consume(rest) == event_result::error)
+          return -1;
+        consumed = data.size(); // Data should be consumed completely
+      } else {
+        const auto res = next_layer_.consume(rest);
+        if (res < 0)
+          return -1;
+        if (static_cast<size_t>(res) > rest.size()) {
+          handle_error({util::error_code::runtime_error,
+                        "[stream_transport::consume()] layer consumed more "
+                        "data than it received"});
+          return -1;
+        }
+        if (res == 0)
+          break; // Waits for the rest of the frame
+        consumed += static_cast<size_t>(res);
+      }
+    }
+    return static_cast<std::ptrdiff_t>(consumed);
+  }
+
+  /// Hands the buffered data to the next layer.
+  event_result consume_buffered() {
+    const auto consumed = consume_some(buffered());
+    if (consumed < 0)
+      return event_result::error;
+    read_offset_ += static_cast<size_t>(consumed);
+    if (read_offset_ == received_)
+      read_offset_ = received_ = 0;
+    return event_result::ok;
+  }
+
+  /// Hands `data` from the scratch buffer to the next layer and copies the
+  /// unconsumed rest into the read_buffer.
+  event_result consume_scratch(util::const_byte_span data) {
+    const auto consumed = consume_some(data);
+    if (consumed < 0)
+      return event_result::error;
+    const auto rest = data.subspan(static_cast<size_t>(consumed));
+    if (!rest.empty()) {
+      received_ = rest.size();
+      prepare_read();
+      std::memcpy(read_buffer_.data(), rest.data(), rest.size());
+    }
+    return event_result::ok;
+  }
+
+  /// Writes pending data until the socket would block. Returns `done` once all
+  /// data has been written.
+  event_result write_some() {
     auto done_writing = [&]() {
-      return (write_buffer_.empty() && !next_layer_.has_more_data());
+      return (write_buffer_.empty() && write_queue_.empty()
+              && !next_layer_.has_more_data());
     };
     auto fetch = [&]() {
+      acquire_write_buffer();
       for (size_t i = 0; next_layer_.has_more_data()
                          && (i < transport::max_consecutive_fetches_);
            ++i)
         next_layer_.produce();
-      return !write_buffer_.empty();
+      flush_write_buffer();
+      return !write_queue_.empty();
     };
-    if (write_buffer_.empty())
+    flush_write_buffer();
+    if (write_queue_.empty())
       if (!fetch())
         return event_result::done;
     for (size_t i = 0; i < transport::max_consecutive_writes_; ++i) {
-      auto write_res = write(handle<stream_socket>(), write_buffer_);
+      // Writes all queued segments at once, partial writes only advance the
+      // view of the first segment
+      auto write_res = write_queue_.write(handle<stream_socket>());
       if (write_res > 0) {
         LOG_DEBUG("Wrote ", write_res, " bytes to ",
                   NET_ARG2("socket", handle().id));
-        write_buffer_.erase(write_buffer_.begin(),
-                            write_buffer_.begin() + write_res);
-        if (write_buffer_.empty())
+        if (write_queue_.empty())
           if (!fetch())
             return event_result::done;
       } else {
-        if (last_socket_error_is_temporary()) {
-          return event_result::ok;
-        } else {
-          handle_error({util::error_code::socket_operation_failed,
-                        util::format("[stream::write()] errno = {0}: {1}",
-                                     errno, last_socket_error_as_string())});
-          return event_result::error;
-        }
+        return last_socket_error_is_temporary() ? event_result::ok
+                                                : event_result::error;
       }
     }
-    return done_writing() ? event_result::done : event_result::ok;
+    return done_writing() ? event_result::done : stopped_early();
   }
 
-  event_result handle_timeout(uint64_t id) override {
-    return next_layer_.handle_timeout(id);
-  }
-
-  // -- public API -------------------------------------------------------------
+  /// Offset of the unconsumed data in the read buffer.
+  size_t read_offset_ = 0;
+  size_t max_read_size_ = 0;
 
-  /// Configures the amount to be read next
-  void configure_next_read(receive_policy policy) override {
-    received_ = 0;
-    min_read_size_ = policy.min_size;
-    if (read_buffer_.size() != policy.max_size)
-      read_buffer_.resize(policy.max_size);
-    LOG_DEBUG("Configuring next read on ", NET_ARG2("socket", handle().id),
-              ": ", NET_ARG(min_read_size_), ", ",
-              NET_ARG2("max_read_size_", policy.max_size));
-  }
-
-private:
   NextLayer next_layer_;
+  /// Set while `write_some` runs outside of a write event.
+  bool writing_ = false;
 };
 
 } // namespace net
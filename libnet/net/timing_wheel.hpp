@@ -0,0 +1,192 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      timing_wheel.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "net/socket_id.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace net {
+
+/// Hierarchical timing wheel that stores the timeouts of a multiplexer.
+/// Timeouts are hashed into the slots of `num_levels` wheels of `num_slots`
+/// slots each, where a slot of level `n` spans `num_slots^n` ticks. Adding
+/// and cancelling a timeout takes constant time. Slots of the upper levels
+/// are cascaded into the lower ones once the wheel reaches them.
+///
+/// Timeouts live in a slab of nodes that is reused once they expire or get
+/// cancelled. Their ids encode the node and its generation, so looking up a
+/// timeout allocates nothing and stale ids never match a reused node.
+class timing_wheel {
+public:
+  using clock_type = std::chrono::steady_clock;
+  using time_point = clock_type::time_point;
+
+  static constexpr std::size_t num_levels = 4;
+  static constexpr std::size_t slot_bits = 8;
+  static constexpr std::size_t num_slots = std::size_t{1} << slot_bits;
+
+  /// Resolution used by multiplexers with high-resolution timers enabled.
+  static constexpr std::chrono::microseconds high_resolution{1};
+
+  /// Marks ids that callers reserved before adding their timeout, e.g. on
+  /// another thread. The wheel never hands out ids with this bit set.
+  static constexpr std::uint64_t reserved_id = std::uint64_t{1} << 63;
+
+  /// An id that never belongs to a timeout.
+  static constexpr std::uint64_t invalid_id
+    = std::numeric_limits<std::uint32_t>::max();
+
+  /// An expired timeout.
+  struct timeout {
+    socket_id handle;
+    std::uint64_t id;
+  };
+
+  // -- constructors, destructors, and assignment operators --------------------
+
+  /// Creates a wheel that advances in steps of `resolution`.
+  explicit timing_wheel(
+    std::chrono::nanoseconds resolution = std::chrono::milliseconds{1});
+
+  timing_wheel(const timing_wheel&) = delete;
+
+  timing_wheel& operator=(const timing_wheel&) = delete;
+
+  timing_wheel(timing_wheel&&) = default;
+
+  timing_wheel& operator=(timing_wheel&&) = default;
+
+  // -- timeout management -----------------------------------------------------
+
+  /// Registers a timeout for `handle` at `when` and returns its id.
+  std::uint64_t add(socket_id handle, time_point when);
+
+  /// Registers a timeout for `handle` at `when` using an id reserved by the
+  /// caller, which has to contain `reserved_id`. Ids must not be used for
+  /// more than one pending timeout. Reserved ids are looked up in a map,
+  /// which makes them slower than the ids of the wheel.
+  void add(socket_id handle, time_point when, std::uint64_t id);
+
+  /// Cancels the timeout `id`. Returns false if it was unknown or already
+  /// handed out by `pop`.
+  bool cancel(std::uint64_t id);
+
+  /// Cancels all timeouts of `handle`, including due ones, e.g., before the
+  /// socket is closed and its id is reused. Returns the number of timeouts.
+  std::size_t cancel_all(socket_id handle);
+
+  /// Moves all timeouts that expired at `now` to the list of due timeouts.
+  void advance(time_point now);
+
+  /// Removes the next due timeout in the order of expiry.
+  std::optional<timeout> pop();
+
+  // -- properties -------------------------------------------------------------
+
+  /// Returns the earliest point in time at which the wheel has to advance.
+  /// Timeouts in the upper levels are only cascaded at that point, which may
+  /// be before they expire.
+  std::optional<time_point> next_expiry() const;
+
+  /// Returns the number of registered timeouts, including due ones.
+  std::size_t size() const noexcept {
+    return nodes_.size() - num_lists - free_.size();
+  }
+
+  /// Checks whether there are no registered timeouts.
+  bool empty() const noexcept { return size() == 0; }
+
+private:
+  using index_type = std::uint32_t;
+  using bitmap = std::array<std::uint64_t, num_slots / 64>;
+
+  static constexpr index_type due_list = num_levels * num_slots;
+  static constexpr index_type num_lists = due_list + 1;
+  static constexpr index_type no_node = std::numeric_limits<index_type>::max();
+  /// Keeps generations from reaching the bit of `reserved_id`.
+  static constexpr std::uint32_t generation_mask = ~std::uint32_t{0} >> 1;
+
+  /// Timeouts and list heads share the same storage, the first `num_lists`
+  /// nodes are the sentinels of the slot lists and the due list. Timeouts of
+  /// the same handle are chained in addition. Free nodes have an invalid id.
+  struct node {
+    index_type prev;
+    index_type next;
+    index_type list;
+    socket_id handle;
+    std::uint64_t id;
+    std::int64_t tick;
+    index_type handle_prev = no_node;
+    index_type handle_next = no_node;
+    std::uint32_t generation = 0;
+  };
+
+  std::int64_t to_tick(time_point tp) const noexcept;
+
+  time_point to_time_point(std::int64_t tick) const noexcept;
+
+  /// Returns the next tick that expires or cascades timeouts.
+  std::optional<std::int64_t> next_tick() const noexcept;
+
+  /// Returns a free node for a new timeout.
+  index_type allocate();
+
+  /// Links the node `idx` of a new timeout into the wheel.
+  void insert(index_type idx, socket_id handle, time_point when,
+              std::uint64_t id);
+
+  /// Returns the node of the timeout `id` or `no_node` if it is unknown.
+  index_type find(std::uint64_t id) const;
+
+  /// Links node `idx` into the slot that matches its tick.
+  void schedule(index_type idx) noexcept;
+
+  /// Re-schedules all nodes from the slot of `level` that `tick_` points to.
+  void cascade(std::size_t level) noexcept;
+
+  void link(index_type list, index_type idx) noexcept;
+
+  void unlink(index_type idx) noexcept;
+
+  /// Removes node `idx` from the chain of its handle.
+  void unlink_handle(index_type idx) noexcept;
+
+  /// Unlinks node `idx` from its slot and frees it, which invalidates its id.
+  void release(index_type idx);
+
+  /// Moves all nodes of `list` to the due list.
+  void expire(index_type list) noexcept;
+
+  /// Returns the first occupied slot of `level` at or after `from`.
+  std::optional<std::size_t> find_occupied(std::size_t level,
+                                           std::size_t from) const noexcept;
+
+  std::chrono::nanoseconds resolution_;
+  /// The next tick to process.
+  std::int64_t tick_;
+  /// The number of timeouts that are linked into a slot.
+  std::size_t num_scheduled_{0};
+  std::vector<node> nodes_;
+  std::vector<index_type> free_;
+  std::array<bitmap, num_levels> occupied_{};
+  /// The first node in the chain of each handle, indexed by the handle.
+  std::vector<index_type> handles_;
+  /// The nodes of timeouts with reserved ids.
+  std::unordered_map<std::uint64_t, index_type> reserved_;
+};
+
+} // namespace net
@@ -13,16 +13,25 @@
 #include "net/event_result.hpp"
 #include "net/layer.hpp"
 #include "net/receive_policy.hpp"
+#include "net/transport.hpp"
 
 #include "openssl/tls_context.hpp"
 
 #include "util/byte_array.hpp"
+#include "util/byte_buffer.hpp"
 #include "util/error.hpp"
 
+#include <chrono>
+#include <cstdint>
+#include <utility>
+
 namespace net {
 
-template <class NextLayer>
-class tls : public layer {
+/// Encrypts the data of `NextLayer`, which is instantiated with the tls layer
+/// as its parent. `Parent` is the type of the layer below, which is the
+/// transport unless tls is stacked on top of another layer.
+template <template <class> class NextLayer, class Parent = transport>
+class tls {
   /// Custom enum for relevant states of the SSL
   enum ssl_status {
     ok,
@@ -33,8 +42,10 @@ class tls : public layer {
   static constexpr const std::size_t buffer_size = 2048;
 
 public:
+  using next_layer_type = NextLayer<tls>;
+
   template <class... Ts>
-  tls(layer& parent, openssl::tls_context& ctx, bool is_client, Ts&&... xs)
+  tls(Parent& parent, openssl::tls_context& ctx, bool is_client, Ts&&... xs)
     : parent_{parent},
       next_layer_{*this, std::forward<Ts>(xs)...},
       is_client_{is_client},
@@ -47,11 +58,14 @@ public:
     else
       SSL_set_accept_state(ssl_);
     SSL_set_bio(ssl_, rbio_, wbio_);
+    static_assert(event_layer<next_layer_type>);
+    static_assert(lower_layer<Parent>);
+    static_assert(lower_layer<tls>);
   }
 
   // -- Upfacing interface (towards application) -------------------------------
 
-  util::error init(const util::config&) override {
+  util::error init(const util::config& cfg) {
     // Check the relevant ssl members
     if (!ssl_)
       return {util::error_code::openssl_error, "SSL object was not created"};
@@ -66,14 +80,14 @@ public:
       }
     }
     parent_.configure_next_read(receive_policy::up_to(buffer_size));
-    return next_layer_.init();
+    return next_layer_.init(cfg);
   }
 
-  bool has_more_data() override {
+  bool has_more_data() {
     return (!encrypt_buf_.empty() || next_layer_.has_more_data());
   }
 
-  event_result produce() override {
+  event_result produce() {
     if (next_layer_.produce() == event_result::error)
       return event_result::error;
     if (auto err = encrypt()) {
@@ -84,7 +98,7 @@ public:
   }
 
   /// Takes received data from the transport and consumes it
-  event_result consume(util::const_byte_span bytes) override {
+  event_result consume(util::const_byte_span bytes) {
     while (!bytes.empty()) {
       auto write_res = BIO_write(rbio_,
                                  reinterpret_cast<const void*>(bytes.data()),
@@ -135,47 +149,49 @@ public:
     return event_result::ok;
   }
 
-  event_result handle_timeout(uint64_t id) override {
+  event_result handle_timeout(uint64_t id) {
     return next_layer_.handle_timeout(id);
   }
 
   // -- Downfacing interface (towards transport) -------------------------------
 
   /// Configures the amount to be read next
-  void configure_next_read(receive_policy) override {
+  void configure_next_read(receive_policy) {
     // Currently ignored for following applications.
   }
 
   /// Returns a reference to the send_buffer
-  util::byte_buffer& write_buffer() override { return encrypt_buf_; }
+  util::byte_buffer& write_buffer() { return encrypt_buf_; }
 
   /// Enqueues data to the transport extension
-  void enqueue(util::const_byte_span bytes) override {
+  void enqueue(util::const_byte_span bytes) {
     encrypt_buf_.insert(encrypt_buf_.end(), bytes.begin(), bytes.end());
   }
 
   /// Called when an error occurs
-  void handle_error(const util::error& err) override {
+  void handle_error(const util::error& err) {
     parent_.handle_error(err);
   }
 
   /// Registers the stack for write events
-  void register_writing() override { parent_.register_writing(); }
+  void register_writing() { parent_.register_writing(); }
 
   /// Sets a timeout in `duration` milliseconds with the id `timeout_id`
-  uint64_t set_timeout_in(std::chrono::milliseconds duration) override {
+  uint64_t set_timeout_in(std::chrono::milliseconds duration) {
     return parent_.set_timeout_in(duration);
   }
 
   /// Sets a timeout at timepoint `point` with the id `timeout_id`
-  uint64_t
-  set_timeout_at(std::chrono::system_clock::time_point point) override {
+  uint64_t set_timeout_at(std::chrono::steady_clock::time_point point) {
     return parent_.set_timeout_at(point);
   }
 
   /// Checks wether this session is initialized (Handshake is done)
   bool handshake_done() { return SSL_is_init_finished(ssl_); }
 
+  /// Returns a reference to the following layer
+  next_layer_type& next_layer() { return next_layer_; }
+
 private:
   util::error encrypt() {
     // Wait for initialization to be done
@@ -246,9 +262,9 @@ private:
   }
 
   // Reference to the parent transport
-  layer& parent_;
+  Parent& parent_;
   // NextLayer
-  NextLayer next_layer_;
+  next_layer_type next_layer_;
 
   /// Denotes session to be either server, or client
   const bool is_client_;
@@ -12,11 +12,21 @@
 
 #include "net/fwd.hpp"
 
+#include "net/buffer_pool.hpp"
+#include "net/event_result.hpp"
+#include "net/multiplexer.hpp"
+#include "net/write_queue.hpp"
+
 #include "util/byte_buffer.hpp"
 #include "util/byte_span.hpp"
 #include "util/config.hpp"
 #include "util/error.hpp"
+#include "util/intrusive_ptr.hpp"
 #include "util/logger.hpp"
+#include "util/ref_counted.hpp"
+#include "util/shared_buffer.hpp"
+
+#include <utility>
 
 namespace net {
 
@@ -35,9 +45,15 @@ public:
                                         std::int64_t{20});
     max_consecutive_writes_ = cfg.get_or("transport.max-consecutive-writes",
                                          std::int64_t{20});
+    write_through_ = cfg.get_or("transport.write-through", false);
+    edge_triggered(cfg.get_or("transport.edge-triggered", false));
+    pooled_buffers_ = cfg.get_or("transport.pooled-buffers", false);
+    scratch_reads_ = cfg.get_or("transport.scratch-reads", false);
     LOG_DEBUG(NET_ARG(max_consecutive_fetches_),
               NET_ARG(max_consecutive_reads_),
-              NET_ARG(max_consecutive_writes_));
+              NET_ARG(max_consecutive_writes_), NET_ARG(write_through_),
+              NET_ARG2("edge_triggered", edge_triggered()),
+              NET_ARG(pooled_buffers_), NET_ARG(scratch_reads_));
     return util::none;
   }
 
@@ -46,19 +62,104 @@ public:
   /// Configures the amount to be read next
   virtual void configure_next_read(receive_policy policy) = 0;
 
-  /// Returns a reference to the send_buffer
-  util::byte_buffer& write_buffer() { return write_buffer_; }
+  /// Returns a reference to the send_buffer. Data in the send_buffer is sent
+  /// after all previously enqueued data.
+  util::byte_buffer& write_buffer() {
+    acquire_write_buffer();
+    return write_buffer_;
+  }
 
+  /// Copies `bytes` into the send_buffer. Small messages are cheaper to copy
+  /// than to queue separately.
   void enqueue(util::const_byte_span bytes) {
     LOG_TRACE();
-    // TODO: copying the data is not very performant. Think of another solution
+    acquire_write_buffer();
     write_buffer_.insert(write_buffer_.end(), bytes.begin(), bytes.end());
   }
 
+  /// Enqueues `buf` without copying it.
+  void enqueue(util::byte_buffer&& buf) {
+    LOG_TRACE();
+    flush_write_buffer();
+    write_queue_.push(std::move(buf));
+  }
+
+  /// Enqueues `bytes` without copying them. The data is kept alive by a
+  /// reference to `owner` until it was sent.
+  void enqueue(util::intrusive_ptr<util::ref_counted> owner,
+               util::const_byte_span bytes) {
+    LOG_TRACE();
+    flush_write_buffer();
+    write_queue_.push(std::move(owner), bytes);
+  }
+
+  /// Enqueues `slice` by reference. The same slice can be enqueued at any
+  /// number of transports without copying it.
+  void enqueue(const util::shared_slice& slice) {
+    LOG_TRACE();
+    flush_write_buffer();
+    write_queue_.push(slice.buffer(), slice.bytes());
+  }
+
+  /// Enqueues `bytes` without copying them. The caller keeps them alive until
+  /// `on_done` is called.
+  void enqueue(util::const_byte_span bytes,
+               write_queue::completion_handler on_done) {
+    LOG_TRACE();
+    flush_write_buffer();
+    write_queue_.push(bytes, std::move(on_done));
+  }
+
 protected:
+  /// Returns the result for handlers that stopped before the socket would
+  /// block. Only edge-triggered transports need to be handled again.
+  event_result stopped_early() const noexcept {
+    return edge_triggered() ? event_result::again : event_result::ok;
+  }
+
+  /// Borrows a send_buffer from the multiplexer if buffers are pooled.
+  void acquire_write_buffer() {
+    if (pooled_buffers_ && (write_buffer_.capacity() == 0))
+      write_buffer_ = mpx()->buffers().acquire(
+        buffer_pool::size_classes.front());
+  }
+
+  /// Returns drained buffers to the multiplexer if buffers are pooled.
+  void release_buffers() {
+    // Remainders of partial frames are only kept until they were consumed
+    if (scratch_reads_ && !pooled_buffers_ && (received_ == 0))
+      read_buffer_ = {};
+    if (!pooled_buffers_)
+      return;
+    auto& pool = mpx()->buffers();
+    if ((received_ == 0) && (read_buffer_.capacity() > 0))
+      pool.release(std::exchange(read_buffer_, {}));
+    if (write_buffer_.empty() && write_queue_.empty()) {
+      pool.release(std::exchange(write_buffer_, {}));
+      pool.release(write_queue_.take_spare());
+    }
+  }
+
+  /// Moves the data of the send_buffer to the end of the write_queue.
+  void flush_write_buffer() {
+    if (write_buffer_.empty())
+      return;
+    auto spare = write_queue_.take_spare();
+    write_queue_.push(std::exchange(write_buffer_, std::move(spare)));
+  }
+
   size_t max_consecutive_fetches_ = 10;
   size_t max_consecutive_reads_ = 20;
   size_t max_consecutive_writes_ = 20;
+  /// Writes data directly when registering for writing instead of waiting for
+  /// the next write event.
+  bool write_through_ = false;
+  /// Borrows buffers from the multiplexer only while there is data to read or
+  /// write.
+  bool pooled_buffers_ = false;
+  /// Reads into the scratch buffer of the multiplexer and only copies the
+  /// start of incomplete frames into the read_buffer.
+  bool scratch_reads_ = false;
 
   size_t received_ = 0;
   size_t written_ = 0;
@@ -66,6 +167,7 @@ protected:
 
   util::byte_buffer read_buffer_;
   util::byte_buffer write_buffer_;
+  write_queue write_queue_;
 };
 
 } // namespace net
@@ -15,72 +15,81 @@
 #include "net/receive_policy.hpp"
 #include "net/transport.hpp"
 
+#include "util/byte_buffer.hpp"
 #include "util/error.hpp"
 
+#include <chrono>
+#include <cstdint>
 #include <utility>
 
 namespace net {
 
-/// Adapts the transport to the transport_extension layer
-template <class NextLayer>
-class transport_adaptor : public layer {
+/// Forwards the calls of `NextLayer` to the transport. `NextLayer` is
+/// instantiated with the adaptor as its parent.
+template <template <class> class NextLayer>
+class transport_adaptor {
 public:
+  using next_layer_type = NextLayer<transport_adaptor>;
+
   template <class... Ts>
   explicit transport_adaptor(transport& parent, Ts&&... xs)
-    : parent_{parent}, next_layer_{*this, std::forward<Ts>(xs)...} {}
-
-  util::error init(const util::config& cfg) override {
-    return next_layer_.init(cfg);
+    : parent_{parent}, next_layer_{*this, std::forward<Ts>(xs)...} {
+    static_assert(event_layer<next_layer_type>);
+    static_assert(lower_layer<transport>);
+    static_assert(lower_layer<transport_adaptor>);
   }
 
-  bool has_more_data() override { return next_layer_.has_more_data(); }
+  // -- Upfacing interface (towards application) -------------------------------
+
+  util::error init(const util::config& cfg) { return next_layer_.init(cfg); }
 
-  event_result produce() override { return next_layer_.produce(); }
+  bool has_more_data() { return next_layer_.has_more_data(); }
 
-  event_result consume(util::const_byte_span bytes) override {
+  event_result produce() { return next_layer_.produce(); }
+
+  event_result consume(util::const_byte_span bytes) {
     return next_layer_.consume(bytes);
   }
 
-  event_result handle_timeout(uint64_t id) override {
+  event_result handle_timeout(uint64_t id) {
     return next_layer_.handle_timeout(id);
   }
 
+  // -- Downfacing interface (towards transport) -------------------------------
+
   /// Configures the amount to be read next
-  void configure_next_read(receive_policy policy) override {
+  void configure_next_read(receive_policy policy) {
     parent_.configure_next_read(policy);
   }
 
   /// Returns a reference to the send_buffer
-  util::byte_buffer& write_buffer() override { return parent_.write_buffer(); }
+  util::byte_buffer& write_buffer() { return parent_.write_buffer(); }
 
   /// Enqueues data to the transport extension
-  void enqueue(util::const_byte_span bytes) override { parent_.enqueue(bytes); }
+  void enqueue(util::const_byte_span bytes) { parent_.enqueue(bytes); }
 
   /// Called when an error occurs
-  void handle_error(const util::error& err) override {
-    parent_.handle_error(err);
-  }
+  void handle_error(const util::error& err) { parent_.handle_error(err); }
 
   /// Registers the stack for write events
-  void register_writing() override { parent_.register_writing(); }
+  void register_writing() { parent_.register_writing(); }
 
   /// Sets a timeout in `duration` milliseconds with the id `timeout_id`
-  uint64_t set_timeout_in(std::chrono::milliseconds duration) override {
+  uint64_t set_timeout_in(std::chrono::milliseconds duration) {
     return parent_.set_timeout_in(duration);
   }
 
   /// Sets a timeout at timepoint `point` with the id `timeout_id`
-  uint64_t
-  set_timeout_at(std::chrono::system_clock::time_point point) override {
+  uint64_t set_timeout_at(std::chrono::steady_clock::time_point point) {
     return parent_.set_timeout_at(point);
   }
 
   /// Returns a reference to the following layer
-  NextLayer& next_layer() { return next_layer_; }
+  next_layer_type& next_layer() { return next_layer_; }
 
 private:
   transport& parent_;
-  NextLayer next_layer_;
+  next_layer_type next_layer_;
 };
 
 } // namespace net
@@ -0,0 +1,222 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      uring_multiplexer.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "net/fwd.hpp"
+#include "util/fwd.hpp"
+
+#include "net/multiplexer.hpp"
+#include "net/pollset_updater.hpp"
+#include "net/timing_wheel.hpp"
+
+#include "uring/buffer_ring.hpp"
+#include "uring/ring.hpp"
+
+#include "util/byte_span.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace net {
+
+/// Implements a multiplexing backend on top of io_uring. Readiness is
+/// monitored using oneshot poll requests that are re-armed in batches, which
+/// keeps the `socket_manager` contract identical to the epoll backend while
+/// submitting all pollset changes and waiting for events using a single
+/// syscall per loop iteration. Managers deriving from `uring_transport` may
+/// switch to completion based I/O using `register_completions`.
+class uring_multiplexer : public multiplexer {
+  static constexpr unsigned default_ring_size = 256;
+  static constexpr std::uint16_t default_buffer_count = 1024;
+  static constexpr std::uint32_t default_buffer_size = 4096;
+  static constexpr std::size_t max_send_size = 65536;
+  static constexpr std::uint16_t buffer_group_id = 0;
+
+  /// Bookkeeping for a single registered socket_manager.
+  struct poll_entry {
+    socket_manager_ptr mgr;
+    /// Tags the currently armed poll request
+    std::uint32_t generation{0};
+    /// The operations the armed poll request is waiting for
+    operation armed{operation::none};
+    /// Marks the entry for re-arming before the next submission
+    bool dirty{false};
+    /// Set if the manager performs its I/O using completions
+    bool completion_based{false};
+    /// Set while a multishot recv request is armed
+    bool receiving{false};
+    /// Set once the armed recv request was cancelled, until it completed
+    bool recv_cancelled{false};
+    /// Number of recv and send requests that have yet to complete
+    std::size_t in_flight{0};
+  };
+
+  using manager_map = std::unordered_map<socket_id, poll_entry>;
+  using retired_map = std::unordered_map<std::uint32_t, poll_entry>;
+  using dirty_list = std::vector<socket_id>;
+
+
+public:
+  // -- constructors, destructors ----------------------------------------------
+
+  uring_multiplexer() = default;
+
+  ~uring_multiplexer() override;
+
+  /// Initializes the multiplexer.
+  util::error init(socket_manager_factory_ptr factory,
+                   const util::config& cfg) override;
+
+  // -- Thread functions -------------------------------------------------------
+
+  /// Creates a thread that runs this multiplexer indefinately.
+  void start() override;
+
+  /// Shuts the multiplexer down!
+  void shutdown() override;
+
+  /// Joins with the multiplexer.
+  void join() override;
+
+  bool running() const override;
+
+  bool is_multiplexer_thread() const override {
+    return std::this_thread::get_id()
+           == mpx_thread_id_.load(std::memory_order_relaxed);
+  }
+
+  void set_thread_id(std::thread::id tid = {}) noexcept;
+
+  // -- members ----------------------------------------------------------------
+
+  std::uint16_t num_socket_managers() const { return managers_.size(); }
+
+  // -- Error Handling ---------------------------------------------------------
+
+  void handle_error(const util::error& err) override;
+
+  // -- Interface functions ----------------------------------------------------
+
+  /// Adds a new fd to the multiplexer for operation `initial`.
+  void add(socket_manager_ptr mgr, operation initial) override;
+
+  /// Enables an operation `op` for socket manager `mgr`.
+  void enable(socket_manager*, operation op) override;
+
+  /// Disables an operation `op` for socket manager `mgr`.
+  /// If `mgr` is not registered for any operation after disabling it, it is
+  /// removed if `remove` is set.
+  void disable(socket_manager* mgr, operation op, bool remove) override;
+
+  std::uint64_t set_timeout(socket_manager* mgr, time_point when) override;
+
+  void add_timeout(socket_manager* mgr, time_point when,
+                   std::uint64_t timeout_id) override;
+
+  bool cancel_timeout(std::uint64_t timeout_id) override;
+
+  /// Completes `job` on the multiplexer thread.
+  void post(offload_job_ptr job) override;
+
+  /// Main multiplexing loop.
+  util::error poll_once(bool blocking) override;
+
+  // -- Completion interface ---------------------------------------------------
+
+  /// Switches the registered `mgr` to completion based I/O. Received data is
+  /// delivered to `mgr.handle_recv_completion` in buffers of the ring shared
+  /// by all managers, while write events request `mgr` to submit its sends.
+  util::error register_completions(uring_transport& mgr);
+
+  /// Submits `data` on behalf of `mgr` as a chain of linked send requests.
+  /// Returns the number of submitted requests, `0` on failure.
+  std::size_t submit_send(uring_transport& mgr, util::const_byte_span data);
+
+private:
+  /// Notifies all socket managers about timeouts that have expired.
+  void handle_timeouts();
+
+  /// Dispatches a single completion to its handler.
+  void handle_completion(const io_uring_cqe& cqe);
+
+  /// Handles the completion of a poll request.
+  void handle_poll_completion(const io_uring_cqe& cqe);
+
+  /// Handles the completion of a recv or send request.
+  void handle_io_completion(const io_uring_cqe& cqe);
+
+  /// The main multiplexer loop.
+  void run();
+
+  /// Deletes an existing socket_manager using its key `handle`.
+  void del(socket handle);
+
+  /// Deletes an existing socket_manager using an iterator `it` to the
+  /// manager_map.
+  manager_map::iterator del(manager_map::iterator it);
+
+  /// Marks the entry of `handle` for re-arming its poll request.
+  void mark_dirty(socket handle);
+
+  /// Submits poll requests for all entries whose interest has changed.
+  void arm_dirty_entries();
+
+  /// Cancels the poll request currently armed for `entry`.
+  void cancel_poll(socket_id fd, poll_entry& entry);
+
+  /// Submits the requests of a completion based entry, or cancels its recv
+  /// request if the manager stopped reading.
+  void arm_completions(socket_id fd, poll_entry& entry);
+
+  /// Cancels all recv and send requests in flight for `fd`.
+  void cancel_io(socket_id fd);
+
+  /// Checks whether `mgr` is registered. Managers may be passed to `enable`
+  /// and friends after they were deleted, e.g. by commands or jobs that
+  /// completed late.
+  bool is_registered(socket_manager* mgr) const {
+    const auto it = managers_.find(mgr->handle().id);
+    return (it != managers_.end()) && (it->second.mgr.get() == mgr);
+  }
+
+  // Thread-safe access to the mpx
+  pollset_updater_ptr updater_;
+
+  // Multiplexing variables
+  uring::ring ring_;
+  uring::buffer_ring buffers_;
+  manager_map managers_;
+  /// Deleted managers that have requests in flight, keyed by generation
+  retired_map retired_;
+  dirty_list dirty_;
+  std::uint32_t current_generation_{0};
+
+  // timeout handling
+  timing_wheel timeouts_;
+
+  // thread variables
+  bool shutting_down_{false};
+  bool running_{false};
+  std::thread mpx_thread_;
+  /// Only ever equals the id of the thread reading it if that thread set it.
+  std::atomic<std::thread::id> mpx_thread_id_;
+
+  const util::config* cfg_ = nullptr;
+};
+
+util::error_or<multiplexer_ptr>
+make_uring_multiplexer(socket_manager_factory_ptr factory,
+                       const util::config& cfg);
+
+} // namespace net
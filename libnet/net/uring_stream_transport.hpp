@@ -0,0 +1,187 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      uring_stream_transport.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "net/fwd.hpp"
+
+#include "net/event_result.hpp"
+#include "net/layer.hpp"
+#include "net/receive_policy.hpp"
+#include "net/socket/stream_socket.hpp"
+#include "net/uring_multiplexer.hpp"
+#include "net/uring_transport.hpp"
+
+#include "util/byte_buffer.hpp"
+#include "util/byte_span.hpp"
+#include "util/config.hpp"
+#include "util/error.hpp"
+#include "util/format.hpp"
+#include "util/logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+namespace net {
+
+/// Implements a stream oriented transport on top of io_uring completions.
+/// Data is received using a multishot recv into the buffer ring shared by all
+/// transports of the multiplexer, and handed to `consume()` without copying
+/// whenever a completion satisfies the receive policy. Only frames that are
+/// split across completions are assembled in the `read_buffer_`.
+template <class NextLayer>
+class uring_stream_transport : public uring_transport {
+public:
+  template <class... Ts>
+  uring_stream_transport(stream_socket handle, multiplexer* mpx, Ts&&... xs)
+    : uring_transport(handle, mpx),
+      next_layer_(*this, std::forward<Ts>(xs)...) {
+    static_assert(event_layer<NextLayer>);
+    LOG_DEBUG("Creating uring_stream_transport with ",
+              NET_ARG2("id", handle.id));
+  }
+
+  util::error init(const util::config& cfg) override {
+    LOG_DEBUG("init uring_stream_transport with ",
+              NET_ARG2("socket", handle().id));
+    if (auto err = uring_transport::init(cfg))
+      return err;
+    return next_layer_.init(cfg);
+  }
+
+  // -- socket_manager API -----------------------------------------------------
+
+  /// Data is delivered using `handle_recv_completion`.
+  event_result handle_read_event() override { return event_result::ok; }
+
+  /// Submits the pending data unless a send is still in flight.
+  event_result handle_write_event() override {
+    LOG_TRACE();
+    if (pending_sends_ > 0)
+      return event_result::ok;
+    if (write_buffer_.empty() && write_queue_.empty()) {
+      for (size_t i = 0; next_layer_.has_more_data()
+                         && (i < transport::max_consecutive_fetches_);
+           ++i)
+        next_layer_.produce();
+      if (write_buffer_.empty() && write_queue_.empty())
+        return event_result::done;
+    }
+    // The data in flight has to stay untouched until its sends completed
+    if (write_queue_.empty()) {
+      in_flight_.swap(write_buffer_);
+      write_buffer_.clear();
+    } else {
+      // Sends are submitted from a single buffer, queued segments are copied
+      flush_write_buffer();
+      in_flight_.clear();
+      write_queue_.move_to(in_flight_);
+    }
+    sent_ = 0;
+    return submit_sends();
+  }
+
+  event_result handle_timeout(uint64_t id) override {
+    return next_layer_.handle_timeout(id);
+  }
+
+  // -- completion handling ----------------------------------------------------
+
+  event_result handle_recv_completion(util::const_byte_span data) override {
+    LOG_TRACE();
+    LOG_DEBUG("Received ", data.size(), " bytes on ",
+              NET_ARG2("socket", handle().id));
+    auto frame_complete = [this] {
+      return (max_read_size_ > 0) && (received_ > 0)
+             && (received_ >= min_read_size_);
+    };
+    auto consume_frame = [this] {
+      const auto size = std::exchange(received_, 0);
+      return next_layer_.consume(
+        util::const_byte_span{read_buffer_.data(), size});
+    };
+    // Data buffered while reading was stopped may already form a frame
+    if (frame_complete() && (consume_frame() == event_result::error))
+      return event_result::error;
+    while (!data.empty()) {
+      if ((received_ == 0) && (max_read_size_ > 0)
+          && (data.size() >= min_read_size_)) {
+        // Hand the data to the next layer straight from the provided buffer
+        const auto size = std::min(data.size(), max_read_size_);
+        if (next_layer_.consume(data.first(size)) == event_result::error)
+          return event_result::error;
+        data = data.subspan(size);
+        continue;
+      }
+      // Assemble the frame, stopped reads keep their data buffered
+      const auto size = (max_read_size_ == 0)
+                          ? data.size()
+                          : std::min(data.size(), max_read_size_ - received_);
+      if (read_buffer_.size() < received_ + size)
+        read_buffer_.resize(received_ + size);
+      std::memcpy(read_buffer_.data() + received_, data.data(), size);
+      received_ += size;
+      data = data.subspan(size);
+      if (frame_complete() && (consume_frame() == event_result::error))
+        return event_result::error;
+    }
+    return event_result::ok;
+  }
+
+  event_result handle_send_completion(int res) override {
+    LOG_TRACE();
+    --pending_sends_;
+    if (res > 0) {
+      LOG_DEBUG("Wrote ", res, " bytes to ", NET_ARG2("socket", handle().id));
+      sent_ += static_cast<size_t>(res);
+    } else if (res != -ECANCELED) {
+      // Cancelled sends were part of a chain that was broken by a short send
+      handle_error({util::error_code::socket_operation_failed,
+                    util::format("[uring_stream_transport::send()] "
+                                 "errno = {0}: {1}",
+                                 -res, std::strerror(-res))});
+      return event_result::error;
+    }
+    if (pending_sends_ > 0)
+      return event_result::ok;
+    if (sent_ < in_flight_.size())
+      return submit_sends();
+    in_flight_.clear();
+    return handle_write_event();
+  }
+
+  // -- public API -------------------------------------------------------------
+
+  /// Configures the amount to be read next. Data of a partially received
+  /// frame stays buffered.
+  void configure_next_read(receive_policy policy) override {
+    min_read_size_ = policy.min_size;
+    max_read_size_ = policy.max_size;
+    LOG_DEBUG("Configuring next read on ", NET_ARG2("socket", handle().id),
+              ": ", NET_ARG(min_read_size_), ", ", NET_ARG(max_read_size_));
+  }
+
+private:
+  event_result submit_sends() {
+    auto remaining = util::const_byte_span{in_flight_}.subspan(sent_);
+    pending_sends_ = uring_mpx_->submit_send(*this, remaining);
+    return (pending_sends_ > 0) ? event_result::ok : event_result::error;
+  }
+
+  size_t max_read_size_ = 0;
+
+  size_t sent_ = 0;
+  size_t pending_sends_ = 0;
+  util::byte_buffer in_flight_;
+
+  NextLayer next_layer_;
+};
+
+} // namespace net
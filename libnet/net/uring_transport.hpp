@@ -0,0 +1,58 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      uring_transport.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "net/transport.hpp"
+
+#include "net/fwd.hpp"
+
+#include "net/event_result.hpp"
+#include "net/uring_multiplexer.hpp"
+
+#include "util/byte_span.hpp"
+#include "util/config.hpp"
+#include "util/error.hpp"
+#include "util/logger.hpp"
+
+namespace net {
+
+/// Implements the base of transports that perform their I/O using io_uring
+/// completions instead of readiness events. Requires the
+/// `uring_multiplexer`.
+class uring_transport : public transport {
+public:
+  uring_transport(socket handle, multiplexer* mpx) : transport{handle, mpx} {
+    // nop
+  }
+
+  util::error init(const util::config& cfg) override {
+    LOG_TRACE();
+    if (auto err = transport::init(cfg))
+      return err;
+    uring_mpx_ = dynamic_cast<uring_multiplexer*>(mpx());
+    if (uring_mpx_ == nullptr)
+      return {util::error_code::runtime_error,
+              "[uring_transport]: requires the io_uring multiplexer"};
+    return uring_mpx_->register_completions(*this);
+  }
+
+  // -- completion handling ----------------------------------------------------
+
+  /// Handles `data` that was received into a buffer of the shared buffer ring.
+  /// The buffer is handed back to the kernel once this function returns.
+  virtual event_result handle_recv_completion(util::const_byte_span data) = 0;
+
+  /// Handles the completion of a single send request with result `res`.
+  virtual event_result handle_send_completion(int res) = 0;
+
+protected:
+  uring_multiplexer* uring_mpx_ = nullptr;
+};
+
+} // namespace net
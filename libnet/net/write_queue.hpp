@@ -0,0 +1,108 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      write_queue.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "net/fwd.hpp"
+#include "util/fwd.hpp"
+
+#include "util/byte_buffer.hpp"
+#include "util/byte_span.hpp"
+#include "util/intrusive_ptr.hpp"
+#include "util/ref_counted.hpp"
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+
+namespace net {
+
+/// Queue of buffer segments that are written to a stream socket using
+/// scatter-gather I/O. Segments are owned by the queue, shared with other
+/// queues by reference, or borrowed from the caller until their completion
+/// handler is called. Partially written segments are not moved, the queue
+/// only advances its view of the first segment.
+class write_queue {
+public:
+  /// Called once the queue no longer references a borrowed segment, either
+  /// because it was written or because the queue was cleared.
+  using completion_handler = std::function<void()>;
+
+  /// Maximum number of segments that are written at once, limited to IOV_MAX.
+  static constexpr std::size_t max_segments = 1024;
+
+  // -- constructors, destructors, and assignment operators --------------------
+
+  write_queue() = default;
+
+  ~write_queue();
+
+  write_queue(const write_queue&) = delete;
+
+  write_queue& operator=(const write_queue&) = delete;
+
+  // -- adding segments --------------------------------------------------------
+
+  /// Appends `buf` as segment owned by the queue.
+  void push(util::byte_buffer buf);
+
+  /// Appends `bytes` as segment that is kept alive by a reference to `owner`.
+  void push(util::intrusive_ptr<util::ref_counted> owner,
+            util::const_byte_span bytes);
+
+  /// Appends `bytes` as borrowed segment, `on_done` is called once the queue
+  /// no longer references them.
+  void push(util::const_byte_span bytes, completion_handler on_done);
+
+  // -- writing ----------------------------------------------------------------
+
+  /// Writes as many segments as possible to `x` using a single system call.
+  /// Returns the result of the write.
+  ptrdiff_t write(stream_socket x);
+
+  /// Appends the data of all segments to `buf` and clears the queue.
+  void move_to(util::byte_buffer& buf);
+
+  /// Removes the first `num_bytes` bytes from the queue.
+  void consume(std::size_t num_bytes);
+
+  /// Removes all segments from the queue.
+  void clear();
+
+  /// Returns the storage of a written owned segment for reuse.
+  util::byte_buffer take_spare() noexcept;
+
+  // -- properties -------------------------------------------------------------
+
+  /// Checks whether there is no data in the queue.
+  bool empty() const noexcept { return segments_.empty(); }
+
+  /// Returns the number of bytes in the queue.
+  std::size_t size() const noexcept { return size_; }
+
+  /// Returns the number of segments in the queue.
+  std::size_t num_segments() const noexcept { return segments_.size(); }
+
+private:
+  struct segment {
+    /// The data that has not been written yet
+    util::const_byte_span data;
+    util::byte_buffer owned;
+    util::intrusive_ptr<util::ref_counted> shared;
+    completion_handler on_done;
+  };
+
+  /// Removes the first segment.
+  void pop();
+
+  std::deque<segment> segments_;
+  std::size_t size_ = 0;
+  util::byte_buffer spare_;
+};
+
+} // namespace net
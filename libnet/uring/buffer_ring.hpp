@@ -0,0 +1,79 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      buffer_ring.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "util/fwd.hpp"
+
+#include "util/byte_span.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/io_uring.h>
+
+namespace uring {
+
+class ring;
+
+/// Wraps a ring of kernel-provided buffers. Requests submitted with
+/// `IOSQE_BUFFER_SELECT` pick a buffer from this group when data arrives,
+/// so the memory is shared by all sockets instead of being owned per socket.
+class buffer_ring {
+public:
+  // -- constructors, destructors, and assignment operators --------------------
+
+  buffer_ring() = default;
+
+  ~buffer_ring();
+
+  buffer_ring(const buffer_ring&) = delete;
+
+  buffer_ring& operator=(const buffer_ring&) = delete;
+
+  /// Registers `count` buffers of `buffer_size` bytes each with `r` under the
+  /// id `group_id`. `count` has to be a power of two.
+  util::error init(ring& r, std::uint16_t group_id, std::uint16_t count,
+                   std::uint32_t buffer_size);
+
+  // -- properties -------------------------------------------------------------
+
+  /// Checks whether the buffer ring has been registered.
+  bool initialized() const noexcept { return owner_ != nullptr; }
+
+  /// Returns the id of the buffer group.
+  std::uint16_t group_id() const noexcept { return group_id_; }
+
+  /// Returns the size of each buffer.
+  std::uint32_t buffer_size() const noexcept { return buffer_size_; }
+
+  // -- buffer access ----------------------------------------------------------
+
+  /// Returns the memory of the buffer with id `bid`.
+  util::byte_span buffer(std::uint16_t bid) const noexcept {
+    return {buffers_ + std::size_t{bid} * buffer_size_, buffer_size_};
+  }
+
+  /// Hands the buffer `bid` back to the kernel.
+  void recycle(std::uint16_t bid) noexcept;
+
+private:
+  ring* owner_{nullptr};
+  std::uint16_t group_id_{0};
+  std::uint16_t count_{0};
+  std::uint16_t mask_{0};
+  std::uint16_t tail_{0};
+  std::uint32_t buffer_size_{0};
+
+  io_uring_buf_ring* bufs_{nullptr};
+  std::size_t bufs_size_{0};
+  std::byte* buffers_{nullptr};
+  std::size_t buffers_size_{0};
+};
+
+} // namespace uring
@@ -0,0 +1,116 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      ring.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "util/fwd.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/io_uring.h>
+
+namespace uring {
+
+/// Thin wrapper around the raw io_uring syscall interface. Owns the ring fd
+/// and the shared submission- and completion-queue mappings.
+class ring {
+public:
+  // -- constructors, destructors, and assignment operators --------------------
+
+  ring() = default;
+
+  ~ring();
+
+  ring(const ring&) = delete;
+
+  ring& operator=(const ring&) = delete;
+
+  /// Sets up a ring with at least `entries` submission queue entries.
+  util::error init(unsigned entries);
+
+  // -- properties -------------------------------------------------------------
+
+  /// Returns the fd of the ring.
+  int fd() const noexcept { return fd_; }
+
+  /// Returns the feature flags reported by the kernel.
+  std::uint32_t features() const noexcept { return features_; }
+
+  /// Returns the number of queued but not yet submitted entries.
+  unsigned pending() const noexcept { return sqe_tail_ - sqe_head_; }
+
+  // -- submission -------------------------------------------------------------
+
+  /// Returns a zeroed submission queue entry. Flushes the submission queue to
+  /// the kernel in case it is full. Returns `nullptr` if no entry could be
+  /// acquired.
+  io_uring_sqe* next_sqe();
+
+  /// Submits all pending entries and waits for `min_complete` completions or
+  /// until `timeout` expired. Returns the number of submitted entries or
+  /// `-errno` on failure.
+  int enter(unsigned min_complete, const __kernel_timespec* timeout = nullptr);
+
+  /// Registers or unregisters a resource with the ring using the register
+  /// `opcode`. Returns `0` on success or `-errno` on failure.
+  int register_resource(unsigned opcode, const void* arg, unsigned nr_args);
+
+  // -- completion -------------------------------------------------------------
+
+  /// Calls `f` for every available completion queue entry and marks them as
+  /// seen afterwards. Returns the number of handled entries.
+  template <class F>
+  std::size_t for_each_cqe(F&& f) {
+    auto head = *cq_head_;
+    const auto tail = std::atomic_ref{*cq_tail_}.load(
+      std::memory_order_acquire);
+    std::size_t num_handled = 0;
+    for (; head != tail; ++head, ++num_handled) {
+      f(cqes_[head & cq_mask_]);
+      // Entries are released one by one since `f` may flush the submission
+      // queue, which would otherwise be blocked by a full completion queue.
+      std::atomic_ref{*cq_head_}.store(head + 1, std::memory_order_release);
+    }
+    return num_handled;
+  }
+
+private:
+  /// Moves all locally prepared entries into the shared submission queue and
+  /// returns the number of entries the kernel has yet to consume.
+  unsigned flush();
+
+  int fd_{-1};
+  std::uint32_t features_{0};
+
+  // Shared mappings
+  void* sq_ptr_{nullptr};
+  std::size_t sq_size_{0};
+  void* cq_ptr_{nullptr};
+  std::size_t cq_size_{0};
+  io_uring_sqe* sqes_{nullptr};
+  std::size_t sqes_size_{0};
+
+  // Submission queue
+  unsigned* sq_head_{nullptr};
+  unsigned* sq_tail_{nullptr};
+  unsigned* sq_array_{nullptr};
+  unsigned sq_mask_{0};
+  unsigned sq_entries_{0};
+  unsigned sqe_head_{0};
+  unsigned sqe_tail_{0};
+
+  // Completion queue
+  unsigned* cq_head_{nullptr};
+  unsigned* cq_tail_{nullptr};
+  unsigned cq_mask_{0};
+  io_uring_cqe* cqes_{nullptr};
+};
+
+} // namespace uring
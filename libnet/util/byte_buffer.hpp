@@ -8,11 +8,16 @@
 
 #pragma once
 
+#include "util/default_init_allocator.hpp"
+
 #include <cstddef>
 #include <vector>
 
 namespace util {
 
-using byte_buffer = std::vector<std::byte>;
+/// Buffer type used for I/O. Growing the buffer leaves the new bytes
+/// uninitialized, since they are overwritten by the kernel or a serializer
+/// anyway. Clearing the buffer keeps its capacity.
+using byte_buffer = std::vector<std::byte, default_init_allocator<std::byte>>;
 
 } // namespace util
@@ -65,6 +65,15 @@ public:
     config_values_.emplace(std::move(key), std::move(entry));
   }
 
+  /// @brief Adds a single entry to the config, replacing an existing entry
+  /// @tparam Entry  Type of the entry
+  /// @param key  The key to set the entry at
+  /// @param entry  The entry to set
+  template <meta::one_of<bool, std::int64_t, double, std::string> Entry>
+  void set_config_entry(key_type key, Entry entry) {
+    config_values_.insert_or_assign(std::move(key), std::move(entry));
+  }
+
   /// @brief Checks wether the config contains an entry for `key` and the type
   ///        is equal to `T`
   /// @tparam T  The expected type of the entry
@@ -0,0 +1,24 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      cpu_affinity.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "util/fwd.hpp"
+
+#include <thread>
+
+namespace util {
+
+/// Pins `thread` to the cpu with index `cpu`.
+error pin_to_cpu(std::thread& thread, unsigned cpu);
+
+/// Returns the index of the cpu the calling thread is running on, or -1 if it
+/// can not be determined.
+int current_cpu() noexcept;
+
+} // namespace util
@@ -0,0 +1,47 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      default_init_allocator.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace util {
+
+/// Allocator adaptor that default-initializes elements constructed without
+/// arguments instead of value-initializing them. Growing a container of
+/// trivial types, e.g., using `resize`, then leaves the new elements
+/// uninitialized instead of zeroing memory that is overwritten anyway.
+template <class T, class Allocator = std::allocator<T>>
+class default_init_allocator : public Allocator {
+  using traits = std::allocator_traits<Allocator>;
+
+public:
+  template <class U>
+  struct rebind {
+    using other
+      = default_init_allocator<U, typename traits::template rebind_alloc<U>>;
+  };
+
+  using Allocator::Allocator;
+
+  template <class U>
+  void construct(U* ptr) noexcept(std::is_nothrow_default_constructible_v<U>) {
+    ::new (static_cast<void*>(ptr)) U;
+  }
+
+  template <class U, class... Ts>
+  void construct(U* ptr, Ts&&... xs) {
+    traits::construct(static_cast<Allocator&>(*this), ptr,
+                      std::forward<Ts>(xs)...);
+  }
+};
+
+} // namespace util
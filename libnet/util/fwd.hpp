@@ -24,6 +24,8 @@ class cli_parser;
 class config;
 class error;
 class serialized_size;
+class shared_buffer;
+class shared_slice;
 
 // -- enums --------------------------------------------------------------------
 
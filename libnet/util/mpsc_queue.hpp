@@ -0,0 +1,98 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      mpsc_queue.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace util {
+
+/// Bounded lock-free queue for multiple producers and a single consumer. Each
+/// cell carries a sequence number that tells producers and the consumer whose
+/// turn it is, so neither side has to lock or allocate.
+template <class T>
+class mpsc_queue {
+public:
+  /// Creates a queue that holds at least `capacity` elements.
+  explicit mpsc_queue(std::size_t capacity)
+    : capacity_{std::bit_ceil(std::max(capacity, std::size_t{2}))},
+      cells_{std::make_unique<cell[]>(capacity_)} {
+    for (std::size_t i = 0; i < capacity_; ++i)
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  mpsc_queue(const mpsc_queue&) = delete;
+
+  mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+  // -- producer interface -----------------------------------------------------
+
+  /// Appends `value` to the queue. Returns false if the queue is full. Safe to
+  /// call from any thread.
+  bool try_push(T value) {
+    auto pos = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      auto& c = cells_[pos & (capacity_ - 1)];
+      const auto seq = c.sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::intptr_t>(seq)
+                        - static_cast<std::intptr_t>(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          c.value = std::move(value);
+          c.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        // The consumer has not yet freed this cell
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // -- consumer interface -----------------------------------------------------
+
+  /// Removes the first element of the queue. Must only be called by the
+  /// consumer.
+  std::optional<T> pop() {
+    auto& c = cells_[head_ & (capacity_ - 1)];
+    if (c.sequence.load(std::memory_order_acquire) != head_ + 1)
+      return std::nullopt;
+    std::optional<T> result{std::move(c.value)};
+    c.sequence.store(head_ + capacity_, std::memory_order_release);
+    ++head_;
+    return result;
+  }
+
+  // -- properties -------------------------------------------------------------
+
+  std::size_t capacity() const noexcept { return capacity_; }
+
+private:
+  struct cell {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+  const std::size_t capacity_;
+  std::unique_ptr<cell[]> cells_;
+  /// Producers and the consumer work on separate cache lines.
+  alignas(64) std::atomic<std::size_t> tail_{0};
+  alignas(64) std::size_t head_{0};
+};
+
+} // namespace util
@@ -9,23 +9,78 @@
 #pragma once
 
 #include <atomic>
+#include <concepts>
+#include <cstddef>
 
 namespace util {
 
-struct ref_counted {
-  virtual ~ref_counted() = default;
+// -- reference count policies -------------------------------------------------
 
-  void ref() { ref_count_.fetch_add(1, std::memory_order_relaxed); }
+/// Reference count that may be shared between threads.
+struct atomic_ref_count {
+  void inc() noexcept { value_.fetch_add(1, std::memory_order_relaxed); }
 
-  void deref() {
-    if (ref_count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
-      delete this;
+  /// Returns true if the last reference was dropped.
+  bool dec() noexcept {
+    return value_.fetch_sub(1, std::memory_order_acq_rel) == 1;
   }
 
-  std::size_t ref_count() { return ref_count_.load(); }
+  std::size_t load() const noexcept { return value_.load(); }
 
 private:
-  std::atomic_size_t ref_count_{1};
+  std::atomic_size_t value_{1};
 };
 
+/// Reference count for objects that never leave the thread they were created
+/// on. Avoids the locked instructions of the atomic count.
+struct local_ref_count {
+  void inc() noexcept { ++value_; }
+
+  /// Returns true if the last reference was dropped.
+  bool dec() noexcept { return --value_ == 0; }
+
+  std::size_t load() const noexcept { return value_; }
+
+private:
+  std::size_t value_{1};
+};
+
+// -- reference counted base ---------------------------------------------------
+
+/// Base class for objects that are owned by `intrusive_ptr`s. The count
+/// starts at one, `RefCount` decides whether it is thread-safe.
+template <class RefCount>
+struct basic_ref_counted {
+  virtual ~basic_ref_counted() = default;
+
+  void ref() noexcept { ref_count_.inc(); }
+
+  void deref() noexcept {
+    if (ref_count_.dec())
+      dispose();
+  }
+
+  std::size_t ref_count() const noexcept { return ref_count_.load(); }
+
+protected:
+  /// Releases the object once its last reference was dropped. Objects that
+  /// recycle their memory override this instead of being deleted.
+  virtual void dispose() noexcept { delete this; }
+
+private:
+  RefCount ref_count_;
+};
+
+/// Base for objects that are shared between threads.
+using ref_counted = basic_ref_counted<atomic_ref_count>;
+
+/// Base for objects that are confined to a single thread, e.g., to the thread
+/// of a multiplexer.
+using local_ref_counted = basic_ref_counted<local_ref_count>;
+
+/// Constrains a template to types that can be owned by an `intrusive_ptr`.
+template <class T>
+concept ref_countable = std::derived_from<T, ref_counted>
+                        || std::derived_from<T, local_ref_counted>;
+
 } // namespace util
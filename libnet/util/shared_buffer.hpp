@@ -0,0 +1,95 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      shared_buffer.hpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#pragma once
+
+#include "util/fwd.hpp"
+
+#include "util/byte_buffer.hpp"
+#include "util/byte_span.hpp"
+#include "util/intrusive_ptr.hpp"
+#include "util/ref_counted.hpp"
+
+#include <cstddef>
+#include <utility>
+
+namespace util {
+
+/// Immutable, reference-counted byte buffer. A serialized message is stored
+/// once and can be queued by any number of transports without copying it.
+class shared_buffer : public ref_counted {
+public:
+  explicit shared_buffer(byte_buffer data) : data_{std::move(data)} {
+    // nop
+  }
+
+  /// Returns the stored bytes.
+  const_byte_span bytes() const noexcept { return data_; }
+
+  /// Returns the number of stored bytes.
+  std::size_t size() const noexcept { return data_.size(); }
+
+private:
+  const byte_buffer data_;
+};
+
+using shared_buffer_ptr = intrusive_ptr<shared_buffer>;
+
+/// A view into a shared_buffer that keeps the buffer alive.
+class shared_slice {
+public:
+  shared_slice() = default;
+
+  /// Creates a slice that covers all of `buf`.
+  explicit shared_slice(shared_buffer_ptr buf)
+    : bytes_{buf ? buf->bytes() : const_byte_span{}}, buf_{std::move(buf)} {
+    // nop
+  }
+
+  /// Creates a slice that covers `size` bytes of `buf` starting at `offset`.
+  shared_slice(shared_buffer_ptr buf, std::size_t offset, std::size_t size)
+    : bytes_{buf->bytes().subspan(offset, size)}, buf_{std::move(buf)} {
+    // nop
+  }
+
+  /// Returns a slice of `size` bytes of this slice starting at `offset`.
+  shared_slice subslice(std::size_t offset, std::size_t size) const {
+    shared_slice result;
+    result.bytes_ = bytes_.subspan(offset, size);
+    result.buf_ = buf_;
+    return result;
+  }
+
+  // -- properties -------------------------------------------------------------
+
+  /// Returns the bytes covered by this slice.
+  const_byte_span bytes() const noexcept { return bytes_; }
+
+  /// Returns the buffer that owns the bytes of this slice.
+  const shared_buffer_ptr& buffer() const noexcept { return buf_; }
+
+  std::size_t size() const noexcept { return bytes_.size(); }
+
+  bool empty() const noexcept { return bytes_.empty(); }
+
+private:
+  const_byte_span bytes_;
+  shared_buffer_ptr buf_;
+};
+
+/// Moves `data` into a new shared_buffer and returns a slice covering it.
+inline shared_slice make_shared_slice(byte_buffer data) {
+  return shared_slice{make_intrusive<shared_buffer>(std::move(data))};
+}
+
+/// Copies `data` into a new shared_buffer and returns a slice covering it.
+inline shared_slice make_shared_slice(const_byte_span data) {
+  return make_shared_slice(byte_buffer{data.begin(), data.end()});
+}
+
+} // namespace util
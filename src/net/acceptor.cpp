@@ -13,10 +13,13 @@
 #include "net/socket/tcp_accept_socket.hpp"
 #include "net/socket_manager_factory.hpp"
 
+#include "util/config.hpp"
 #include "util/error.hpp"
 #include "util/error_code.hpp"
 #include "util/logger.hpp"
 
+#include <cerrno>
+#include <cstdint>
 #include <iostream>
 #include <memory>
 
@@ -28,8 +31,14 @@ acceptor::acceptor(tcp_accept_socket handle, multiplexer* mpx,
   LOG_TRACE();
 }
 
-util::error acceptor::init(const util::config&) {
+util::error acceptor::init(const util::config& cfg) {
   LOG_TRACE();
+  const auto budget = cfg.get_or<std::int64_t>(
+    "multiplexer.accept-budget", static_cast<std::int64_t>(accept_budget_));
+  if (budget < 1)
+    return {util::error_code::invalid_argument,
+            "[acceptor]: multiplexer.accept-budget must be positive"};
+  accept_budget_ = static_cast<std::size_t>(budget);
   return util::none;
 }
 
@@ -39,23 +48,35 @@ event_result acceptor::handle_read_event() {
   auto hdl = handle<tcp_accept_socket>();
   LOG_TRACE();
   LOG_DEBUG("acceptor handling read event ", NET_ARG2("handle", hdl.id));
-  auto accepted = accept(hdl);
-  if (accepted == invalid_socket) {
-    mpx()->handle_error({util::error_code::socket_operation_failed,
-                         "[acceptor::handle_read_event()] accept failed: {0}",
-                         last_socket_error_as_string()});
-    return event_result::ok;
-  }
-  LOG_DEBUG("accepted connection ", NET_ARG2("new_handle", accepted.id));
-  if (!nonblocking(accepted, true)) {
-    mpx()->handle_error(
-      {util::error_code::socket_operation_failed,
-       "[acceptor::handle_read_event()] nonblocking failed: {0}",
-       last_socket_error_as_string()});
-    return event_result::ok;
+  for (std::size_t i = 0; i < accept_budget_; ++i) {
+    auto accepted = accept(hdl);
+    if (accepted == invalid_socket) {
+      // The backlog is drained
+      if (last_socket_error_is_temporary())
+        break;
+      const auto code = last_socket_error();
+      // The connection failed before it was accepted, or a signal arrived
+      if ((code == ECONNABORTED) || (code == EINTR) || (code == EPROTO))
+        continue;
+      // Pending connections stay in the backlog until descriptors are free.
+      // The listening socket stays readable meanwhile, so reading pauses to
+      // keep the multiplexer from spinning on it.
+      if ((code == EMFILE) || (code == ENFILE)) {
+        LOG_WARNING("acceptor ran out of file descriptors: ",
+                    last_socket_error_as_string());
+        mpx()->disable(this, operation::read, false);
+        retry_timeout_ = set_timeout_in(retry_delay);
+        break;
+      }
+      mpx()->handle_error({util::error_code::socket_operation_failed,
+                           "[acceptor::handle_read_event()] accept failed: {0}",
+                           last_socket_error_as_string()});
+      return event_result::ok;
+    }
+    LOG_DEBUG("accepted connection ", NET_ARG2("new_handle", accepted.id));
+    auto mgr = factory_->make(accepted, mpx());
+    mpx()->add(std::move(mgr), operation::read);
   }
-  auto mgr = factory_->make(accepted, mpx());
-  mpx()->add(std::move(mgr), operation::read);
   return event_result::ok;
 }
 
@@ -67,7 +88,13 @@ event_result acceptor::handle_write_event() {
   return event_result::error;
 }
 
-event_result acceptor::handle_timeout(uint64_t) {
+event_result acceptor::handle_timeout(uint64_t timeout_id) {
+  if (retry_timeout_ == timeout_id) {
+    LOG_DEBUG("acceptor resumes accepting connections");
+    retry_timeout_.reset();
+    register_reading();
+    return event_result::ok;
+  }
   LOG_ERROR("Should not be registered for timeouts");
   mpx()->handle_error({util::error_code::runtime_error,
                        "[acceptor::handle_timeout()] not implemented!"});
@@ -0,0 +1,72 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      buffer_pool.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/buffer_pool.hpp"
+
+#include <utility>
+
+namespace net {
+
+buffer_pool::buffer_pool(std::size_t max_cached) : max_cached_{max_cached} {
+  // nop
+}
+
+// -- buffer management --------------------------------------------------------
+
+util::byte_buffer buffer_pool::acquire(std::size_t min_capacity) {
+  for (std::size_t i = 0; i < size_classes.size(); ++i) {
+    if (min_capacity > size_classes[i])
+      continue;
+    auto& list = free_[i];
+    if (!list.empty()) {
+      auto buf = std::move(list.back());
+      list.pop_back();
+      return buf;
+    }
+    util::byte_buffer buf;
+    buf.reserve(size_classes[i]);
+    return buf;
+  }
+  util::byte_buffer buf;
+  buf.reserve(min_capacity);
+  return buf;
+}
+
+void buffer_pool::release(util::byte_buffer&& buf) {
+  const auto capacity = buf.capacity();
+  // Buffers that grew far beyond the largest class are not worth keeping
+  if ((capacity < size_classes.front())
+      || (capacity >= 2 * size_classes.back()))
+    return;
+  // Pools the buffer in the largest class it satisfies
+  auto i = size_classes.size() - 1;
+  while (capacity < size_classes[i])
+    --i;
+  auto& list = free_[i];
+  if (list.size() >= max_cached_)
+    return;
+  buf.clear();
+  list.emplace_back(std::move(buf));
+}
+
+util::byte_span buffer_pool::scratch(std::size_t size) {
+  if (scratch_.size() < size)
+    scratch_.resize(size);
+  return {scratch_.data(), size};
+}
+
+// -- properties ---------------------------------------------------------------
+
+std::size_t buffer_pool::num_cached() const noexcept {
+  std::size_t result = 0;
+  for (const auto& list : free_)
+    result += list.size();
+  return result;
+}
+
+} // namespace net
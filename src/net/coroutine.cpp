@@ -0,0 +1,157 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      coroutine.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/coroutine.hpp"
+
+#include "net/manager_pool.hpp"
+#include "net/multiplexer.hpp"
+#include "net/transport.hpp"
+
+#include "util/error.hpp"
+#include "util/logger.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <new>
+
+namespace net {
+
+namespace {
+
+/// Precedes each coroutine frame to find its pool on deallocation. Frames
+/// are destroyed with their manager, which may happen on any thread.
+struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) frame_header {
+  manager_pool::control_ptr ctrl;
+};
+
+/// The pool for frames created on this thread, set by `frame_pool_scope`.
+thread_local manager_pool* current_frame_pool = nullptr;
+
+} // namespace
+
+// -- task ---------------------------------------------------------------------
+
+void task::promise_type::unhandled_exception() noexcept {
+  LOG_ERROR("Unhandled exception in connection handler");
+  std::terminate();
+}
+
+void* task::promise_type::operator new(std::size_t size) {
+  auto* pool = current_frame_pool;
+  const auto total = size + sizeof(frame_header);
+  auto* mem = (pool != nullptr) ? pool->allocate(total)
+                                : ::operator new(total);
+  auto* header = new (mem) frame_header{
+    (pool != nullptr) ? pool->control() : nullptr};
+  return header + 1;
+}
+
+void task::promise_type::operator delete(void* ptr, std::size_t size) noexcept {
+  auto* header = static_cast<frame_header*>(ptr) - 1;
+  const auto total = size + sizeof(frame_header);
+  auto ctrl = std::move(header->ctrl);
+  header->~frame_header();
+  if (ctrl != nullptr)
+    manager_pool::release(*ctrl, header, total);
+  else
+    ::operator delete(header);
+}
+
+// -- frame_pool_scope ---------------------------------------------------------
+
+frame_pool_scope::frame_pool_scope(connection& conn) noexcept
+  : prev_{current_frame_pool} {
+  auto* mpx = conn.parent().mpx();
+  current_frame_pool = (mpx != nullptr) ? &mpx->pooled_managers() : nullptr;
+}
+
+frame_pool_scope::~frame_pool_scope() {
+  current_frame_pool = prev_;
+}
+
+// -- connection ---------------------------------------------------------------
+
+connection::connection(transport& parent) : parent_{parent} {
+  // nop
+}
+
+bool connection::read_awaitable::await_ready() const noexcept {
+  return conn.available()
+         >= std::max(policy.min_size, std::uint32_t{1});
+}
+
+void connection::read_awaitable::await_suspend(
+  std::coroutine_handle<> handle) {
+  conn.waiting_ = handle;
+  conn.reason_ = waiting_for::data;
+  conn.policy_ = policy;
+  conn.parent_.configure_next_read(policy);
+  // Reading was paused if the coroutine slept
+  conn.parent_.register_reading();
+}
+
+util::const_byte_span connection::read_awaitable::await_resume() noexcept {
+  const auto size = std::min<std::size_t>(conn.available(), policy.max_size);
+  const auto result = conn.input_.subspan(conn.delivered_, size);
+  conn.delivered_ += size;
+  return result;
+}
+
+void connection::sleep_awaitable::await_suspend(
+  std::coroutine_handle<> handle) {
+  conn.waiting_ = handle;
+  conn.reason_ = waiting_for::timeout;
+  conn.timeout_id_ = conn.parent_.set_timeout_in(duration);
+  conn.parent_.configure_next_read(receive_policy::stop());
+}
+
+connection::read_awaitable connection::read(receive_policy policy) noexcept {
+  return {*this, policy};
+}
+
+std::suspend_never connection::write(util::const_byte_span bytes) {
+  parent_.enqueue(bytes);
+  parent_.register_writing();
+  return {};
+}
+
+void connection::start(task handler) {
+  handler_ = std::move(handler);
+  if (!handler_.done())
+    handler_.handle().resume();
+}
+
+std::ptrdiff_t connection::consume(util::const_byte_span bytes) {
+  if (done()) {
+    parent_.handle_error({util::error_code::runtime_error,
+                          "[connection::consume()] received data after the "
+                          "handler finished"});
+    return -1;
+  }
+  if ((reason_ != waiting_for::data)
+      || (bytes.size() < std::max(policy_.min_size, std::uint32_t{1})))
+    return 0;
+  // Reads of the coroutine take their data from `bytes` until it suspends
+  input_ = bytes;
+  resume();
+  input_ = {};
+  return static_cast<std::ptrdiff_t>(std::exchange(delivered_, 0));
+}
+
+event_result connection::handle_timeout(uint64_t id) {
+  if ((reason_ == waiting_for::timeout) && (id == timeout_id_))
+    resume();
+  return event_result::ok;
+}
+
+void connection::resume() {
+  reason_ = waiting_for::nothing;
+  std::exchange(waiting_, {}).resume();
+}
+
+} // namespace net
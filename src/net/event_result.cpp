@@ -18,6 +18,8 @@ std::string to_string(event_result res) {
       return "event_result::done";
     case event_result::error:
       return "event_result::error";
+    case event_result::again:
+      return "event_result::again";
     default:
       return "event_result::unknown";
   }
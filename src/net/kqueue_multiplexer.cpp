@@ -10,13 +10,12 @@
 
 #include "net/acceptor.hpp"
 #include "net/event_result.hpp"
+#include "net/offload_pool.hpp"
 #include "net/operation.hpp"
 #include "net/pollset_updater.hpp"
-#include "net/socket/pipe_socket.hpp"
 #include "net/socket/tcp_accept_socket.hpp"
 #include "net/socket_manager.hpp"
 
-#include "util/binary_serializer.hpp"
 #include "util/byte_span.hpp"
 #include "util/config.hpp"
 #include "util/error.hpp"
@@ -33,10 +32,15 @@
 #include <unistd.h>
 #include <utility>
 
+#include <sys/socket.h>
+
 namespace net {
 
 kqueue_multiplexer::~kqueue_multiplexer() {
   LOG_TRACE();
+  // Workers must not post jobs to a destroyed multiplexer
+  if (offload_pool_)
+    offload_pool_->detach(this);
   ::close(mpx_fd_);
 }
 
@@ -53,22 +57,39 @@ util::error kqueue_multiplexer::init(socket_manager_factory_ptr factory,
             "[kqueue_multiplexer]: Creating epoll fd failed"};
   }
   LOG_DEBUG("Created ", NET_ARG(mpx_fd_));
-
+  if (cfg_->get_or("multiplexer.high-resolution-timers", false))
+    timeouts_ = timing_wheel{timing_wheel::high_resolution};
+
+  const auto max_cached_buffers = cfg_->get_or<std::int64_t>(
+    "multiplexer.max-cached-buffers",
+    static_cast<std::int64_t>(buffer_pool::default_max_cached));
+  buffer_pool_ = buffer_pool{static_cast<std::size_t>(max_cached_buffers)};
+  const auto max_cached_managers = cfg_->get_or<std::int64_t>(
+    "multiplexer.max-cached-managers",
+    static_cast<std::int64_t>(manager_pool::default_max_cached));
+  manager_pool_.max_cached(static_cast<std::size_t>(max_cached_managers));
+  const auto offload_threads = cfg_->get_or<std::int64_t>(
+    "multiplexer.offload-threads", 0);
+  if (offload_threads > 0)
+    offload_pool_ = std::make_shared<offload_pool>(
+      static_cast<std::size_t>(offload_threads));
   // Create pollset updater
-  const auto pipe_res = make_pipe();
-  if (auto err = util::get_error(pipe_res)) {
+  auto updater_res = make_pollset_updater(
+    this, static_cast<std::size_t>(cfg_->get_or<std::int64_t>(
+            "multiplexer.command-queue-size",
+            static_cast<std::int64_t>(pollset_updater::default_queue_size))));
+  if (auto err = util::get_error(updater_res)) {
     return *err;
   }
-  auto pipe_fds = std::get<pipe_socket_pair>(pipe_res);
-  pipe_reader_ = pipe_fds.first;
-  pipe_writer_ = pipe_fds.second;
-  add(util::make_intrusive<pollset_updater>(pipe_reader_, this),
-      operation::read);
+  updater_ = std::get<pollset_updater_ptr>(updater_res);
+  add(updater_, operation::read);
   // Create Acceptor
   const auto res = net::make_tcp_accept_socket(ip::v4_endpoint(
     (cfg_->get_or("multiplexer.local", true) ? ip::v4_address::localhost
                                              : ip::v4_address::any),
-    cfg_->get_or<std::int64_t>("multiplexer.port", 0)));
+    cfg_->get_or<std::int64_t>("multiplexer.port", 0)),
+    static_cast<int>(
+      cfg_->get_or<std::int64_t>("multiplexer.backlog", SOMAXCONN)));
   if (auto err = util::get_error(res)) {
     return *err;
   }
@@ -87,8 +108,6 @@ void kqueue_multiplexer::start() {
   if (!running_) {
     running_ = true;
     mpx_thread_ = std::thread(&kqueue_multiplexer::run, this);
-    mpx_thread_id_ = mpx_thread_.get_id();
-    LOG_DEBUG(NET_ARG(mpx_thread_id_));
   }
 }
 
@@ -99,8 +118,8 @@ void kqueue_multiplexer::shutdown() {
     auto it = managers_.begin();
     while (it != managers_.end()) {
       auto& mgr = it->second;
-      if (mgr->handle() != pipe_reader_) {
-        disable(mgr, operation::read, false);
+      if (mgr.get() != updater_.get()) {
+        disable(mgr.get(), operation::read, false);
         if (mgr->mask() == operation::none) {
           it = del(it);
         } else {
@@ -111,16 +130,11 @@ void kqueue_multiplexer::shutdown() {
       }
     }
     shutting_down_ = true;
-    close(pipe_writer_);
-    pipe_writer_ = pipe_socket{};
+    // Removes the pollset_updater once it handled all pending commands
+    updater_->request_shutdown();
   } else if (!shutting_down_) {
     LOG_DEBUG("requesting multiplexer shutdown");
-    auto res = write_to_pipe(pollset_updater::shutdown_code);
-    if (res != 1) {
-      LOG_ERROR("could not write shutdown code to pipe: ",
-                last_socket_error_as_string());
-      std::terminate(); // Can't be handled by shutting down, if shutdown fails.
-    }
+    updater_->request_shutdown();
   }
 }
 
@@ -137,11 +151,15 @@ bool kqueue_multiplexer::running() const {
 }
 
 void kqueue_multiplexer::set_thread_id(std::thread::id tid) noexcept {
-  mpx_thread_id_ = tid;
+  mpx_thread_id_.store(tid, std::memory_order_relaxed);
+  manager_pool_.owner(tid);
 }
 
 void kqueue_multiplexer::run() {
   LOG_TRACE();
+  // The multiplexer thread sets its own id before polling, other threads
+  // keep using the command queue until then
+  set_thread_id(std::this_thread::get_id());
   while (running_) {
     if (poll_once(true)) {
       running_ = false;
@@ -156,42 +174,61 @@ void kqueue_multiplexer::handle_error([[maybe_unused]] const util::error& err) {
   shutdown();
 }
 
+// -- Offloading ---------------------------------------------------------------
+
+void kqueue_multiplexer::post(offload_job_ptr job) {
+  LOG_TRACE();
+  if (is_multiplexer_thread()) {
+    job->complete();
+    return;
+  }
+  updater_->push({pollset_updater::complete_code, nullptr, operation::none,
+                  false, 0, {}, job.release()});
+}
+
 // -- Timeout management -------------------------------------------------------
 
-uint64_t
-kqueue_multiplexer::set_timeout(socket_manager_ptr mgr,
-                                std::chrono::system_clock::time_point when) {
+uint64_t kqueue_multiplexer::set_timeout(socket_manager* mgr, time_point when) {
+  LOG_TRACE();
+  if (!is_multiplexer_thread()) {
+    // The multiplexer adds the timeout under the id reserved by this thread
+    const auto id = timing_wheel::reserved_id | next_timeout_id_++;
+    mgr->ref();
+    updater_->push({pollset_updater::set_timeout_code, mgr,
+                    operation::none, false, id, when});
+    return id;
+  }
+  const auto id = timeouts_.add(mgr->handle().id, when);
+  LOG_DEBUG("Set timeout ", id, " on ", NET_ARG2("mgr", mgr->handle().id));
+  return id;
+}
+
+void kqueue_multiplexer::add_timeout(socket_manager* mgr, time_point when,
+                                     uint64_t timeout_id) {
   LOG_TRACE();
-  LOG_DEBUG("Setting timeout ", current_timeout_id_, " on ",
+  timeouts_.add(mgr->handle().id, when, timeout_id);
+  LOG_DEBUG("Set timeout ", timeout_id, " on ",
             NET_ARG2("mgr", mgr->handle().id));
-  timeouts_.emplace(mgr->handle().id, when, current_timeout_id_);
-  current_timeout_
-    = current_timeout_.has_value() ? std::min(when, *current_timeout_) : when;
-  return current_timeout_id_++;
+}
+
+bool kqueue_multiplexer::cancel_timeout(uint64_t timeout_id) {
+  LOG_TRACE();
+  LOG_DEBUG("Cancelling timeout ", timeout_id);
+  if (is_multiplexer_thread()) {
+    return timeouts_.cancel(timeout_id);
+  }
+  updater_->push({pollset_updater::cancel_timeout_code, nullptr,
+                  operation::none, false, timeout_id});
+  return true;
 }
 
 void kqueue_multiplexer::handle_timeouts() {
-  using namespace std::chrono;
   LOG_TRACE();
-  const auto now = time_point_cast<milliseconds>(system_clock::now());
-  for (auto it = timeouts_.begin(); it != timeouts_.end(); ++it) {
-    const auto& entry = *it;
-    const auto when = time_point_cast<milliseconds>(entry.when_);
-    if (when <= now) {
-      // Registered timeout has expired
-      managers_.at(entry.handle_)->handle_timeout(entry.id_);
-    } else {
-      // Timeout not expired, delete handled entries and set the current timeout
-      timeouts_.erase(timeouts_.begin(), it);
-      if (timeouts_.empty()) {
-        LOG_DEBUG("No further timeouts registered");
-        current_timeout_ = std::nullopt;
-      } else {
-        LOG_DEBUG("Next timeout with ", NET_ARG2("id", entry.id_));
-        current_timeout_ = entry.when_;
-      }
-      break;
-    }
+  timeouts_.advance(now_);
+  // Handlers may add or cancel timeouts while the batch is dispatched
+  while (auto timeout = timeouts_.pop()) {
+    if (auto it = managers_.find(timeout->handle); it != managers_.end())
+      it->second->handle_timeout(timeout->id);
   }
 }
 
@@ -200,15 +237,10 @@ void kqueue_multiplexer::add(socket_manager_ptr mgr, operation initial) {
   if (is_multiplexer_thread()) {
     LOG_DEBUG("Adding socket_manager with ", NET_ARG2("id", mgr->handle().id),
               " for ", NET_ARG(initial));
-    // Set nonblocking on socket
-    if (!nonblocking(mgr->handle(), true)) {
-      handle_error(util::error(util::error_code::socket_operation_failed,
-                               "Could not set nonblocking"));
-    }
     // Add the mgr to the pollset for both reading and writing and enable it for
     // the initial operations
     mod(mgr->handle().id, (EV_ADD | EV_DISABLE), operation::read_write);
-    enable(mgr, initial);
+    enable(mgr.get(), initial);
     managers_.emplace(mgr->handle().id, mgr);
     // TODO: This should probably return an error instead of calling
     // handle_error
@@ -219,27 +251,37 @@ void kqueue_multiplexer::add(socket_manager_ptr mgr, operation initial) {
     LOG_DEBUG("Requesting to add socket_manager with ",
               NET_ARG2("id", mgr->handle().id), " for ", NET_ARG(initial));
     mgr->ref();
-    write_to_pipe(pollset_updater::add_code, mgr.get(), initial);
+    updater_->push({pollset_updater::add_code, mgr.get(), initial});
   }
 }
 
-void kqueue_multiplexer::enable(socket_manager_ptr mgr, operation op) {
+void kqueue_multiplexer::enable(socket_manager* mgr, operation op) {
   LOG_TRACE();
   LOG_DEBUG("Enabling mgr with ", NET_ARG2("id", mgr->handle().id),
             " registered for ", NET_ARG2("mask", to_string(mgr->mask())),
             " for ", NET_ARG2("new_event", to_string(op)));
+  if (!is_multiplexer_thread()) {
+    mgr->ref();
+    updater_->push({pollset_updater::enable_code, mgr, op});
+    return;
+  }
   if (!mgr->mask_add(op)) {
     return;
   }
   mod(mgr->handle().id, EV_ENABLE, mgr->mask());
 }
 
-void kqueue_multiplexer::disable(socket_manager_ptr mgr, operation op,
+void kqueue_multiplexer::disable(socket_manager* mgr, operation op,
                                  bool remove) {
   LOG_TRACE();
   LOG_DEBUG("Disabling mgr with ", NET_ARG2("id", mgr->handle().id),
             " registered for ", NET_ARG2("mask", to_string(mgr->mask())),
             " for ", NET_ARG2("event", to_string(op)));
+  if (!is_multiplexer_thread()) {
+    mgr->ref();
+    updater_->push({pollset_updater::disable_code, mgr, op, remove});
+    return;
+  }
   if (!mgr->mask_del(op)) {
     return;
   }
@@ -253,6 +295,7 @@ void kqueue_multiplexer::del(socket handle) {
   LOG_TRACE();
   LOG_DEBUG("Deleting mgr with ", NET_ARG2("id", handle.id));
   mod(handle.id, EV_DELETE, operation::read_write);
+  timeouts_.cancel_all(handle.id);
   managers_.erase(handle.id);
   if (shutting_down_ && managers_.empty()) {
     running_ = false;
@@ -265,6 +308,7 @@ kqueue_multiplexer::del(manager_map::iterator it) {
   auto fd = it->second->handle().id;
   LOG_DEBUG("Deleting mgr with ", NET_ARG2("id", fd));
   mod(fd, EV_DELETE, operation::read_write);
+  timeouts_.cancel_all(fd);
   auto new_it = managers_.erase(it);
   if (shutting_down_ && managers_.empty()) {
     running_ = false;
@@ -304,15 +348,18 @@ void kqueue_multiplexer::mod(int fd, int op, operation events) {
 util::error kqueue_multiplexer::poll_once(bool blocking) {
   using namespace std::chrono;
   LOG_TRACE();
+  const auto next_timeout = timeouts_.next_expiry();
   // Calculates the timeout value for the kqueue call
-  auto calculate_timeout = [this, blocking]() -> timespec {
-    if (!blocking || !current_timeout_) {
+  auto calculate_timeout = [&]() -> timespec {
+    if (!blocking || !next_timeout) {
       return {0, 0};
     }
-    const auto now = time_point_cast<milliseconds>(system_clock::now());
-    const auto timeout_tp = time_point_cast<milliseconds>(*current_timeout_);
-    const auto diff_ms = (timeout_tp - now).count();
-    return {(diff_ms / 1000), ((diff_ms % 1000) * 1000000)};
+    // The loop time is stale by the time it took to handle the last batch
+    const auto diff = duration_cast<nanoseconds>(*next_timeout
+                                                 - clock_type::now());
+    const auto ns = std::max(diff.count(), nanoseconds::rep{0});
+    return {static_cast<time_t>(ns / 1'000'000'000),
+            static_cast<long>(ns % 1'000'000'000)};
   };
   const auto timeout = calculate_timeout();
   LOG_DEBUG("kevent ", NET_ARG(blocking), ", timeout={", timeout.tv_sec, "s,",
@@ -321,7 +368,7 @@ util::error kqueue_multiplexer::poll_once(bool blocking) {
                                 static_cast<int>(update_cache_.size()),
                                 pollset_.data(),
                                 static_cast<int>(pollset_.size()),
-                                (!current_timeout_ ? nullptr : &timeout));
+                                (!next_timeout ? nullptr : &timeout));
   update_cache_.clear();
   // Check for errors
   if (num_events < 0) {
@@ -329,6 +376,7 @@ util::error kqueue_multiplexer::poll_once(bool blocking) {
                             : util::error{util::error_code::runtime_error,
                                           util::last_error_as_string()};
   }
+  now_ = clock_type::now();
   // Handle all timeouts and io-events that have been registered
   handle_timeouts();
   handle_events(event_span(pollset_.data(), static_cast<size_t>(num_events)));
@@ -343,7 +391,7 @@ void kqueue_multiplexer::handle_events(event_span events) {
     LOG_DEBUG(NET_ARG2("res", to_string(res)));
     switch (res) {
       case event_result::done:
-        disable(mgr, op, true);
+        disable(mgr.get(), op, true);
         break;
       case event_result::error:
         del(mgr->handle());
@@ -0,0 +1,85 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      manager_pool.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/manager_pool.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+namespace net {
+
+manager_pool::manager_pool(std::size_t max_cached)
+  : max_cached_{max_cached}, ctrl_{std::make_shared<control_block>()} {
+  ctrl_->pool = this;
+  ctrl_->owner = std::this_thread::get_id();
+}
+
+manager_pool::~manager_pool() {
+  ctrl_->pool = nullptr;
+  for (auto& list : free_)
+    for (auto* block : list.blocks)
+      ::operator delete(block);
+}
+
+// -- memory management --------------------------------------------------------
+
+void* manager_pool::allocate(std::size_t size) {
+  auto& blocks = list_for(size).blocks;
+  if (blocks.empty())
+    return ::operator new(size);
+  auto* block = blocks.back();
+  blocks.pop_back();
+  return block;
+}
+
+void manager_pool::deallocate(void* ptr, std::size_t size) noexcept {
+  auto it = find_list(size);
+  if ((it == free_.end()) || (it->blocks.size() >= max_cached_)) {
+    ::operator delete(ptr);
+    return;
+  }
+  try {
+    it->blocks.push_back(ptr);
+  } catch (...) {
+    ::operator delete(ptr);
+  }
+}
+
+void manager_pool::release(const control_block& ctrl, void* ptr,
+                           std::size_t size) noexcept {
+  auto* pool = ctrl.pool.load();
+  if ((pool != nullptr) && (ctrl.owner.load() == std::this_thread::get_id()))
+    pool->deallocate(ptr, size);
+  else
+    ::operator delete(ptr);
+}
+
+std::vector<manager_pool::free_list>::iterator
+manager_pool::find_list(std::size_t size) noexcept {
+  return std::find_if(free_.begin(), free_.end(),
+                      [size](const auto& list) { return list.size == size; });
+}
+
+manager_pool::free_list& manager_pool::list_for(std::size_t size) {
+  if (auto it = find_list(size); it != free_.end())
+    return *it;
+  // Lists are created on allocation, deallocating must not throw
+  return free_.emplace_back(free_list{size, {}});
+}
+
+// -- properties ---------------------------------------------------------------
+
+std::size_t manager_pool::num_cached() const noexcept {
+  std::size_t result = 0;
+  for (const auto& list : free_)
+    result += list.blocks.size();
+  return result;
+}
+
+} // namespace net
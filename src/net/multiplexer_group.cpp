@@ -0,0 +1,99 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      multiplexer_group.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/multiplexer_group.hpp"
+
+#include "net/multiplexer.hpp"
+#include "net/multiplexer_impl.hpp"
+#include "net/offload_pool.hpp"
+
+#include "util/config.hpp"
+#include "util/error.hpp"
+#include "util/error_or.hpp"
+#include "util/logger.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+namespace net {
+
+multiplexer_group::~multiplexer_group() {
+  if (running()) {
+    shutdown();
+    join();
+  }
+}
+
+util::error multiplexer_group::init(socket_manager_factory_ptr factory,
+                                    const util::config& cfg) {
+  LOG_TRACE();
+  const auto num_threads = cfg.get_or<std::int64_t>(
+    "multiplexer.num-threads",
+    std::max(std::thread::hardware_concurrency(), 1u));
+  if (num_threads < 1)
+    return {util::error_code::invalid_argument,
+            "[multiplexer_group]: multiplexer.num-threads must be positive"};
+  LOG_DEBUG("initializing multiplexer_group with ", NET_ARG(num_threads));
+  const auto num_cpus = std::max(std::thread::hardware_concurrency(), 1u);
+  const bool steering = cfg.get_or("multiplexer.cpu-steering", false);
+  // All multiplexers share a single pool, which balances the work of busy
+  // multiplexers across all workers
+  const auto offload_threads = cfg.get_or<std::int64_t>(
+    "multiplexer.offload-threads", 0);
+  offload_pool_ptr pool;
+  if (offload_threads > 0)
+    pool = std::make_shared<offload_pool>(
+      static_cast<std::size_t>(offload_threads));
+  for (std::int64_t i = 0; i < num_threads; ++i) {
+    auto& mpx_cfg = cfgs_.emplace_back(cfg);
+    mpx_cfg.set_config_entry("multiplexer.reuseport", true);
+    mpx_cfg.set_config_entry("multiplexer.num-threads", num_threads);
+    mpx_cfg.set_config_entry("multiplexer.offload-threads", std::int64_t{0});
+    // The remaining acceptors join the port resolved by the first one
+    if (i > 0)
+      mpx_cfg.set_config_entry("multiplexer.port", std::int64_t{port_});
+    if (steering)
+      mpx_cfg.set_config_entry("multiplexer.cpu-affinity",
+                               std::int64_t{i % num_cpus});
+    auto res = make_multiplexer(factory, mpx_cfg);
+    if (auto err = util::get_error(res))
+      return *err;
+    mpxs_.emplace_back(std::get<multiplexer_ptr>(std::move(res)));
+    mpxs_.back()->offload(pool);
+    port_ = mpxs_.front()->port();
+  }
+  return util::none;
+}
+
+// -- Thread functions ---------------------------------------------------------
+
+void multiplexer_group::start() {
+  LOG_TRACE();
+  for (auto& mpx : mpxs_)
+    mpx->start();
+}
+
+void multiplexer_group::shutdown() {
+  LOG_TRACE();
+  for (auto& mpx : mpxs_)
+    mpx->shutdown();
+}
+
+void multiplexer_group::join() {
+  LOG_TRACE();
+  for (auto& mpx : mpxs_)
+    mpx->join();
+}
+
+bool multiplexer_group::running() const {
+  return std::any_of(mpxs_.begin(), mpxs_.end(),
+                     [](const auto& mpx) { return mpx->running(); });
+}
+
+} // namespace net
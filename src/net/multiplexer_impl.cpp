@@ -10,15 +10,19 @@
 
 #include "net/acceptor.hpp"
 #include "net/event_result.hpp"
+#include "net/offload_pool.hpp"
 #include "net/operation.hpp"
 #include "net/pollset_updater.hpp"
-#include "net/socket/pipe_socket.hpp"
 #include "net/socket/tcp_accept_socket.hpp"
 #include "net/socket_manager.hpp"
 
-#include "util/binary_serializer.hpp"
+#if defined(__linux__)
+#  include "net/uring_multiplexer.hpp"
+#endif
+
 #include "util/byte_span.hpp"
 #include "util/config.hpp"
+#include "util/cpu_affinity.hpp"
 #include "util/error.hpp"
 #include "util/error_or.hpp"
 #include "util/format.hpp"
@@ -26,16 +30,34 @@
 #include "util/logger.hpp"
 
 #include <algorithm>
+#include <cerrno>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <unistd.h>
 #include <utility>
 
+#include <sys/socket.h>
+
+#if defined(__linux__)
+#  include <linux/time_types.h>
+#  include <sys/syscall.h>
+#  include <sys/timerfd.h>
+#endif
+
 // -- identical implementation of the multiplexer_impl accross OSes ------------
 
 namespace net {
 
 multiplexer_impl::~multiplexer_impl() {
   LOG_TRACE();
+  // Workers must not post jobs to a destroyed multiplexer
+  if (offload_pool_)
+    offload_pool_->detach(this);
+#if defined(EPOLL_MPX)
+  if (timer_fd_ != invalid_socket_id)
+    ::close(timer_fd_);
+#endif
   ::close(mpx_fd_);
 }
 
@@ -55,25 +77,55 @@ util::error multiplexer_impl::init(socket_manager_factory_ptr factory,
     return {util::error_code::runtime_error,
             "[multiplexer_impl]: Creating epoll fd failed"};
   LOG_DEBUG("Created ", NET_ARG(mpx_fd_));
+  if (cfg_->get_or("multiplexer.high-resolution-timers", false)) {
+    timeouts_ = timing_wheel{timing_wheel::high_resolution};
+#if defined(EPOLL_MPX)
+    if (auto err = init_high_resolution_timers())
+      return err;
+#endif
+  }
+  const auto max_cached_buffers = cfg_->get_or<std::int64_t>(
+    "multiplexer.max-cached-buffers",
+    static_cast<std::int64_t>(buffer_pool::default_max_cached));
+  buffer_pool_ = buffer_pool{static_cast<std::size_t>(max_cached_buffers)};
+  const auto max_cached_managers = cfg_->get_or<std::int64_t>(
+    "multiplexer.max-cached-managers",
+    static_cast<std::int64_t>(manager_pool::default_max_cached));
+  manager_pool_.max_cached(static_cast<std::size_t>(max_cached_managers));
+  const auto offload_threads = cfg_->get_or<std::int64_t>(
+    "multiplexer.offload-threads", 0);
+  if (offload_threads > 0)
+    offload_pool_ = std::make_shared<offload_pool>(
+      static_cast<std::size_t>(offload_threads));
   // Create pollset updater
-  auto pipe_res = make_pipe();
-  if (auto err = util::get_error(pipe_res))
+  auto updater_res = make_pollset_updater(
+    this, static_cast<std::size_t>(cfg_->get_or<std::int64_t>(
+            "multiplexer.command-queue-size",
+            static_cast<std::int64_t>(pollset_updater::default_queue_size))));
+  if (auto err = util::get_error(updater_res))
     return *err;
-  auto pipe_fds = std::get<pipe_socket_pair>(pipe_res);
-  pipe_reader_ = pipe_fds.first;
-  pipe_writer_ = pipe_fds.second;
-  add(util::make_intrusive<pollset_updater>(pipe_reader_, this),
-      operation::read);
+  updater_ = std::get<pollset_updater_ptr>(updater_res);
+  add(updater_, operation::read);
   // Create Acceptor
   auto res = net::make_tcp_accept_socket(ip::v4_endpoint(
     (cfg_->get_or("multiplexer.local", true) ? ip::v4_address::localhost
                                              : ip::v4_address::any),
-    cfg_->get_or<std::int64_t>("multiplexer.port", 0)));
+    cfg_->get_or<std::int64_t>("multiplexer.port", 0)),
+    static_cast<int>(
+      cfg_->get_or<std::int64_t>("multiplexer.backlog", SOMAXCONN)),
+    cfg_->get_or("multiplexer.reuseport", false));
   if (auto err = util::get_error(res))
     return *err;
   auto accept_socket_pair = std::get<net::acceptor_pair>(res);
   auto accept_socket = accept_socket_pair.first;
   port_ = accept_socket_pair.second;
+  if (cfg_->get_or("multiplexer.cpu-steering", false)) {
+    const auto group_size = cfg_->get_or<std::int64_t>(
+      "multiplexer.num-threads", 1);
+    if (auto err = steer_by_cpu(accept_socket,
+                                static_cast<std::uint32_t>(group_size)))
+      return err;
+  }
   add(util::make_intrusive<acceptor>(accept_socket, this, std::move(factory)),
       operation::read);
   set_thread_id();
@@ -85,8 +137,13 @@ void multiplexer_impl::start() {
   if (!running_) {
     running_ = true;
     mpx_thread_ = std::thread(&multiplexer_impl::run, this);
-    mpx_thread_id_ = mpx_thread_.get_id();
-    LOG_DEBUG(NET_ARG(mpx_thread_id_));
+    const auto cpu = cfg_->get_or<std::int64_t>("multiplexer.cpu-affinity", -1);
+    if (cpu >= 0) {
+      if (auto err = util::pin_to_cpu(mpx_thread_,
+                                      static_cast<unsigned>(cpu))) {
+        LOG_ERROR(err);
+      }
+    }
   }
 }
 
@@ -97,8 +154,8 @@ void multiplexer_impl::shutdown() {
     auto it = managers_.begin();
     while (it != managers_.end()) {
       auto& mgr = it->second;
-      if (mgr->handle() != pipe_reader_) {
-        disable(mgr, operation::read, false);
+      if (mgr.get() != updater_.get()) {
+        disable(mgr.get(), operation::read, false);
         if (mgr->mask() == operation::none)
           it = del(it);
         else
@@ -108,16 +165,11 @@ void multiplexer_impl::shutdown() {
       }
     }
     shutting_down_ = true;
-    close(pipe_writer_);
-    pipe_writer_ = pipe_socket{};
+    // Removes the pollset_updater once it handled all pending commands
+    updater_->request_shutdown();
   } else if (!shutting_down_) {
     LOG_DEBUG("requesting multiplexer shutdown");
-    auto res = write_to_pipe(pollset_updater::shutdown_code);
-    if (res != 1) {
-      LOG_ERROR("could not write shutdown code to pipe: ",
-                last_socket_error_as_string());
-      std::terminate(); // Can't be handled by shutting down, if shutdown fails.
-    }
+    updater_->request_shutdown();
   }
 }
 
@@ -134,11 +186,15 @@ bool multiplexer_impl::running() const {
 }
 
 void multiplexer_impl::set_thread_id(std::thread::id tid) noexcept {
-  mpx_thread_id_ = tid;
+  mpx_thread_id_.store(tid, std::memory_order_relaxed);
+  manager_pool_.owner(tid);
 }
 
 void multiplexer_impl::run() {
   LOG_TRACE();
+  // The multiplexer thread sets its own id before polling, other threads
+  // keep using the command queue until then
+  set_thread_id(std::this_thread::get_id());
   while (running_) {
     if (poll_once(true))
       running_ = false;
@@ -152,49 +208,82 @@ void multiplexer_impl::handle_error([[maybe_unused]] const util::error& err) {
   shutdown();
 }
 
+// -- Offloading ---------------------------------------------------------------
+
+void multiplexer_impl::post(offload_job_ptr job) {
+  LOG_TRACE();
+  if (is_multiplexer_thread()) {
+    job->complete();
+    return;
+  }
+  updater_->push({pollset_updater::complete_code, nullptr, operation::none,
+                  false, 0, {}, job.release()});
+}
+
 // -- Timeout management -------------------------------------------------------
 
-uint64_t
-multiplexer_impl::set_timeout(socket_manager_ptr mgr,
-                              std::chrono::system_clock::time_point when) {
+uint64_t multiplexer_impl::set_timeout(socket_manager* mgr, time_point when) {
   LOG_TRACE();
-  LOG_DEBUG("Setting timeout ", current_timeout_id_, " on ",
+  if (!is_multiplexer_thread()) {
+    // The multiplexer adds the timeout under the id reserved by this thread
+    const auto id = timing_wheel::reserved_id | next_timeout_id_++;
+    mgr->ref();
+    updater_->push({pollset_updater::set_timeout_code, mgr,
+                    operation::none, false, id, when});
+    return id;
+  }
+  if (!is_registered(mgr))
+    return timing_wheel::invalid_id;
+  const auto id = timeouts_.add(mgr->handle().id, when);
+  LOG_DEBUG("Set timeout ", id, " on ", NET_ARG2("mgr", mgr->handle().id));
+  return id;
+}
+
+void multiplexer_impl::add_timeout(socket_manager* mgr, time_point when,
+                                   uint64_t timeout_id) {
+  LOG_TRACE();
+  if (!is_registered(mgr))
+    return;
+  timeouts_.add(mgr->handle().id, when, timeout_id);
+  LOG_DEBUG("Set timeout ", timeout_id, " on ",
             NET_ARG2("mgr", mgr->handle().id));
-  timeouts_.emplace(mgr->handle().id, when, current_timeout_id_);
-  current_timeout_ = (current_timeout_ != std::nullopt)
-                       ? std::min(when, *current_timeout_)
-                       : when;
-  return current_timeout_id_++;
+}
+
+bool multiplexer_impl::cancel_timeout(uint64_t timeout_id) {
+  LOG_TRACE();
+  LOG_DEBUG("Cancelling timeout ", timeout_id);
+  if (is_multiplexer_thread())
+    return timeouts_.cancel(timeout_id);
+  updater_->push({pollset_updater::cancel_timeout_code, nullptr,
+                  operation::none, false, timeout_id});
+  return true;
 }
 
 void multiplexer_impl::handle_timeouts() {
-  using namespace std::chrono;
   LOG_TRACE();
-  const auto now = time_point_cast<milliseconds>(system_clock::now());
-  for (auto it = timeouts_.begin(); it != timeouts_.end(); ++it) {
-    const auto& entry = *it;
-    const auto when = time_point_cast<milliseconds>(entry.when_);
-    if (when <= now) {
-      // Registered timeout has expired
-      managers_.at(entry.handle_)->handle_timeout(entry.id_);
-    } else {
-      // Timeout not expired, delete handled entries and set the current timeout
-      timeouts_.erase(timeouts_.begin(), it);
-      if (timeouts_.empty()) {
-        LOG_DEBUG("No further timeouts registered");
-        current_timeout_ = std::nullopt;
-      } else {
-        LOG_DEBUG("Next timeout with ", NET_ARG2("id", entry.id_));
-        current_timeout_ = entry.when_;
-      }
-      break;
-    }
+  timeouts_.advance(now_);
+  // Handlers may add or cancel timeouts while the batch is dispatched
+  while (auto timeout = timeouts_.pop()) {
+    if (auto it = managers_.find(timeout->handle); it != managers_.end())
+      it->second->handle_timeout(timeout->id);
   }
 }
 
 util::error_or<multiplexer_ptr>
 make_multiplexer(socket_manager_factory_ptr factory, const util::config& cfg) {
   LOG_TRACE();
+  const auto backend = cfg.get_or<std::string>("multiplexer.backend", "native");
+  if (backend == "io_uring") {
+#if defined(__linux__)
+    return make_uring_multiplexer(std::move(factory), cfg);
+#else
+    return util::error{util::error_code::invalid_argument,
+                       "io_uring is only available on linux"};
+#endif
+  } else if (backend != "native") {
+    return util::error{util::error_code::invalid_argument,
+                       "unknown multiplexer backend '{0}'", backend};
+  }
   auto mpx = std::make_shared<multiplexer_impl>();
   if (auto err = mpx->init(std::move(factory), cfg))
     return err;
@@ -203,57 +292,109 @@ make_multiplexer(socket_manager_factory_ptr factory, const util::config& cfg) {
 
 #if defined(EPOLL_MPX) // -- epoll specific implementation ---------------------
 
+using std::chrono::ceil;
+using std::chrono::duration_cast;
 using std::chrono::milliseconds;
-using std::chrono::system_clock;
-using std::chrono::time_point_cast;
+using std::chrono::nanoseconds;
+
+namespace {
+
+/// Calls epoll_pwait2 directly, since glibc only wraps it as of version 2.35.
+int epoll_pwait2_syscall(int epfd, epoll_event* events, int max_events,
+                         const __kernel_timespec* timeout) {
+#if defined(SYS_epoll_pwait2)
+  return static_cast<int>(
+    ::syscall(SYS_epoll_pwait2, epfd, events, max_events, timeout, nullptr, 0));
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+} // namespace
 
 // -- Interface functions ------------------------------------------------------
 
 void multiplexer_impl::add(socket_manager_ptr mgr, operation initial) {
-  mgr->mask_set(initial);
-  if (!nonblocking(mgr->handle(), true))
-    handle_error(util::error(util::error_code::socket_operation_failed,
-                             "Could not set nonblocking"));
-  mod(mgr->handle().id, EPOLL_CTL_ADD, mgr->mask());
-  managers_.emplace(mgr->handle().id, mgr);
-  // TODO: This should probably return an error instead of calling handle_error
-  if (auto err = mgr->init(*cfg_))
-    handle_error(err);
-}
-
-void multiplexer_impl::enable(socket_manager_ptr mgr, operation op) {
+  if (is_multiplexer_thread()) {
+    mgr->mask_set(initial);
+    managers_.emplace(mgr->handle().id, mgr);
+    // TODO: This should probably return an error instead of calling
+    // handle_error
+    if (auto err = mgr->init(*cfg_))
+      handle_error(err);
+    // Managers choose edge-triggered events during init. Changes of the mask
+    // made by init are part of the initial registration.
+    if (managers_.contains(mgr->handle().id)) {
+      mgr->clear_dirty();
+      mod(mgr.get(), EPOLL_CTL_ADD);
+    }
+  } else {
+    LOG_DEBUG("Requesting to add socket_manager with ",
+              NET_ARG2("id", mgr->handle().id), " for ", NET_ARG(initial));
+    mgr->ref();
+    updater_->push({pollset_updater::add_code, mgr.get(), initial});
+  }
+}
+
+void multiplexer_impl::enable(socket_manager* mgr, operation op) {
+  if (!is_multiplexer_thread()) {
+    mgr->ref();
+    updater_->push({pollset_updater::enable_code, mgr, op});
+    return;
+  }
+  if (!is_registered(mgr))
+    return;
+  const auto registered = mgr->mask();
   if (!mgr->mask_add(op))
     return;
-  mod(mgr->handle().id, EPOLL_CTL_MOD, mgr->mask());
+  mark_dirty(mgr, registered);
 }
 
-void multiplexer_impl::disable(socket_manager_ptr mgr, operation op,
-                               bool remove) {
+void multiplexer_impl::disable(socket_manager* mgr, operation op, bool remove) {
+  if (!is_multiplexer_thread()) {
+    mgr->ref();
+    updater_->push({pollset_updater::disable_code, mgr, op, remove});
+    return;
+  }
+  if (!is_registered(mgr))
+    return;
+  const auto registered = mgr->mask();
   if (!mgr->mask_del(op))
     return;
-  mod(mgr->handle().id, EPOLL_CTL_MOD, mgr->mask());
   if (remove && mgr->mask() == operation::none)
     del(mgr->handle());
+  else
+    mark_dirty(mgr, registered);
 }
 
 void multiplexer_impl::del(socket handle) {
-  mod(handle.id, EPOLL_CTL_DEL, operation::none);
-  managers_.erase(handle.id);
-  if (shutting_down_ && managers_.empty())
-    running_ = false;
+  if (auto it = managers_.find(handle.id); it != managers_.end())
+    del(it);
 }
 
 multiplexer_impl::manager_map::iterator
 multiplexer_impl::del(manager_map::iterator it) {
-  auto fd = it->second->handle().id;
-  mod(fd, EPOLL_CTL_DEL, operation::none);
+  auto& mgr = it->second;
+  // Pending events of this batch may still point to the manager. A cleared
+  // mask marks it as deleted for handle_events.
+  mgr->mask_set(operation::none);
+  mod(mgr.get(), EPOLL_CTL_DEL);
+  // The entry in dirty_ is skipped once it is no longer marked
+  mgr->clear_dirty();
+  // The handle may be reused by the next manager
+  timeouts_.cancel_all(it->first);
+  std::erase_if(ready_, [&](const auto& entry) {
+    return entry.first == mgr.get();
+  });
+  graveyard_.emplace_back(std::move(mgr));
   auto new_it = managers_.erase(it);
   if (shutting_down_ && managers_.empty())
     running_ = false;
   return new_it;
 }
 
-void multiplexer_impl::mod(int fd, int op, operation events) {
+void multiplexer_impl::mod(socket_manager* mgr, int op) {
   static const auto to_epoll_flag = [](net::operation op) -> uint32_t {
     switch (op) {
       case net::operation::none:
@@ -269,71 +410,186 @@ void multiplexer_impl::mod(int fd, int op, operation events) {
     }
   };
   epoll_event event{};
-  event.events = to_epoll_flag(events);
-  event.data.fd = fd;
-  if (epoll_ctl(mpx_fd_, op, fd, &event) < 0) {
+  event.events = to_epoll_flag(mgr->mask());
+  if (mgr->edge_triggered())
+    event.events |= EPOLLET;
+  event.data.ptr = mgr;
+  if (epoll_ctl(mpx_fd_, op, mgr->handle().id, &event) < 0) {
     handle_error({util::error_code::runtime_error, "epoll_ctl: {0}",
                   util::last_error_as_string()});
   }
 }
 
-util::error multiplexer_impl::poll_once(bool blocking) {
-  // Calculates the timeout value for the epoll_wait call
-  auto timeout = [&]() -> int {
-    if (!blocking)
-      return 0; // nonblocking
-    if (current_timeout_ == std::nullopt)
-      return -1; // No timeout
-    auto now = time_point_cast<milliseconds>(system_clock::now());
-    auto timeout_tp = time_point_cast<milliseconds>(*current_timeout_);
-    return static_cast<int>((timeout_tp - now).count());
+void multiplexer_impl::mark_dirty(socket_manager* mgr, operation registered) {
+  ++num_pending_updates_;
+  // Keeps the mask of the first change, which is the one known to epoll
+  if (mgr->mark_dirty(registered))
+    dirty_.emplace_back(mgr);
+}
+
+void multiplexer_impl::apply_updates() {
+  std::uint64_t num_applied = 0;
+  // Error handling may mark further managers, which invalidates iterators
+  for (std::size_t i = 0; i < dirty_.size(); ++i) {
+    auto* mgr = dirty_[i].get();
+    if (!mgr->dirty())
+      continue;
+    // Changes that cancel each other out do not need a syscall
+    if (mgr->clear_dirty() == mgr->mask())
+      continue;
+    mod(mgr, EPOLL_CTL_MOD);
+    ++num_applied;
+  }
+  dirty_.clear();
+  num_coalesced_updates_ += num_pending_updates_ - num_applied;
+  num_pending_updates_ = 0;
+}
+
+util::error multiplexer_impl::init_high_resolution_timers() {
+  LOG_TRACE();
+  high_resolution_timers_ = true;
+  // epoll_pwait2 is available as of linux 5.11
+  const __kernel_timespec zero{};
+  if (!cfg_->get_or("multiplexer.timerfd", false)
+      && (epoll_pwait2_syscall(mpx_fd_, pollset_.data(), 1, &zero) >= 0))
+    return util::none;
+  LOG_DEBUG("falling back to timerfd for high-resolution timers");
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer_fd_ < 0)
+    return {util::error_code::runtime_error,
+            "[multiplexer_impl]: Creating timerfd failed: {0}",
+            util::last_error_as_string()};
+  // A null pointer marks events of the timerfd
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.ptr = nullptr;
+  if (epoll_ctl(mpx_fd_, EPOLL_CTL_ADD, timer_fd_, &event) < 0)
+    return {util::error_code::runtime_error, "epoll_ctl: {0}",
+            util::last_error_as_string()};
+  return util::none;
+}
+
+int multiplexer_impl::wait(bool blocking, std::optional<time_point> deadline) {
+  const auto max_events = static_cast<int>(pollset_.size());
+  const bool timed = blocking && deadline.has_value();
+  // The loop time is stale by the time it took to handle the last batch
+  const auto remaining = [&] {
+    return std::max(duration_cast<nanoseconds>(*deadline - clock_type::now()),
+                    nanoseconds{0});
   };
+  if (!high_resolution_timers_) {
+    int timeout = blocking ? -1 : 0;
+    // Rounding up avoids spinning on timeouts that are due in less than 1ms
+    if (timed)
+      timeout = static_cast<int>(ceil<milliseconds>(remaining()).count());
+    return epoll_wait(mpx_fd_, pollset_.data(), max_events, timeout);
+  }
+  if (timer_fd_ == invalid_socket_id) {
+    __kernel_timespec ts{};
+    if (timed) {
+      const auto ns = remaining().count();
+      ts.tv_sec = ns / 1000000000;
+      ts.tv_nsec = ns % 1000000000;
+    }
+    return epoll_pwait2_syscall(mpx_fd_, pollset_.data(), max_events,
+                                (blocking && !timed) ? nullptr : &ts);
+  }
+  // The timerfd only has to be re-armed when the next timeout changed
+  if (timed && (*deadline != timer_deadline_)) {
+    const auto ns = duration_cast<nanoseconds>(deadline->time_since_epoch())
+                      .count();
+    itimerspec spec{};
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+    if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) < 0)
+      return -1;
+    timer_deadline_ = *deadline;
+  }
+  return epoll_wait(mpx_fd_, pollset_.data(), max_events, blocking ? -1 : 0);
+}
 
+util::error multiplexer_impl::poll_once(bool blocking) {
+  apply_updates();
+  // Ready managers must not wait for new events
+  auto ready = std::exchange(ready_, {});
   // Poll for events on the reqistered sockets
-  auto num_events = epoll_wait(mpx_fd_, pollset_.data(),
-                               static_cast<int>(pollset_.size()), timeout());
+  auto num_events = wait(blocking && ready.empty(), timeouts_.next_expiry());
   // Check for errors
   if (num_events < 0) {
     return (errno == EINTR) ? util::none
                             : util::error{util::error_code::runtime_error,
                                           util::last_error_as_string()};
   }
+  now_ = clock_type::now();
   // Handle all timeouts and io-events that have been registered
   handle_timeouts();
   handle_events(event_span(pollset_.data(), static_cast<size_t>(num_events)));
+  handle_ready(std::move(ready));
+  // No event refers to the deleted managers anymore
+  graveyard_.clear();
   return util::none;
 }
 
-void multiplexer_impl::handle_events(event_span events) {
-  auto handle_result = [&](socket_manager_ptr& mgr, event_result res,
-                           operation op) -> bool {
-    if (res == event_result::done) {
-      disable(mgr, op, true);
-    } else if (res == event_result::error) {
-      del(mgr->handle());
-      return false;
-    }
-    return true;
-  };
+bool multiplexer_impl::handle_result(socket_manager* mgr, event_result res,
+                                     operation op) {
+  if (res == event_result::done) {
+    disable(mgr, op, true);
+  } else if (res == event_result::error) {
+    del(mgr->handle());
+    return false;
+  } else if ((res == event_result::again) && mgr->edge_triggered()) {
+    // Level-triggered managers are notified again by epoll anyway
+    const auto is_entry = [&](const auto& entry) {
+      return (entry.first == mgr) && (entry.second == op);
+    };
+    if (std::none_of(ready_.begin(), ready_.end(), is_entry))
+      ready_.emplace_back(mgr, op);
+  }
+  return true;
+}
 
+void multiplexer_impl::handle_ready(ready_list ready) {
+  for (const auto& [mgr, op] : ready) {
+    // Skips managers that were deleted or disabled in the meantime
+    if ((mgr->mask() & op) != op)
+      continue;
+    if (op == operation::read)
+      handle_result(mgr.get(), mgr->handle_read_event(), op);
+    else
+      handle_result(mgr.get(), mgr->handle_write_event(), op);
+  }
+}
+
+void multiplexer_impl::handle_events(event_span events) {
   for (auto& event : events) {
+    // The timerfd only wakes up the multiplexer, the timeouts are handled
+    // beforehand
+    if (event.data.ptr == nullptr) {
+      std::uint64_t num_expirations = 0;
+      [[maybe_unused]] auto res = ::read(timer_fd_, &num_expirations,
+                                         sizeof(num_expirations));
+      timer_deadline_ = time_point{};
+      continue;
+    }
+    auto mgr = static_cast<socket_manager*>(event.data.ptr);
+    // Skip managers that were deleted while handling this batch
+    if (mgr->mask() == operation::none)
+      continue;
     if (event.events == (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) {
-      LOG_ERROR("epoll_wait failed on socket = ", event.data.fd, ": ",
+      LOG_ERROR("epoll_wait failed on socket = ", mgr->handle().id, ": ",
                 util::last_error_as_string());
-      del(socket{event.data.fd});
+      del(mgr->handle());
       continue;
-    } else {
-      auto& mgr = managers_[event.data.fd];
-      // Handle possible read event
-      if ((event.events & EPOLLIN) == EPOLLIN) {
-        if (!handle_result(mgr, mgr->handle_read_event(), operation::read))
-          continue;
-      }
-      // Handle possible write event
-      if ((event.events & EPOLLOUT) == EPOLLOUT) {
-        if (!handle_result(mgr, mgr->handle_write_event(), operation::write))
-          continue;
-      }
+    }
+    // Handle possible read event
+    if ((event.events & EPOLLIN) == EPOLLIN) {
+      if (!handle_result(mgr, mgr->handle_read_event(), operation::read))
+        continue;
+    }
+    // Handle possible write event
+    if ((event.events & EPOLLOUT) == EPOLLOUT) {
+      if (!handle_result(mgr, mgr->handle_write_event(), operation::write))
+        continue;
     }
   }
 }
@@ -345,15 +601,11 @@ void multiplexer_impl::add(socket_manager_ptr mgr, operation initial) {
   if (is_multiplexer_thread()) {
     LOG_DEBUG("Adding socket_manager with ", NET_ARG2("id", mgr->handle().id),
               " for ", NET_ARG(initial));
-    // Set nonblocking on socket
-    if (!nonblocking(mgr->handle(), true))
-      handle_error(util::error(util::error_code::socket_operation_failed,
-                               "Could not set nonblocking"));
     // Add the mgr to the pollset for both reading and writing and enable it for
     // the initial operations
     mod(mgr->handle().id, (EV_ADD | EV_DISABLE), operation::read_write);
-    enable(mgr, initial);
     managers_.emplace(mgr->handle().id, mgr);
+    enable(mgr.get(), initial);
     // TODO: This should probably return an error instead of calling
     // handle_error
     if (auto err = mgr->init(*cfg_))
@@ -362,27 +614,36 @@ void multiplexer_impl::add(socket_manager_ptr mgr, operation initial) {
     LOG_DEBUG("Requesting to add socket_manager with ",
               NET_ARG2("id", mgr->handle().id), " for ", NET_ARG(initial));
     mgr->ref();
-    write_to_pipe(pollset_updater::add_code, mgr.get(), initial);
+    updater_->push({pollset_updater::add_code, mgr.get(), initial});
   }
 }
 
-void multiplexer_impl::enable(socket_manager_ptr mgr, operation op) {
+void multiplexer_impl::enable(socket_manager* mgr, operation op) {
   LOG_TRACE();
   LOG_DEBUG("Enabling mgr with ", NET_ARG2("id", mgr->handle().id),
             " registered for ", NET_ARG2("mask", to_string(mgr->mask())),
             " for ", NET_ARG2("new_event", to_string(op)));
-  if (!mgr->mask_add(op))
+  if (!is_multiplexer_thread()) {
+    mgr->ref();
+    updater_->push({pollset_updater::enable_code, mgr, op});
+    return;
+  }
+  if (!is_registered(mgr) || !mgr->mask_add(op))
     return;
   mod(mgr->handle().id, EV_ENABLE, mgr->mask());
 }
 
-void multiplexer_impl::disable(socket_manager_ptr mgr, operation op,
-                               bool remove) {
+void multiplexer_impl::disable(socket_manager* mgr, operation op, bool remove) {
   LOG_TRACE();
   LOG_DEBUG("Disabling mgr with ", NET_ARG2("id", mgr->handle().id),
             " registered for ", NET_ARG2("mask", to_string(mgr->mask())),
             " for ", NET_ARG2("event", to_string(op)));
-  if (!mgr->mask_del(op))
+  if (!is_multiplexer_thread()) {
+    mgr->ref();
+    updater_->push({pollset_updater::disable_code, mgr, op, remove});
+    return;
+  }
+  if (!is_registered(mgr) || !mgr->mask_del(op))
     return;
   mod(mgr->handle().id, EV_DISABLE, op);
   if (remove && mgr->mask() == operation::none)
@@ -393,6 +654,7 @@ void multiplexer_impl::del(socket handle) {
   LOG_TRACE();
   LOG_DEBUG("Deleting mgr with ", NET_ARG2("id", handle.id));
   mod(handle.id, EV_DELETE, operation::read_write);
+  timeouts_.cancel_all(handle.id);
   managers_.erase(handle.id);
   if (shutting_down_ && managers_.empty())
     running_ = false;
@@ -404,6 +666,7 @@ multiplexer_impl::del(manager_map::iterator it) {
   auto fd = it->second->handle().id;
   LOG_DEBUG("Deleting mgr with ", NET_ARG2("id", fd));
   mod(fd, EV_DELETE, operation::read_write);
+  timeouts_.cancel_all(fd);
   auto new_it = managers_.erase(it);
   if (shutting_down_ && managers_.empty())
     running_ = false;
@@ -442,14 +705,17 @@ void multiplexer_impl::mod(int fd, int op, operation events) {
 util::error multiplexer_impl::poll_once(bool blocking) {
   using namespace std::chrono;
   LOG_TRACE();
+  const auto next_timeout = timeouts_.next_expiry();
   // Calculates the timeout value for the kqueue call
-  auto calculate_timeout = [this, blocking]() -> timespec {
-    if (!blocking || !current_timeout_)
+  auto calculate_timeout = [&]() -> timespec {
+    if (!blocking || !next_timeout)
       return {0, 0};
-    const auto now = time_point_cast<milliseconds>(system_clock::now());
-    const auto timeout_tp = time_point_cast<milliseconds>(*current_timeout_);
-    const auto diff_ms = (timeout_tp - now).count();
-    return {(diff_ms / 1000), ((diff_ms % 1000) * 1000000)};
+    // The loop time is stale by the time it took to handle the last batch
+    const auto diff = duration_cast<nanoseconds>(*next_timeout
+                                                 - clock_type::now());
+    const auto ns = std::max(diff.count(), nanoseconds::rep{0});
+    return {static_cast<time_t>(ns / 1'000'000'000),
+            static_cast<long>(ns % 1'000'000'000)};
   };
   const auto timeout = calculate_timeout();
   LOG_DEBUG("kevent ", NET_ARG(blocking), ", timeout={", timeout.tv_sec, "s,",
@@ -458,7 +724,7 @@ util::error multiplexer_impl::poll_once(bool blocking) {
                                 static_cast<int>(update_cache_.size()),
                                 pollset_.data(),
                                 static_cast<int>(pollset_.size()),
-                                (!current_timeout_ ? nullptr : &timeout));
+                                (!next_timeout ? nullptr : &timeout));
   update_cache_.clear();
   // Check for errors
   if (num_events < 0) {
@@ -466,6 +732,7 @@ util::error multiplexer_impl::poll_once(bool blocking) {
                             : util::error{util::error_code::runtime_error,
                                           util::last_error_as_string()};
   }
+  now_ = clock_type::now();
   // Handle all timeouts and io-events that have been registered
   handle_timeouts();
   handle_events(event_span(pollset_.data(), static_cast<size_t>(num_events)));
@@ -480,7 +747,7 @@ void multiplexer_impl::handle_events(event_span events) {
     LOG_DEBUG(NET_ARG2("res", to_string(res)));
     switch (res) {
       case event_result::done:
-        disable(mgr, op, true);
+        disable(mgr.get(), op, true);
         break;
       case event_result::error:
         del(mgr->handle());
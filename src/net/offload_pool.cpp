@@ -0,0 +1,155 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      offload_pool.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/offload_pool.hpp"
+
+#include "net/multiplexer.hpp"
+
+#include "util/logger.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/// The pool that the current thread works for.
+thread_local net::offload_pool* current_pool = nullptr;
+
+/// The index of the current thread in `current_pool`.
+thread_local std::size_t current_worker = 0;
+
+} // namespace
+
+namespace net {
+
+offload_pool::offload_pool(std::size_t num_workers) {
+  num_workers = std::max(num_workers, std::size_t{1});
+  workers_.reserve(num_workers);
+  for (std::size_t i = 0; i < num_workers; ++i)
+    workers_.emplace_back(std::make_unique<worker>());
+  threads_.reserve(num_workers);
+  for (std::size_t i = 0; i < num_workers; ++i)
+    threads_.emplace_back(&offload_pool::run, this, i);
+}
+
+offload_pool::~offload_pool() {
+  stop();
+}
+
+// -- thread-safe interface ----------------------------------------------------
+
+bool offload_pool::submit(offload_job_ptr job) {
+  // Jobs spawned by a job stay local, others are spread across all workers
+  const auto id = (current_pool == this)
+                    ? current_worker
+                    : next_worker_.fetch_add(1, std::memory_order_relaxed)
+                        % workers_.size();
+  return push(id, std::move(job));
+}
+
+void offload_pool::detach(multiplexer* mpx) {
+  std::vector<offload_job_ptr> dropped;
+  for (auto& w : workers_) {
+    std::lock_guard<std::mutex> guard{w->mtx};
+    auto is_dropped = [mpx](const offload_job_ptr& job) {
+      return job->manager()->mpx() == mpx;
+    };
+    for (auto& job : w->jobs)
+      if (is_dropped(job))
+        dropped.emplace_back(std::move(job));
+    std::erase_if(w->jobs, [](const auto& job) { return !job; });
+  }
+  pending_.fetch_sub(dropped.size());
+  // Jobs taken before their queue was visited are still running
+  for (auto& w : workers_)
+    while (w->running.load() == mpx)
+      std::this_thread::yield();
+}
+
+void offload_pool::stop() {
+  {
+    std::lock_guard<std::mutex> guard{mtx_};
+    if (stopping_.exchange(true))
+      return;
+  }
+  cv_.notify_all();
+  for (auto& thread : threads_)
+    thread.join();
+  for (auto& w : workers_) {
+    std::lock_guard<std::mutex> guard{w->mtx};
+    w->jobs.clear();
+  }
+  pending_ = 0;
+}
+
+// -- private member functions -------------------------------------------------
+
+bool offload_pool::push(std::size_t id, offload_job_ptr job) {
+  {
+    auto& w = *workers_[id];
+    std::lock_guard<std::mutex> guard{w.mtx};
+    // Jobs queued after `stop` cleared the queues would never run
+    if (stopping_)
+      return false;
+    pending_.fetch_add(1);
+    w.jobs.emplace_back(std::move(job));
+  }
+  // Sleeping workers check `pending_` after announcing that they sleep
+  if (sleeping_.load() > 0) {
+    std::lock_guard<std::mutex> guard{mtx_};
+    cv_.notify_one();
+  }
+  return true;
+}
+
+offload_job_ptr offload_pool::take(std::size_t id) {
+  {
+    auto& own = *workers_[id];
+    std::lock_guard<std::mutex> guard{own.mtx};
+    if (!own.jobs.empty()) {
+      auto job = std::move(own.jobs.back());
+      own.jobs.pop_back();
+      own.running = job->manager()->mpx();
+      return job;
+    }
+  }
+  for (std::size_t i = 1; i < workers_.size(); ++i) {
+    auto& victim = *workers_[(id + i) % workers_.size()];
+    std::lock_guard<std::mutex> guard{victim.mtx};
+    if (!victim.jobs.empty()) {
+      auto job = std::move(victim.jobs.front());
+      victim.jobs.pop_front();
+      workers_[id]->running = job->manager()->mpx();
+      return job;
+    }
+  }
+  return nullptr;
+}
+
+void offload_pool::run(std::size_t id) {
+  current_pool = this;
+  current_worker = id;
+  while (!stopping_) {
+    if (auto job = take(id)) {
+      pending_.fetch_sub(1);
+      job->run();
+      // The multiplexer of the manager completes and releases the job
+      auto* mpx = job->manager()->mpx();
+      mpx->post(std::move(job));
+      workers_[id]->running = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> guard{mtx_};
+    sleeping_.fetch_add(1);
+    cv_.wait(guard, [this] { return stopping_ || (pending_.load() > 0); });
+    sleeping_.fetch_sub(1);
+  }
+}
+
+} // namespace net
@@ -10,66 +10,125 @@
 
 #include "net/event_result.hpp"
 #include "net/multiplexer.hpp"
+#include "net/offload_pool.hpp"
 #include "net/socket/pipe_socket.hpp"
 
-#include "util/byte_span.hpp"
+#include "util/byte_array.hpp"
 #include "util/error.hpp"
+#include "util/error_or.hpp"
 #include "util/logger.hpp"
 
-namespace {
+#include <exception>
+#include <thread>
+#include <utility>
+#include <unistd.h>
 
-template <class T>
-util::error read_from_pipe(net::pipe_socket handle, T& t) {
-  if (auto res = net::read(handle, util::as_bytes(&t, sizeof(T)));
-      res != sizeof(T)) {
-    LOG_ERROR("Could not read ", sizeof(T),
-              " bytes from pipe socket: ", net::last_socket_error_as_string());
-    return util::error_code::runtime_error;
-  }
-  return util::none;
-}
-
-} // namespace
+#if defined(__linux__)
+#  include <sys/eventfd.h>
+#endif
 
 namespace net {
 
-pollset_updater::pollset_updater(pipe_socket handle, multiplexer* mpx)
-  : socket_manager(handle, mpx) {
+pollset_updater::pollset_updater(socket read_handle, socket write_handle,
+                                 multiplexer* mpx, std::size_t queue_size)
+  : socket_manager(read_handle, mpx),
+    write_handle_{write_handle},
+    commands_{queue_size} {
   LOG_TRACE();
 }
 
+pollset_updater::~pollset_updater() {
+  // Releases the references held by commands that were never handled
+  while (auto cmd = commands_.pop()) {
+    util::make_intrusive(cmd->mgr, false);
+    util::make_intrusive(cmd->job, false);
+  }
+  if (write_handle_ != handle())
+    close(write_handle_);
+}
+
 util::error pollset_updater::init(const util::config&) {
   LOG_TRACE();
   return util::none;
 }
 
-// -- interface functions ----------------------------------------------------
+// -- thread-safe interface ----------------------------------------------------
+
+void pollset_updater::push(command cmd) {
+  while (!commands_.try_push(cmd))
+    std::this_thread::yield();
+  signal();
+}
+
+void pollset_updater::request_shutdown() {
+  shutdown_requested_ = true;
+  signal();
+}
+
+void pollset_updater::signal() {
+  // Only the first command after the multiplexer drained the queue wakes it
+  // up. Raising the flag releases the pushed command to the multiplexer.
+  if (signalled_.exchange(true, std::memory_order_acq_rel))
+    return;
+#if defined(__linux__)
+  const std::uint64_t value = 1;
+#else
+  const std::uint8_t value = 1;
+#endif
+  if (::write(write_handle_.id, &value, sizeof(value)) != sizeof(value)) {
+    LOG_ERROR("could not signal the multiplexer: ",
+              last_socket_error_as_string());
+    std::terminate(); // Commands would never be handled
+  }
+}
+
+// -- interface functions ------------------------------------------------------
 
 event_result pollset_updater::handle_read_event() {
   LOG_TRACE();
-  opcode code;
-  if (auto err = read_from_pipe(handle<pipe_socket>(), code))
-    return event_result::ok;
-  switch (code) {
-    case add_code: {
-      socket_manager* mgr_ptr = nullptr;
-      operation op;
-      if (auto err = read_from_pipe(handle<pipe_socket>(), mgr_ptr))
-        return event_result::ok;
-      if (auto err = read_from_pipe(handle<pipe_socket>(), op))
-        return event_result::ok;
-      LOG_DEBUG("Received add_code for mgr with ",
-                NET_ARG2("id", mgr_ptr->handle().id), " with ", NET_ARG(op));
-      mpx()->add(util::make_intrusive(mgr_ptr, false), op);
-      break;
+  // The eventfd is reset by a single read, the pipe holds at most a byte
+  util::byte_array<8> buf;
+  [[maybe_unused]] auto res = ::read(handle().id, buf.data(), buf.size());
+  // Producers have to signal again for commands pushed after this point. They
+  // push before raising the flag, so acquiring the flag here makes the
+  // commands of every producer that found it raised visible to the drain
+  // below. Producers that come later find it cleared and signal again, so
+  // no wakeup is lost.
+  signalled_.exchange(false, std::memory_order_acq_rel);
+  while (auto cmd = commands_.pop()) {
+    // Adopts the reference that was acquired when pushing the command
+    auto mgr = util::make_intrusive(cmd->mgr, false);
+    switch (cmd->code) {
+      case add_code:
+        LOG_DEBUG("Received add_code for mgr with ",
+                  NET_ARG2("id", mgr->handle().id), " with ",
+                  NET_ARG2("op", cmd->op));
+        mpx()->add(std::move(mgr), cmd->op);
+        break;
+      case enable_code:
+        mpx()->enable(mgr.get(), cmd->op);
+        break;
+      case disable_code:
+        mpx()->disable(mgr.get(), cmd->op, cmd->remove);
+        break;
+      case set_timeout_code:
+        mpx()->add_timeout(mgr.get(), cmd->when, cmd->timeout_id);
+        break;
+      case cancel_timeout_code:
+        mpx()->cancel_timeout(cmd->timeout_id);
+        break;
+      case complete_code:
+        util::make_intrusive(cmd->job, false)->complete();
+        break;
+      default:
+        LOG_WARNING("Received unspecified code");
+        break;
     }
-    case shutdown_code:
-      LOG_DEBUG("Received shutdown_code");
-      mpx()->shutdown();
-      return event_result::done;
-    default:
-      LOG_WARNING("Received unspecified code");
-      break;
+  }
+  if (shutdown_requested_) {
+    LOG_DEBUG("Received shutdown request");
+    mpx()->shutdown();
+    return event_result::done;
   }
   return event_result::ok;
 }
@@ -90,4 +149,29 @@ event_result pollset_updater::handle_timeout(uint64_t) {
   return event_result::error;
 }
 
+util::error_or<pollset_updater_ptr>
+make_pollset_updater(multiplexer* mpx, std::size_t queue_size) {
+#if defined(__linux__)
+  const auto fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0)
+    return util::error{util::error_code::socket_operation_failed,
+                       "eventfd: {0}", last_socket_error_as_string()};
+  return util::make_intrusive<pollset_updater>(socket{fd}, socket{fd}, mpx,
+                                               queue_size);
+#else
+  auto pipe_res = make_pipe();
+  if (auto err = util::get_error(pipe_res))
+    return *err;
+  auto [reader, writer] = std::get<pipe_socket_pair>(pipe_res);
+  if (!nonblocking(reader, true)) {
+    close(reader);
+    close(writer);
+    return util::error{util::error_code::socket_operation_failed,
+                       "Could not set nonblocking on the pollset_updater pipe"};
+  }
+  return util::make_intrusive<pollset_updater>(reader, writer, mpx,
+                                               queue_size);
+#endif
+}
+
 } // namespace net
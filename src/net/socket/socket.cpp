@@ -91,4 +91,14 @@ bool reuseaddr(socket sock, bool new_value) {
   return res == 0;
 }
 
+bool reuseport(socket sock, bool new_value) {
+  LOG_DEBUG("reuseport on ", NET_ARG2("socket", sock.id), ", ",
+            NET_ARG(new_value));
+  int on = new_value ? 1 : 0;
+  const auto res = setsockopt(sock.id, SOL_SOCKET, SO_REUSEPORT,
+                              reinterpret_cast<const void*>(&on),
+                              static_cast<unsigned>(sizeof(on)));
+  return res == 0;
+}
+
 } // namespace net
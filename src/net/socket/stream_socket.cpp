@@ -21,6 +21,7 @@
 #include <utility>
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 namespace {
 
@@ -63,4 +64,14 @@ ptrdiff_t write(stream_socket hdl, util::const_byte_span buf) {
                 no_sigpipe_io_flag);
 }
 
+ptrdiff_t write(stream_socket hdl, std::span<const iovec> bufs) {
+  LOG_DEBUG("Writing ", bufs.size(), " buffers to stream_socket with ",
+            NET_ARG2("fd", hdl.id));
+  // sendmsg, unlike writev, supports suppressing SIGPIPE
+  msghdr msg{};
+  msg.msg_iov = const_cast<iovec*>(bufs.data());
+  msg.msg_iovlen = static_cast<decltype(msg.msg_iovlen)>(bufs.size());
+  return ::sendmsg(hdl.id, &msg, no_sigpipe_io_flag);
+}
+
 } // namespace net
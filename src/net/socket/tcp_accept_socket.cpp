@@ -18,8 +18,13 @@
 #include "util/error_or.hpp"
 #include "util/logger.hpp"
 
+#include <iterator>
 #include <utility>
 
+#if defined(__linux__)
+#  include <linux/filter.h>
+#endif
+
 namespace net {
 
 util::error listen(tcp_accept_socket sock, int conn_backlog) {
@@ -35,21 +40,49 @@ tcp_stream_socket accept(tcp_accept_socket sock) {
   LOG_DEBUG("accept on ", NET_ARG2("socket", sock.id));
   sockaddr_in cli = {};
   socklen_t len = sizeof(sockaddr_in);
-  return tcp_stream_socket{
+#if defined(__linux__)
+  // Saves the additional fcntl calls for every accepted connection
+  return tcp_stream_socket{::accept4(sock.id,
+                                     reinterpret_cast<sockaddr*>(&cli), &len,
+                                     SOCK_NONBLOCK | SOCK_CLOEXEC)};
+#else
+  const tcp_stream_socket accepted{
     ::accept(sock.id, reinterpret_cast<sockaddr*>(&cli), &len)};
+  if ((accepted != invalid_socket) && !nonblocking(accepted, true)) {
+    close(accepted);
+    return tcp_stream_socket{invalid_socket_id};
+  }
+  return accepted;
+#endif
 }
 
 util::error_or<acceptor_pair> make_tcp_accept_socket(const ip::v4_endpoint& ep,
-                                                     const int conn_backlog) {
+                                                     const int conn_backlog,
+                                                     bool reuse_port) {
   LOG_DEBUG("Creating tcp_accept_socket for ",
             NET_ARG2("endpoint", to_string(ep)), ", ", NET_ARG(conn_backlog));
+#if defined(__linux__)
+  const tcp_accept_socket sock{
+    ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+#else
   const tcp_accept_socket sock{::socket(AF_INET, SOCK_STREAM, 0)};
+#endif
   if (sock == invalid_socket) {
     return util::error(util::error_code::socket_operation_failed,
                        "Failed to create socket {0}",
                        util::last_error_as_string());
   }
   auto guard = make_socket_guard(sock);
+#if !defined(__linux__)
+  if (!nonblocking(sock, true))
+    return util::error(util::error_code::socket_operation_failed,
+                       "Failed to set nonblocking {0}",
+                       util::last_error_as_string());
+#endif
+  if (reuse_port && !reuseport(sock, true))
+    return util::error(util::error_code::socket_operation_failed,
+                       "Failed to set SO_REUSEPORT {0}",
+                       util::last_error_as_string());
   if (auto err = bind(sock, ep))
     return err;
   if (auto err = listen(sock, conn_backlog))
@@ -61,4 +94,33 @@ util::error_or<acceptor_pair> make_tcp_accept_socket(const ip::v4_endpoint& ep,
   return std::make_pair(guard.release(), std::get<uint16_t>(res));
 }
 
+util::error steer_by_cpu([[maybe_unused]] tcp_accept_socket sock,
+                         [[maybe_unused]] std::uint32_t group_size) {
+  LOG_DEBUG("steer_by_cpu on ", NET_ARG2("socket", sock.id), ", ",
+            NET_ARG(group_size));
+#if defined(__linux__)
+  if (group_size == 0)
+    return {util::error_code::invalid_argument,
+            "steering requires a nonempty reuseport group"};
+  // A = cpu; A %= group_size; return A
+  sock_filter code[] = {
+    {BPF_LD | BPF_W | BPF_ABS, 0, 0,
+     static_cast<std::uint32_t>(SKF_AD_OFF + SKF_AD_CPU)},
+    {BPF_ALU | BPF_MOD | BPF_K, 0, 0, group_size},
+    {BPF_RET | BPF_A, 0, 0, 0},
+  };
+  sock_fprog prog{static_cast<unsigned short>(std::size(code)), code};
+  if (::setsockopt(sock.id, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+                   sizeof(prog))
+      != 0)
+    return {util::error_code::socket_operation_failed,
+            "Failed to attach steering program: {0}",
+            util::last_error_as_string()};
+  return util::none;
+#else
+  return {util::error_code::runtime_error,
+          "steering by cpu is not supported on this platform"};
+#endif
+}
+
 } // namespace net
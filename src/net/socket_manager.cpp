@@ -30,7 +30,10 @@ socket_manager::~socket_manager() {
 }
 
 socket_manager::socket_manager(socket_manager&& other) noexcept
-  : handle_(other.handle_), mpx_(other.mpx_), mask_(other.mask_) {
+  : handle_(other.handle_),
+    mpx_(other.mpx_),
+    mask_(other.mask_),
+    edge_triggered_(other.edge_triggered_) {
   LOG_TRACE();
   other.handle_ = invalid_socket;
 }
@@ -41,6 +44,7 @@ socket_manager& socket_manager::operator=(socket_manager&& other) noexcept {
   other.handle_ = invalid_socket;
   mask_ = other.mask_;
   mpx_ = other.mpx_;
+  edge_triggered_ = other.edge_triggered_;
   return *this;
 }
 
@@ -62,30 +66,56 @@ bool socket_manager::mask_del(operation flag) noexcept {
   return true;
 }
 
+bool socket_manager::mark_dirty(operation registered) noexcept {
+  if (dirty_)
+    return false;
+  dirty_ = true;
+  registered_mask_ = registered;
+  return true;
+}
+
+operation socket_manager::clear_dirty() noexcept {
+  dirty_ = false;
+  return registered_mask_;
+}
+
 void socket_manager::register_reading() {
   LOG_TRACE();
-  if ((mask() & operation::read) == operation::read)
+  // The mask is only stable on the multiplexer thread, other threads always
+  // forward the request, which the multiplexer drops if it is redundant
+  if (mpx_->is_multiplexer_thread()
+      && ((mask() & operation::read) == operation::read))
     return;
   mpx_->enable(this, operation::read);
 }
 
 void socket_manager::register_writing() {
   LOG_TRACE();
-  if ((mask() & operation::write) == operation::write)
+  // The mask is only stable on the multiplexer thread, other threads always
+  // forward the request, which the multiplexer drops if it is redundant
+  if (mpx_->is_multiplexer_thread()
+      && ((mask() & operation::write) == operation::write))
     return;
   mpx_->enable(this, operation::write);
 }
 
 uint64_t socket_manager::set_timeout_in(std::chrono::milliseconds duration) {
-  auto tp = std::chrono::system_clock::now() + duration;
-  return mpx_->set_timeout(this, tp);
+  // The loop time is only updated and read by the multiplexer thread
+  const auto now = mpx_->is_multiplexer_thread()
+                     ? mpx_->now()
+                     : multiplexer::clock_type::now();
+  return mpx_->set_timeout(this, now + duration);
 }
 
 uint64_t
-socket_manager::set_timeout_at(std::chrono::system_clock::time_point point) {
+socket_manager::set_timeout_at(std::chrono::steady_clock::time_point point) {
   return mpx_->set_timeout(this, point);
 }
 
+bool socket_manager::cancel_timeout(uint64_t timeout_id) {
+  return mpx_->cancel_timeout(timeout_id);
+}
+
 void socket_manager::handle_error(const util::error& err) {
   mpx_->handle_error(err);
 }
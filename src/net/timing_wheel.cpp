@@ -0,0 +1,296 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      timing_wheel.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/timing_wheel.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+namespace {
+
+constexpr std::int64_t slot_mask = net::timing_wheel::num_slots - 1;
+
+constexpr std::size_t shift_of(std::size_t level) {
+  return level * net::timing_wheel::slot_bits;
+}
+
+constexpr std::uint32_t slot_list(std::size_t level, std::size_t slot) {
+  return static_cast<std::uint32_t>(level * net::timing_wheel::num_slots
+                                    + slot);
+}
+
+} // namespace
+
+namespace net {
+
+timing_wheel::timing_wheel(std::chrono::nanoseconds resolution)
+  : resolution_{std::max(resolution, std::chrono::nanoseconds{1})},
+    tick_{to_tick(clock_type::now())},
+    nodes_(num_lists) {
+  for (index_type i = 0; i < num_lists; ++i)
+    nodes_[i] = node{i, i, i, invalid_socket_id, 0, 0};
+}
+
+// -- timeout management -------------------------------------------------------
+
+std::uint64_t timing_wheel::add(socket_id handle, time_point when) {
+  const auto idx = allocate();
+  const auto id = (std::uint64_t{nodes_[idx].generation} << 32) | idx;
+  insert(idx, handle, when, id);
+  return id;
+}
+
+void timing_wheel::add(socket_id handle, time_point when, std::uint64_t id) {
+  const auto idx = allocate();
+  reserved_.emplace(id, idx);
+  insert(idx, handle, when, id);
+}
+
+bool timing_wheel::cancel(std::uint64_t id) {
+  const auto idx = find(id);
+  if (idx == no_node)
+    return false;
+  unlink_handle(idx);
+  release(idx);
+  return true;
+}
+
+std::size_t timing_wheel::cancel_all(socket_id handle) {
+  const auto key = static_cast<std::size_t>(handle);
+  if (key >= handles_.size())
+    return 0;
+  auto idx = std::exchange(handles_[key], no_node);
+  std::size_t result = 0;
+  while (idx != no_node) {
+    const auto next = nodes_[idx].handle_next;
+    release(idx);
+    idx = next;
+    ++result;
+  }
+  return result;
+}
+
+void timing_wheel::advance(time_point now) {
+  const auto now_tick = to_tick(now);
+  while (tick_ <= now_tick) {
+    if ((tick_ & slot_mask) == 0)
+      cascade(1);
+    expire(slot_list(0, static_cast<std::size_t>(tick_ & slot_mask)));
+    ++tick_;
+    // Skip all ticks without expiring or cascading timeouts
+    const auto next = next_tick();
+    tick_ = (next && (*next <= now_tick)) ? std::max(*next, tick_)
+                                          : std::max(now_tick + 1, tick_);
+  }
+}
+
+std::optional<timing_wheel::timeout> timing_wheel::pop() {
+  const auto idx = nodes_[due_list].next;
+  if (idx == due_list)
+    return std::nullopt;
+  const auto& n = nodes_[idx];
+  timeout result{n.handle, n.id};
+  unlink_handle(idx);
+  release(idx);
+  return result;
+}
+
+// -- properties ---------------------------------------------------------------
+
+std::optional<timing_wheel::time_point> timing_wheel::next_expiry() const {
+  if (const auto idx = nodes_[due_list].next; idx != due_list)
+    return to_time_point(nodes_[idx].tick);
+  if (auto next = next_tick())
+    return to_time_point(*next);
+  return std::nullopt;
+}
+
+// -- private member functions -------------------------------------------------
+
+std::int64_t timing_wheel::to_tick(time_point tp) const noexcept {
+  using std::chrono::duration_cast;
+  using std::chrono::nanoseconds;
+  return duration_cast<nanoseconds>(tp.time_since_epoch()).count()
+         / resolution_.count();
+}
+
+timing_wheel::time_point
+timing_wheel::to_time_point(std::int64_t tick) const noexcept {
+  return time_point{
+    std::chrono::duration_cast<clock_type::duration>(resolution_ * tick)};
+}
+
+std::optional<std::int64_t> timing_wheel::next_tick() const noexcept {
+  if (num_scheduled_ == 0)
+    return std::nullopt;
+  std::optional<std::int64_t> result;
+  for (std::size_t level = 0; level < num_levels; ++level) {
+    const auto shift = shift_of(level);
+    auto block = tick_ >> shift;
+    // Slots of the current block are only cascaded once the wheel processes
+    // its first tick
+    if ((level > 0) && ((tick_ & ((std::int64_t{1} << shift) - 1)) != 0))
+      ++block;
+    const auto slot = static_cast<std::size_t>(block & slot_mask);
+    std::int64_t next_block = 0;
+    if (auto occupied = find_occupied(level, slot))
+      next_block = block + static_cast<std::int64_t>(*occupied - slot);
+    else if (auto wrapped = find_occupied(level, 0))
+      next_block = block + static_cast<std::int64_t>(num_slots - slot)
+                   + static_cast<std::int64_t>(*wrapped);
+    else
+      continue;
+    const auto tick = next_block << shift;
+    if (!result || tick < *result)
+      result = tick;
+  }
+  return result;
+}
+
+timing_wheel::index_type timing_wheel::allocate() {
+  if (free_.empty()) {
+    nodes_.emplace_back();
+    return static_cast<index_type>(nodes_.size() - 1);
+  }
+  const auto idx = free_.back();
+  free_.pop_back();
+  return idx;
+}
+
+void timing_wheel::insert(index_type idx, socket_id handle, time_point when,
+                          std::uint64_t id) {
+  const auto key = static_cast<std::size_t>(handle);
+  if (key >= handles_.size())
+    handles_.resize(key + 1, no_node);
+  auto& n = nodes_[idx];
+  n.handle = handle;
+  n.id = id;
+  n.tick = to_tick(when);
+  n.handle_prev = no_node;
+  n.handle_next = handles_[key];
+  if (n.handle_next != no_node)
+    nodes_[n.handle_next].handle_prev = idx;
+  handles_[key] = idx;
+  schedule(idx);
+}
+
+timing_wheel::index_type timing_wheel::find(std::uint64_t id) const {
+  if ((id & reserved_id) != 0) {
+    const auto it = reserved_.find(id);
+    return (it != reserved_.end()) ? it->second : no_node;
+  }
+  // Freed nodes have an invalid id and reused ones a new generation
+  const auto idx = static_cast<index_type>(id & no_node);
+  if ((idx < num_lists) || (idx >= nodes_.size()) || (nodes_[idx].id != id))
+    return no_node;
+  return idx;
+}
+
+void timing_wheel::schedule(index_type idx) noexcept {
+  // Expired timeouts are handled with the next tick
+  const auto tick = std::max(nodes_[idx].tick, tick_);
+  const auto delta = static_cast<std::uint64_t>(tick - tick_);
+  std::size_t level = 0;
+  while ((level < num_levels - 1) && (delta >> shift_of(level + 1)) != 0)
+    ++level;
+  // Timeouts beyond the range of the wheel wait in the last slot of the top
+  // level and are re-scheduled once it is cascaded
+  auto slot_tick = tick;
+  if ((delta >> shift_of(num_levels)) != 0)
+    slot_tick = tick_ + (std::int64_t{1} << shift_of(num_levels)) - 1;
+  const auto slot = static_cast<std::size_t>((slot_tick >> shift_of(level))
+                                             & slot_mask);
+  link(slot_list(level, slot), idx);
+}
+
+void timing_wheel::cascade(std::size_t level) noexcept {
+  const auto slot = static_cast<std::size_t>((tick_ >> shift_of(level))
+                                             & slot_mask);
+  if ((slot == 0) && (level + 1 < num_levels))
+    cascade(level + 1);
+  // Nodes never return to the slot they are cascaded from
+  const auto list = slot_list(level, slot);
+  while (nodes_[list].next != list) {
+    const auto idx = nodes_[list].next;
+    unlink(idx);
+    schedule(idx);
+  }
+}
+
+void timing_wheel::link(index_type list, index_type idx) noexcept {
+  auto& sentinel = nodes_[list];
+  auto& n = nodes_[idx];
+  n.list = list;
+  n.prev = sentinel.prev;
+  n.next = list;
+  nodes_[sentinel.prev].next = idx;
+  sentinel.prev = idx;
+  if (list != due_list) {
+    ++num_scheduled_;
+    occupied_[list / num_slots][(list % num_slots) / 64]
+      |= std::uint64_t{1} << (list % 64);
+  }
+}
+
+void timing_wheel::unlink(index_type idx) noexcept {
+  auto& n = nodes_[idx];
+  nodes_[n.prev].next = n.next;
+  nodes_[n.next].prev = n.prev;
+  const auto list = n.list;
+  if (list != due_list) {
+    --num_scheduled_;
+    if (nodes_[list].next == list)
+      occupied_[list / num_slots][(list % num_slots) / 64]
+        &= ~(std::uint64_t{1} << (list % 64));
+  }
+}
+
+void timing_wheel::unlink_handle(index_type idx) noexcept {
+  const auto& n = nodes_[idx];
+  if (n.handle_prev != no_node)
+    nodes_[n.handle_prev].handle_next = n.handle_next;
+  else
+    handles_[static_cast<std::size_t>(n.handle)] = n.handle_next;
+  if (n.handle_next != no_node)
+    nodes_[n.handle_next].handle_prev = n.handle_prev;
+}
+
+void timing_wheel::release(index_type idx) {
+  unlink(idx);
+  auto& n = nodes_[idx];
+  if ((n.id & reserved_id) != 0)
+    reserved_.erase(n.id);
+  n.id = invalid_id;
+  n.generation = (n.generation + 1) & generation_mask;
+  free_.push_back(idx);
+}
+
+void timing_wheel::expire(index_type list) noexcept {
+  while (nodes_[list].next != list) {
+    const auto idx = nodes_[list].next;
+    unlink(idx);
+    link(due_list, idx);
+  }
+}
+
+std::optional<std::size_t>
+timing_wheel::find_occupied(std::size_t level,
+                            std::size_t from) const noexcept {
+  const auto& bits = occupied_[level];
+  for (auto word = from / 64; word < bits.size(); ++word) {
+    auto mask = bits[word];
+    if (word == from / 64)
+      mask &= ~std::uint64_t{0} << (from % 64);
+    if (mask != 0)
+      return word * 64 + static_cast<std::size_t>(std::countr_zero(mask));
+  }
+  return std::nullopt;
+}
+
+} // namespace net
@@ -0,0 +1,701 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      uring_multiplexer.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/uring_multiplexer.hpp"
+
+#include "net/acceptor.hpp"
+#include "net/event_result.hpp"
+#include "net/offload_pool.hpp"
+#include "net/operation.hpp"
+#include "net/pollset_updater.hpp"
+#include "net/socket/tcp_accept_socket.hpp"
+#include "net/socket_manager.hpp"
+#include "net/uring_transport.hpp"
+
+#include "util/byte_span.hpp"
+#include "util/config.hpp"
+#include "util/cpu_affinity.hpp"
+#include "util/error.hpp"
+#include "util/error_or.hpp"
+#include "util/format.hpp"
+#include "util/intrusive_ptr.hpp"
+#include "util/logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include <poll.h>
+#include <sys/socket.h>
+
+namespace {
+
+/// Distinguishes the requests submitted to the ring.
+enum class request_kind : std::uint8_t {
+  ignored = 0,
+  poll,
+  recv,
+  send,
+};
+
+/// Encodes kind, fd, and generation of a request into its user_data.
+constexpr std::uint64_t to_user_data(request_kind kind, net::socket_id fd,
+                                     std::uint32_t gen) {
+  return (static_cast<std::uint64_t>(kind) << 56)
+         | ((static_cast<std::uint64_t>(fd) & 0xFFFFFF) << 32) | gen;
+}
+
+constexpr request_kind kind_of(std::uint64_t user_data) {
+  return static_cast<request_kind>(user_data >> 56);
+}
+
+constexpr net::socket_id fd_of(std::uint64_t user_data) {
+  return static_cast<net::socket_id>((user_data >> 32) & 0xFFFFFF);
+}
+
+constexpr std::uint32_t generation_of(std::uint64_t user_data) {
+  return static_cast<std::uint32_t>(user_data);
+}
+
+constexpr std::uint32_t to_poll_mask(net::operation op) {
+  std::uint32_t mask = 0;
+  if ((op & net::operation::read) == net::operation::read)
+    mask |= POLLIN;
+  if ((op & net::operation::write) == net::operation::write)
+    mask |= POLLOUT;
+  return mask;
+}
+
+} // namespace
+
+namespace net {
+
+uring_multiplexer::~uring_multiplexer() {
+  // Workers must not post jobs to a destroyed multiplexer
+  if (offload_pool_)
+    offload_pool_->detach(this);
+}
+
+util::error uring_multiplexer::init(socket_manager_factory_ptr factory,
+                                    const util::config& cfg) {
+  LOG_TRACE();
+  set_thread_id(std::this_thread::get_id());
+  cfg_ = std::addressof(cfg);
+  LOG_DEBUG("initializing io_uring multiplexer");
+  const auto ring_size = cfg_->get_or<std::int64_t>(
+    "multiplexer.uring-entries", default_ring_size);
+  if (auto err = ring_.init(static_cast<unsigned>(ring_size)))
+    return err;
+  if (!(ring_.features() & IORING_FEAT_EXT_ARG))
+    return {util::error_code::runtime_error,
+            "[uring_multiplexer]: kernel does not support timed waits"};
+  if (cfg_->get_or("multiplexer.high-resolution-timers", false))
+    timeouts_ = timing_wheel{timing_wheel::high_resolution};
+  const auto max_cached_buffers = cfg_->get_or<std::int64_t>(
+    "multiplexer.max-cached-buffers",
+    static_cast<std::int64_t>(buffer_pool::default_max_cached));
+  buffer_pool_ = buffer_pool{static_cast<std::size_t>(max_cached_buffers)};
+  const auto max_cached_managers = cfg_->get_or<std::int64_t>(
+    "multiplexer.max-cached-managers",
+    static_cast<std::int64_t>(manager_pool::default_max_cached));
+  manager_pool_.max_cached(static_cast<std::size_t>(max_cached_managers));
+  const auto offload_threads = cfg_->get_or<std::int64_t>(
+    "multiplexer.offload-threads", 0);
+  if (offload_threads > 0)
+    offload_pool_ = std::make_shared<offload_pool>(
+      static_cast<std::size_t>(offload_threads));
+  // Create pollset updater
+  auto updater_res = make_pollset_updater(
+    this, static_cast<std::size_t>(cfg_->get_or<std::int64_t>(
+            "multiplexer.command-queue-size",
+            static_cast<std::int64_t>(pollset_updater::default_queue_size))));
+  if (auto err = util::get_error(updater_res))
+    return *err;
+  updater_ = std::get<pollset_updater_ptr>(updater_res);
+  add(updater_, operation::read);
+  // Create Acceptor
+  auto res = net::make_tcp_accept_socket(ip::v4_endpoint(
+    (cfg_->get_or("multiplexer.local", true) ? ip::v4_address::localhost
+                                             : ip::v4_address::any),
+    cfg_->get_or<std::int64_t>("multiplexer.port", 0)),
+    static_cast<int>(
+      cfg_->get_or<std::int64_t>("multiplexer.backlog", SOMAXCONN)),
+    cfg_->get_or("multiplexer.reuseport", false));
+  if (auto err = util::get_error(res))
+    return *err;
+  auto accept_socket_pair = std::get<net::acceptor_pair>(res);
+  auto accept_socket = accept_socket_pair.first;
+  port_ = accept_socket_pair.second;
+  if (cfg_->get_or("multiplexer.cpu-steering", false)) {
+    const auto group_size = cfg_->get_or<std::int64_t>(
+      "multiplexer.num-threads", 1);
+    if (auto err = steer_by_cpu(accept_socket,
+                                static_cast<std::uint32_t>(group_size)))
+      return err;
+  }
+  add(util::make_intrusive<acceptor>(accept_socket, this, std::move(factory)),
+      operation::read);
+  set_thread_id();
+  return util::none;
+}
+
+void uring_multiplexer::start() {
+  LOG_TRACE();
+  if (!running_) {
+    running_ = true;
+    mpx_thread_ = std::thread(&uring_multiplexer::run, this);
+    const auto cpu = cfg_->get_or<std::int64_t>("multiplexer.cpu-affinity", -1);
+    if (cpu >= 0) {
+      if (auto err = util::pin_to_cpu(mpx_thread_,
+                                      static_cast<unsigned>(cpu))) {
+        LOG_ERROR(err);
+      }
+    }
+  }
+}
+
+void uring_multiplexer::shutdown() {
+  LOG_TRACE();
+  if (is_multiplexer_thread()) {
+    LOG_DEBUG("multiplexer shutting down");
+    auto it = managers_.begin();
+    while (it != managers_.end()) {
+      auto* mgr = it->second.mgr.get();
+      if (mgr != updater_.get()) {
+        disable(mgr, operation::read, false);
+        if (mgr->mask() == operation::none)
+          it = del(it);
+        else
+          ++it;
+      } else {
+        ++it;
+      }
+    }
+    shutting_down_ = true;
+    // Removes the pollset_updater once it handled all pending commands
+    updater_->request_shutdown();
+  } else if (!shutting_down_) {
+    LOG_DEBUG("requesting multiplexer shutdown");
+    updater_->request_shutdown();
+  }
+}
+
+void uring_multiplexer::join() {
+  LOG_TRACE();
+  if (mpx_thread_.joinable()) {
+    LOG_DEBUG("joining on multiplexer thread");
+    mpx_thread_.join();
+  }
+}
+
+bool uring_multiplexer::running() const {
+  return mpx_thread_.joinable();
+}
+
+void uring_multiplexer::set_thread_id(std::thread::id tid) noexcept {
+  mpx_thread_id_.store(tid, std::memory_order_relaxed);
+  manager_pool_.owner(tid);
+}
+
+void uring_multiplexer::run() {
+  LOG_TRACE();
+  // The multiplexer thread sets its own id before polling, other threads
+  // keep using the command queue until then
+  set_thread_id(std::this_thread::get_id());
+  while (running_) {
+    if (poll_once(true))
+      running_ = false;
+  }
+}
+
+// -- Error handling -----------------------------------------------------------
+
+void uring_multiplexer::handle_error([[maybe_unused]] const util::error& err) {
+  LOG_ERROR(err);
+  shutdown();
+}
+
+// -- Interface functions ------------------------------------------------------
+
+void uring_multiplexer::add(socket_manager_ptr mgr, operation initial) {
+  LOG_TRACE();
+  if (is_multiplexer_thread()) {
+    LOG_DEBUG("Adding socket_manager with ", NET_ARG2("id", mgr->handle().id),
+              " for ", NET_ARG(initial));
+    mgr->mask_set(initial);
+    const auto handle = mgr->handle();
+    managers_.emplace(handle.id, poll_entry{mgr});
+    mark_dirty(handle);
+    // TODO: This should probably return an error instead of calling
+    // handle_error
+    if (auto err = mgr->init(*cfg_))
+      handle_error(err);
+  } else {
+    LOG_DEBUG("Requesting to add socket_manager with ",
+              NET_ARG2("id", mgr->handle().id), " for ", NET_ARG(initial));
+    mgr->ref();
+    updater_->push({pollset_updater::add_code, mgr.get(), initial});
+  }
+}
+
+void uring_multiplexer::enable(socket_manager* mgr, operation op) {
+  if (!is_multiplexer_thread()) {
+    mgr->ref();
+    updater_->push({pollset_updater::enable_code, mgr, op});
+    return;
+  }
+  if (!is_registered(mgr) || !mgr->mask_add(op))
+    return;
+  mark_dirty(mgr->handle());
+}
+
+void uring_multiplexer::disable(socket_manager* mgr, operation op,
+                                bool remove) {
+  if (!is_multiplexer_thread()) {
+    mgr->ref();
+    updater_->push({pollset_updater::disable_code, mgr, op, remove});
+    return;
+  }
+  if (!is_registered(mgr) || !mgr->mask_del(op))
+    return;
+  if (remove && mgr->mask() == operation::none)
+    del(mgr->handle());
+  else
+    mark_dirty(mgr->handle());
+}
+
+void uring_multiplexer::del(socket handle) {
+  if (auto it = managers_.find(handle.id); it != managers_.end())
+    del(it);
+}
+
+uring_multiplexer::manager_map::iterator
+uring_multiplexer::del(manager_map::iterator it) {
+  LOG_DEBUG("Deleting mgr with ", NET_ARG2("id", it->first));
+  auto& entry = it->second;
+  cancel_poll(it->first, entry);
+  // The handle may be reused by the next manager
+  timeouts_.cancel_all(it->first);
+  if (entry.completion_based && (entry.in_flight > 0)) {
+    // The kernel may still access the buffers of the manager, which therefore
+    // has to stay alive until all of its requests completed
+    cancel_io(it->first);
+    retired_.emplace(entry.generation, std::move(entry));
+  }
+  auto new_it = managers_.erase(it);
+  if (shutting_down_ && managers_.empty())
+    running_ = false;
+  return new_it;
+}
+
+// -- Offloading ---------------------------------------------------------------
+
+void uring_multiplexer::post(offload_job_ptr job) {
+  LOG_TRACE();
+  if (is_multiplexer_thread()) {
+    job->complete();
+    return;
+  }
+  updater_->push({pollset_updater::complete_code, nullptr, operation::none,
+                  false, 0, {}, job.release()});
+}
+
+// -- Timeout management -------------------------------------------------------
+
+uint64_t uring_multiplexer::set_timeout(socket_manager* mgr, time_point when) {
+  LOG_TRACE();
+  if (!is_multiplexer_thread()) {
+    // The multiplexer adds the timeout under the id reserved by this thread
+    const auto id = timing_wheel::reserved_id | next_timeout_id_++;
+    mgr->ref();
+    updater_->push({pollset_updater::set_timeout_code, mgr,
+                    operation::none, false, id, when});
+    return id;
+  }
+  if (!is_registered(mgr))
+    return timing_wheel::invalid_id;
+  const auto id = timeouts_.add(mgr->handle().id, when);
+  LOG_DEBUG("Set timeout ", id, " on ", NET_ARG2("mgr", mgr->handle().id));
+  return id;
+}
+
+void uring_multiplexer::add_timeout(socket_manager* mgr, time_point when,
+                                    uint64_t timeout_id) {
+  LOG_TRACE();
+  if (!is_registered(mgr))
+    return;
+  timeouts_.add(mgr->handle().id, when, timeout_id);
+  LOG_DEBUG("Set timeout ", timeout_id, " on ",
+            NET_ARG2("mgr", mgr->handle().id));
+}
+
+bool uring_multiplexer::cancel_timeout(uint64_t timeout_id) {
+  LOG_TRACE();
+  LOG_DEBUG("Cancelling timeout ", timeout_id);
+  if (is_multiplexer_thread())
+    return timeouts_.cancel(timeout_id);
+  updater_->push({pollset_updater::cancel_timeout_code, nullptr,
+                  operation::none, false, timeout_id});
+  return true;
+}
+
+void uring_multiplexer::handle_timeouts() {
+  LOG_TRACE();
+  timeouts_.advance(now_);
+  // Handlers may add or cancel timeouts while the batch is dispatched
+  while (auto timeout = timeouts_.pop()) {
+    if (auto it = managers_.find(timeout->handle); it != managers_.end())
+      it->second.mgr->handle_timeout(timeout->id);
+  }
+}
+
+// -- Pollset management -------------------------------------------------------
+
+void uring_multiplexer::mark_dirty(socket handle) {
+  auto it = managers_.find(handle.id);
+  if ((it == managers_.end()) || it->second.dirty)
+    return;
+  it->second.dirty = true;
+  dirty_.push_back(handle.id);
+}
+
+void uring_multiplexer::arm_dirty_entries() {
+  // Arming completion based entries calls into their managers, which may mark
+  // further entries as dirty
+  while (!dirty_.empty()) {
+    const auto dirty = std::exchange(dirty_, {});
+    for (const auto fd : dirty) {
+      auto it = managers_.find(fd);
+      if (it == managers_.end())
+        continue;
+      auto& entry = it->second;
+      entry.dirty = false;
+      if (entry.completion_based) {
+        arm_completions(fd, entry);
+        continue;
+      }
+      const auto wanted = entry.mgr->mask();
+      if (wanted == entry.armed)
+        continue;
+      cancel_poll(fd, entry);
+      if (wanted == operation::none)
+        continue;
+      auto sqe = ring_.next_sqe();
+      if (sqe == nullptr) {
+        handle_error({util::error_code::runtime_error,
+                      "[uring_multiplexer]: submission queue exhausted"});
+        return;
+      }
+      entry.generation = ++current_generation_;
+      entry.armed = wanted;
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->fd = fd;
+      sqe->poll32_events = to_poll_mask(wanted);
+      sqe->user_data = to_user_data(request_kind::poll, fd, entry.generation);
+    }
+  }
+}
+
+void uring_multiplexer::cancel_poll(socket_id fd, poll_entry& entry) {
+  if (entry.armed == operation::none)
+    return;
+  if (auto sqe = ring_.next_sqe()) {
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->addr = to_user_data(request_kind::poll, fd, entry.generation);
+    // The completion of the removal itself is of no interest
+    sqe->user_data = to_user_data(request_kind::ignored, fd, 0);
+  }
+  entry.armed = operation::none;
+}
+
+// -- Completion interface -----------------------------------------------------
+
+util::error uring_multiplexer::register_completions(uring_transport& mgr) {
+  LOG_TRACE();
+  auto it = managers_.find(mgr.handle().id);
+  if (it == managers_.end())
+    return {util::error_code::invalid_argument,
+            "[uring_multiplexer]: socket_manager is not registered"};
+  if (!buffers_.initialized()) {
+    const auto count = cfg_->get_or<std::int64_t>(
+      "multiplexer.uring-buffer-count", default_buffer_count);
+    const auto size = cfg_->get_or<std::int64_t>(
+      "multiplexer.uring-buffer-size", default_buffer_size);
+    if (auto err = buffers_.init(ring_, buffer_group_id,
+                                 static_cast<std::uint16_t>(count),
+                                 static_cast<std::uint32_t>(size)))
+      return err;
+  }
+  auto& entry = it->second;
+  cancel_poll(it->first, entry);
+  entry.completion_based = true;
+  entry.generation = ++current_generation_;
+  mark_dirty(mgr.handle());
+  return util::none;
+}
+
+std::size_t uring_multiplexer::submit_send(uring_transport& mgr,
+                                           util::const_byte_span data) {
+  auto it = managers_.find(mgr.handle().id);
+  if ((it == managers_.end()) || !it->second.completion_based)
+    return 0;
+  auto& entry = it->second;
+  std::size_t num_sends = 0;
+  while (!data.empty()) {
+    auto sqe = ring_.next_sqe();
+    if (sqe == nullptr) {
+      LOG_ERROR("submission queue exhausted while sending on socket = ",
+                it->first);
+      break;
+    }
+    const auto size = std::min(data.size(), max_send_size);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = it->first;
+    sqe->addr = reinterpret_cast<std::uint64_t>(data.data());
+    sqe->len = static_cast<std::uint32_t>(size);
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = to_user_data(request_kind::send, it->first,
+                                  entry.generation);
+    data = data.subspan(size);
+    // Linking keeps the chunks in order, a short send cancels the rest
+    if (!data.empty())
+      sqe->flags = IOSQE_IO_LINK;
+    ++num_sends;
+  }
+  entry.in_flight += num_sends;
+  return num_sends;
+}
+
+void uring_multiplexer::arm_completions(socket_id fd, poll_entry& entry) {
+  auto mgr = entry.mgr;
+  auto wants = [&mgr](operation op) { return (mgr->mask() & op) == op; };
+  if (!entry.receiving && wants(operation::read)) {
+    auto sqe = ring_.next_sqe();
+    if (sqe == nullptr) {
+      handle_error({util::error_code::runtime_error,
+                    "[uring_multiplexer]: submission queue exhausted"});
+      return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffers_.group_id();
+    sqe->user_data = to_user_data(request_kind::recv, fd, entry.generation);
+    entry.receiving = true;
+    ++entry.in_flight;
+  } else if (entry.receiving && !entry.recv_cancelled
+             && !wants(operation::read)) {
+    // The recv stays armed until its final completion, which re-arms it if
+    // the manager wants to read again by then
+    if (auto sqe = ring_.next_sqe()) {
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->addr = to_user_data(request_kind::recv, fd, entry.generation);
+      sqe->user_data = to_user_data(request_kind::ignored, fd, 0);
+      entry.recv_cancelled = true;
+    }
+  }
+  // Managers submit their sends themselves once asked to write
+  if (wants(operation::write)) {
+    switch (mgr->handle_write_event()) {
+      case event_result::done:
+        disable(mgr.get(), operation::write, true);
+        break;
+      case event_result::error:
+        del(mgr->handle());
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+void uring_multiplexer::cancel_io(socket_id fd) {
+  if (auto sqe = ring_.next_sqe()) {
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = to_user_data(request_kind::ignored, fd, 0);
+  }
+}
+
+// -- Event handling -----------------------------------------------------------
+
+util::error uring_multiplexer::poll_once(bool blocking) {
+  using namespace std::chrono;
+  arm_dirty_entries();
+  // Wait for at least one completion, or until the next timeout expires
+  __kernel_timespec ts{};
+  const __kernel_timespec* timeout = nullptr;
+  const auto next_timeout = timeouts_.next_expiry();
+  if (blocking && next_timeout) {
+    // The loop time is stale by the time it took to handle the last batch
+    const auto diff = duration_cast<nanoseconds>(*next_timeout
+                                                 - clock_type::now());
+    const auto ns = std::max(diff.count(), nanoseconds::rep{0});
+    ts.tv_sec = ns / 1'000'000'000;
+    ts.tv_nsec = ns % 1'000'000'000;
+    timeout = &ts;
+  }
+  const auto res = ring_.enter(blocking ? 1 : 0, timeout);
+  // Check for errors
+  if ((res < 0) && (res != -EINTR) && (res != -ETIME) && (res != -EBUSY)
+      && (res != -EAGAIN)) {
+    return {util::error_code::runtime_error, "io_uring_enter: {0}",
+            util::format("errno = {0}", -res)};
+  }
+  now_ = clock_type::now();
+  // Handle all timeouts and io-events that have been registered
+  handle_timeouts();
+  ring_.for_each_cqe([this](const io_uring_cqe& cqe) {
+    handle_completion(cqe);
+  });
+  return util::none;
+}
+
+void uring_multiplexer::handle_completion(const io_uring_cqe& cqe) {
+  switch (kind_of(cqe.user_data)) {
+    case request_kind::poll:
+      handle_poll_completion(cqe);
+      break;
+    case request_kind::recv:
+    case request_kind::send:
+      handle_io_completion(cqe);
+      break;
+    default:
+      break;
+  }
+}
+
+void uring_multiplexer::handle_poll_completion(const io_uring_cqe& cqe) {
+  const auto fd = fd_of(cqe.user_data);
+  auto it = managers_.find(fd);
+  // Drop completions of cancelled or outdated poll requests
+  if ((it == managers_.end())
+      || (it->second.generation != generation_of(cqe.user_data))
+      || (it->second.armed == operation::none)
+      || it->second.completion_based)
+    return;
+  it->second.armed = operation::none;
+  auto mgr = it->second.mgr;
+  mark_dirty(mgr->handle());
+  if (cqe.res < 0) {
+    LOG_ERROR("poll failed on socket = ", fd, ": ", -cqe.res);
+    del(mgr->handle());
+    return;
+  }
+  const auto revents = static_cast<std::uint32_t>(cqe.res);
+  if ((revents & (POLLERR | POLLHUP)) && !(revents & (POLLIN | POLLOUT))) {
+    LOG_ERROR("poll reported an error on socket = ", fd);
+    del(mgr->handle());
+    return;
+  }
+
+  auto handle_result = [&](event_result res, operation op) -> bool {
+    if (res == event_result::done) {
+      disable(mgr.get(), op, true);
+    } else if (res == event_result::error) {
+      del(mgr->handle());
+      return false;
+    }
+    return true;
+  };
+  auto wants = [&mgr](operation op) { return (mgr->mask() & op) == op; };
+
+  // Handle possible read event
+  if ((revents & POLLIN) && wants(operation::read)) {
+    if (!handle_result(mgr->handle_read_event(), operation::read))
+      return;
+  }
+  // Handle possible write event
+  if ((revents & POLLOUT) && wants(operation::write))
+    handle_result(mgr->handle_write_event(), operation::write);
+}
+
+void uring_multiplexer::handle_io_completion(const io_uring_cqe& cqe) {
+  const auto fd = fd_of(cqe.user_data);
+  const auto generation = generation_of(cqe.user_data);
+  const bool is_recv = kind_of(cqe.user_data) == request_kind::recv;
+  // Multishot recv requests complete multiple times until they are terminated
+  const bool is_final = !is_recv || !(cqe.flags & IORING_CQE_F_MORE);
+  std::optional<std::uint16_t> bid;
+  if (cqe.flags & IORING_CQE_F_BUFFER)
+    bid = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+  auto it = managers_.find(fd);
+  if ((it == managers_.end()) || (it->second.generation != generation)
+      || !it->second.completion_based) {
+    // Release retired managers once all of their requests completed
+    if (bid)
+      buffers_.recycle(*bid);
+    if (auto retired = retired_.find(generation);
+        is_final && (retired != retired_.end())
+        && (--retired->second.in_flight == 0))
+      retired_.erase(retired);
+    return;
+  }
+  auto& entry = it->second;
+  if (is_final)
+    --entry.in_flight;
+  auto mgr = entry.mgr;
+  auto& transport = static_cast<uring_transport&>(*mgr);
+  if (!is_recv) {
+    switch (transport.handle_send_completion(cqe.res)) {
+      case event_result::done:
+        disable(mgr.get(), operation::write, true);
+        break;
+      case event_result::error:
+        del(mgr->handle());
+        break;
+      default:
+        break;
+    }
+    return;
+  }
+  if (is_final) {
+    // Re-arm the recv before the next submission
+    entry.receiving = false;
+    entry.recv_cancelled = false;
+    mark_dirty(mgr->handle());
+  }
+  if (cqe.res > 0 && bid) {
+    const auto data = buffers_.buffer(*bid).first(
+      static_cast<std::size_t>(cqe.res));
+    const auto res = transport.handle_recv_completion(data);
+    buffers_.recycle(*bid);
+    if (res == event_result::error)
+      del(mgr->handle());
+    else if (res == event_result::done)
+      disable(mgr.get(), operation::read, true);
+    return;
+  }
+  if (bid)
+    buffers_.recycle(*bid);
+  if (cqe.res == 0) {
+    LOG_DEBUG("Socket = ", fd, " disconnected");
+    del(mgr->handle());
+  } else if (cqe.res == -ENOBUFS) {
+    LOG_DEBUG("Buffer ring exhausted while receiving on socket = ", fd);
+  } else if ((cqe.res < 0) && (cqe.res != -ECANCELED)) {
+    LOG_ERROR("recv failed on socket = ", fd, ": ", -cqe.res);
+    del(mgr->handle());
+  }
+}
+
+util::error_or<multiplexer_ptr>
+make_uring_multiplexer(socket_manager_factory_ptr factory,
+                       const util::config& cfg) {
+  LOG_TRACE();
+  auto mpx = std::make_shared<uring_multiplexer>();
+  if (auto err = mpx->init(std::move(factory), cfg))
+    return err;
+  return mpx;
+}
+
+} // namespace net
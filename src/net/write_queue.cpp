@@ -0,0 +1,134 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      write_queue.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/write_queue.hpp"
+
+#include "net/socket/stream_socket.hpp"
+
+#include "util/logger.hpp"
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <utility>
+
+#include <sys/uio.h>
+
+namespace {
+
+#if defined(IOV_MAX)
+constexpr std::size_t max_iov = std::min<std::size_t>(
+  net::write_queue::max_segments, IOV_MAX);
+#else
+constexpr std::size_t max_iov = net::write_queue::max_segments;
+#endif
+
+} // namespace
+
+namespace net {
+
+write_queue::~write_queue() {
+  clear();
+}
+
+// -- adding segments ----------------------------------------------------------
+
+void write_queue::push(util::byte_buffer buf) {
+  if (buf.empty())
+    return;
+  auto& seg = segments_.emplace_back();
+  seg.owned = std::move(buf);
+  seg.data = seg.owned;
+  size_ += seg.data.size();
+}
+
+void write_queue::push(util::intrusive_ptr<util::ref_counted> owner,
+                       util::const_byte_span bytes) {
+  if (bytes.empty())
+    return;
+  auto& seg = segments_.emplace_back();
+  seg.data = bytes;
+  seg.shared = std::move(owner);
+  size_ += bytes.size();
+}
+
+void write_queue::push(util::const_byte_span bytes,
+                       completion_handler on_done) {
+  if (bytes.empty()) {
+    if (on_done)
+      on_done();
+    return;
+  }
+  auto& seg = segments_.emplace_back();
+  seg.data = bytes;
+  seg.on_done = std::move(on_done);
+  size_ += bytes.size();
+}
+
+// -- writing ------------------------------------------------------------------
+
+ptrdiff_t write_queue::write(stream_socket x) {
+  LOG_TRACE();
+  std::array<iovec, max_iov> iov;
+  std::size_t num_iov = 0;
+  for (const auto& seg : segments_) {
+    if (num_iov == iov.size())
+      break;
+    iov[num_iov].iov_base = const_cast<std::byte*>(seg.data.data());
+    iov[num_iov].iov_len = seg.data.size();
+    ++num_iov;
+  }
+  const auto res = net::write(x, std::span<const iovec>{iov.data(), num_iov});
+  if (res > 0)
+    consume(static_cast<std::size_t>(res));
+  return res;
+}
+
+void write_queue::move_to(util::byte_buffer& buf) {
+  buf.reserve(buf.size() + size_);
+  for (const auto& seg : segments_)
+    buf.insert(buf.end(), seg.data.begin(), seg.data.end());
+  clear();
+}
+
+void write_queue::consume(std::size_t num_bytes) {
+  size_ -= num_bytes;
+  while (num_bytes > 0) {
+    auto& seg = segments_.front();
+    if (num_bytes < seg.data.size()) {
+      seg.data = seg.data.subspan(num_bytes);
+      return;
+    }
+    num_bytes -= seg.data.size();
+    pop();
+  }
+}
+
+void write_queue::clear() {
+  while (!segments_.empty())
+    pop();
+  size_ = 0;
+}
+
+util::byte_buffer write_queue::take_spare() noexcept {
+  return std::exchange(spare_, {});
+}
+
+void write_queue::pop() {
+  auto seg = std::move(segments_.front());
+  segments_.pop_front();
+  // Keeps the largest written buffer to avoid allocations when staging data
+  if (seg.owned.capacity() > spare_.capacity()) {
+    spare_ = std::move(seg.owned);
+    spare_.clear();
+  }
+  if (seg.on_done)
+    seg.on_done();
+}
+
+} // namespace net
@@ -14,7 +14,7 @@
 #include "util/logger.hpp"
 
 #include "net/event_result.hpp"
-#include "net/kqueue_multiplexer.hpp"
+#include "net/multiplexer_impl.hpp"
 #include "net/socket/stream_socket.hpp"
 #include "net/socket_manager.hpp"
 #include "net/socket_manager_factory.hpp"
@@ -65,7 +65,7 @@ struct manager_factory : public net::socket_manager_factory {
 
   net::socket_manager_ptr make(net::socket handle,
                                net::multiplexer* mpx) override {
-    return util::make_intrusive<dummy_socket_manager>(handle, mpx);
+    return net::make_pooled_manager<dummy_socket_manager>(handle, mpx);
   }
 };
 
@@ -80,7 +80,7 @@ int main(int, const char**) {
   // }
   LOG_INIT(cfg);
   auto factory = std::make_shared<manager_factory>();
-  auto res = net::make_kqueue_multiplexer(factory, cfg);
+  auto res = net::make_multiplexer(factory, cfg);
   if (auto err = util::get_error(res)) {
     LOG_ERROR("Failed to create multiplexer: ", *err);
     return EXIT_FAILURE;
@@ -0,0 +1,92 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      buffer_ring.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "uring/buffer_ring.hpp"
+
+#include "uring/ring.hpp"
+
+#include "util/error.hpp"
+#include "util/format.hpp"
+#include "util/logger.hpp"
+
+#include <atomic>
+#include <bit>
+
+#include <sys/mman.h>
+
+namespace uring {
+
+buffer_ring::~buffer_ring() {
+  if (owner_) {
+    io_uring_buf_reg reg{};
+    reg.bgid = group_id_;
+    owner_->register_resource(IORING_UNREGISTER_PBUF_RING, &reg, 1);
+  }
+  if (buffers_)
+    ::munmap(buffers_, buffers_size_);
+  if (bufs_)
+    ::munmap(bufs_, bufs_size_);
+}
+
+util::error buffer_ring::init(ring& r, std::uint16_t group_id,
+                              std::uint16_t count, std::uint32_t buffer_size) {
+  LOG_TRACE();
+  if (!std::has_single_bit(count) || (buffer_size == 0))
+    return {util::error_code::invalid_argument,
+            "buffer_ring needs a power of two buffers of nonzero size"};
+  group_id_ = group_id;
+  count_ = count;
+  mask_ = count - 1;
+  buffer_size_ = buffer_size;
+  // The ring itself has to be page aligned, which mmap guarantees
+  bufs_size_ = count_ * sizeof(io_uring_buf);
+  auto bufs = ::mmap(nullptr, bufs_size_, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (bufs == MAP_FAILED)
+    return {util::error_code::runtime_error,
+            "mmap of the buffer ring failed: {0}",
+            util::last_error_as_string()};
+  bufs_ = static_cast<io_uring_buf_ring*>(bufs);
+  buffers_size_ = std::size_t{count_} * buffer_size_;
+  auto buffers = ::mmap(nullptr, buffers_size_, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffers == MAP_FAILED)
+    return {util::error_code::runtime_error,
+            "mmap of the provided buffers failed: {0}",
+            util::last_error_as_string()};
+  buffers_ = static_cast<std::byte*>(buffers);
+  io_uring_buf_reg reg{};
+  reg.ring_addr = reinterpret_cast<std::uint64_t>(bufs_);
+  reg.ring_entries = count_;
+  reg.bgid = group_id_;
+  if (auto res = r.register_resource(IORING_REGISTER_PBUF_RING, &reg, 1);
+      res < 0)
+    return {util::error_code::runtime_error,
+            "registering the buffer ring failed: {0}",
+            util::format("errno = {0}", -res)};
+  owner_ = &r;
+  LOG_DEBUG("Registered buffer ring with ", NET_ARG2("bgid", group_id_), ", ",
+            NET_ARG2("count", count_), ", ", NET_ARG2("size", buffer_size_));
+  // Hand all buffers to the kernel
+  for (std::uint16_t bid = 0; bid < count_; ++bid)
+    recycle(bid);
+  return util::none;
+}
+
+void buffer_ring::recycle(std::uint16_t bid) noexcept {
+  // The flexible array of io_uring_buf_ring is misplaced when compiled as C++,
+  // since its empty placeholder struct occupies storage. The entries start at
+  // the beginning of the ring with the tail overlaying the first one.
+  auto& buf = reinterpret_cast<io_uring_buf*>(bufs_)[tail_ & mask_];
+  buf.addr = reinterpret_cast<std::uint64_t>(buffer(bid).data());
+  buf.len = buffer_size_;
+  buf.bid = bid;
+  std::atomic_ref{bufs_->tail}.store(++tail_, std::memory_order_release);
+}
+
+} // namespace uring
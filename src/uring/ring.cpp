@@ -0,0 +1,165 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      ring.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "uring/ring.hpp"
+
+#include "util/error.hpp"
+#include "util/logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+int io_uring_setup(unsigned entries, io_uring_params* params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags, const void* arg, std::size_t arg_size) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit,
+                                    min_complete, flags, arg, arg_size));
+}
+
+int io_uring_register(int fd, unsigned opcode, const void* arg,
+                      unsigned nr_args) {
+  return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg,
+                                    nr_args));
+}
+
+template <class T>
+T* offset_ptr(void* base, std::uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<std::byte*>(base) + offset);
+}
+
+} // namespace
+
+namespace uring {
+
+ring::~ring() {
+  if (sqes_)
+    ::munmap(sqes_, sqes_size_);
+  if (cq_ptr_ && (cq_ptr_ != sq_ptr_))
+    ::munmap(cq_ptr_, cq_size_);
+  if (sq_ptr_)
+    ::munmap(sq_ptr_, sq_size_);
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+util::error ring::init(unsigned entries) {
+  LOG_TRACE();
+  io_uring_params params{};
+  fd_ = io_uring_setup(entries, &params);
+  if (fd_ < 0)
+    return {util::error_code::runtime_error, "io_uring_setup failed: {0}",
+            util::last_error_as_string()};
+  features_ = params.features;
+  LOG_DEBUG("Created io_uring with ", NET_ARG2("fd", fd_), ", ",
+            NET_ARG2("sq_entries", params.sq_entries), ", ",
+            NET_ARG2("cq_entries", params.cq_entries));
+  // Map the submission and completion rings
+  sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (features_ & IORING_FEAT_SINGLE_MMAP)
+    sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+  sq_ptr_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  if (sq_ptr_ == MAP_FAILED) {
+    sq_ptr_ = nullptr;
+    return {util::error_code::runtime_error, "mmap of the SQ ring failed: {0}",
+            util::last_error_as_string()};
+  }
+  if (features_ & IORING_FEAT_SINGLE_MMAP) {
+    cq_ptr_ = sq_ptr_;
+  } else {
+    cq_ptr_ = ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_ptr_ == MAP_FAILED) {
+      cq_ptr_ = nullptr;
+      return {util::error_code::runtime_error,
+              "mmap of the CQ ring failed: {0}", util::last_error_as_string()};
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  auto sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+    return {util::error_code::runtime_error, "mmap of the SQEs failed: {0}",
+            util::last_error_as_string()};
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+  // Resolve the ring members
+  sq_head_ = offset_ptr<unsigned>(sq_ptr_, params.sq_off.head);
+  sq_tail_ = offset_ptr<unsigned>(sq_ptr_, params.sq_off.tail);
+  sq_mask_ = *offset_ptr<unsigned>(sq_ptr_, params.sq_off.ring_mask);
+  sq_array_ = offset_ptr<unsigned>(sq_ptr_, params.sq_off.array);
+  sq_entries_ = params.sq_entries;
+  cq_head_ = offset_ptr<unsigned>(cq_ptr_, params.cq_off.head);
+  cq_tail_ = offset_ptr<unsigned>(cq_ptr_, params.cq_off.tail);
+  cq_mask_ = *offset_ptr<unsigned>(cq_ptr_, params.cq_off.ring_mask);
+  cqes_ = offset_ptr<io_uring_cqe>(cq_ptr_, params.cq_off.cqes);
+  return util::none;
+}
+
+io_uring_sqe* ring::next_sqe() {
+  auto is_full = [this] {
+    const auto head = std::atomic_ref{*sq_head_}.load(
+      std::memory_order_acquire);
+    return (sqe_tail_ - head) >= sq_entries_;
+  };
+  // Hand everything to the kernel to make room for new entries
+  if (is_full() && ((enter(0) < 0) || is_full()))
+    return nullptr;
+  auto sqe = &sqes_[sqe_tail_ & sq_mask_];
+  std::memset(sqe, 0, sizeof(io_uring_sqe));
+  ++sqe_tail_;
+  return sqe;
+}
+
+unsigned ring::flush() {
+  auto tail = *sq_tail_;
+  for (; sqe_head_ != sqe_tail_; ++sqe_head_, ++tail)
+    sq_array_[tail & sq_mask_] = sqe_head_ & sq_mask_;
+  std::atomic_ref{*sq_tail_}.store(tail, std::memory_order_release);
+  // Also accounts for entries a previous enter did not manage to submit
+  return tail - std::atomic_ref{*sq_head_}.load(std::memory_order_acquire);
+}
+
+int ring::enter(unsigned min_complete, const __kernel_timespec* timeout) {
+  const auto to_submit = flush();
+  unsigned flags = (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0;
+  const void* arg = nullptr;
+  std::size_t arg_size = 0;
+  io_uring_getevents_arg ext_arg{};
+  if (timeout) {
+    ext_arg.sigmask_sz = _NSIG / 8;
+    ext_arg.ts = reinterpret_cast<std::uint64_t>(timeout);
+    flags |= IORING_ENTER_EXT_ARG;
+    arg = &ext_arg;
+    arg_size = sizeof(ext_arg);
+  }
+  if ((to_submit == 0) && (flags == 0))
+    return 0;
+  const auto res = io_uring_enter(fd_, to_submit, min_complete, flags, arg,
+                                  arg_size);
+  return (res < 0) ? -errno : res;
+}
+
+int ring::register_resource(unsigned opcode, const void* arg,
+                            unsigned nr_args) {
+  const auto res = io_uring_register(fd_, opcode, arg, nr_args);
+  return (res < 0) ? -errno : res;
+}
+
+} // namespace uring
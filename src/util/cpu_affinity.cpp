@@ -0,0 +1,48 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      cpu_affinity.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "util/cpu_affinity.hpp"
+
+#include "util/error.hpp"
+
+#include <cstring>
+
+#if defined(__linux__)
+#  include <pthread.h>
+#  include <sched.h>
+#endif
+
+namespace util {
+
+error pin_to_cpu([[maybe_unused]] std::thread& thread,
+                 [[maybe_unused]] unsigned cpu) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (auto res = pthread_setaffinity_np(thread.native_handle(), sizeof(set),
+                                        &set);
+      res != 0)
+    return {error_code::runtime_error, "pinning thread to cpu {0} failed: {1}",
+            cpu, std::strerror(res)};
+  return none;
+#else
+  return {error_code::runtime_error,
+          "pinning threads is not supported on this platform"};
+#endif
+}
+
+int current_cpu() noexcept {
+#if defined(__linux__)
+  return sched_getcpu();
+#else
+  return -1;
+#endif
+}
+
+} // namespace util
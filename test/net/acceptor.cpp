@@ -11,16 +11,22 @@
 #include "net/ip/v4_address.hpp"
 #include "net/ip/v4_endpoint.hpp"
 #include "net/multiplexer.hpp"
+#include "net/socket/stream_socket.hpp"
 #include "net/socket/tcp_accept_socket.hpp"
 #include "net/socket/tcp_stream_socket.hpp"
 #include "net/socket_manager_factory.hpp"
 
+#include "util/byte_array.hpp"
 #include "util/config.hpp"
 #include "util/error.hpp"
 #include "util/intrusive_ptr.hpp"
 
 #include "net_test.hpp"
 
+#include <vector>
+
+#include <sys/resource.h>
+
 using namespace net;
 using namespace net::ip;
 
@@ -51,23 +57,33 @@ struct dummy_multiplexer : public multiplexer {
 
   void add(socket_manager_ptr new_mgr, operation) override {
     mgr = std::move(new_mgr);
+    ++num_added;
   }
 
-  void enable(socket_manager_ptr, operation) override {
-    // nop
+  void enable(socket_manager* mgr, operation op) override {
+    mgr->mask_add(op);
   }
 
-  void disable(socket_manager_ptr, operation, bool) override {
-    // nop
+  void disable(socket_manager* mgr, operation op, bool) override {
+    mgr->mask_del(op);
   }
 
-  uint64_t set_timeout(socket_manager_ptr,
-                       std::chrono::system_clock::time_point) override {
-    return 0;
+  uint64_t set_timeout(socket_manager*, time_point) override {
+    return ++num_timeouts;
+  }
+
+  void add_timeout(socket_manager*, time_point, uint64_t) override {}
+
+  bool cancel_timeout(uint64_t) override { return false; }
+
+  void post(offload_job_ptr) override {
+    // nop
   }
 
   util::error last_error;
   socket_manager_ptr mgr = nullptr;
+  size_t num_added = 0;
+  uint64_t num_timeouts = 0;
 };
 
 struct dummy_socket_manager : public socket_manager {
@@ -108,6 +124,18 @@ struct acceptor_test : public testing::Test {
   uint16_t port;
 };
 
+std::vector<tcp_stream_socket> connect_clients(const v4_endpoint& ep,
+                                               size_t num_clients) {
+  std::vector<tcp_stream_socket> clients;
+  for (size_t i = 0; i < num_clients; ++i) {
+    auto res = make_connected_tcp_stream_socket(ep);
+    EXPECT_EQ(get_error(res), nullptr);
+    if (auto sock = std::get_if<tcp_stream_socket>(&res))
+      clients.emplace_back(*sock);
+  }
+  return clients;
+}
+
 } // namespace
 
 TEST_F(acceptor_test, handle_read_event) {
@@ -118,6 +146,84 @@ TEST_F(acceptor_test, handle_read_event) {
   EXPECT_NE(mpx.mgr, nullptr);
 }
 
+TEST_F(acceptor_test, drains_backlog) {
+  const v4_endpoint ep{v4_address::localhost, port};
+  auto clients = connect_clients(ep, 5);
+  ASSERT_EQ(acc->init(util::config{}), util::none);
+  EXPECT_EQ(acc->handle_read_event(), event_result::ok);
+  EXPECT_EQ(mpx.last_error, util::none);
+  EXPECT_EQ(mpx.num_added, 5);
+  // Accepted sockets are handed out in nonblocking mode
+  util::byte_array<1> buf;
+  EXPECT_LT(read(mpx.mgr->handle<stream_socket>(), buf), 0);
+  EXPECT_TRUE(last_socket_error_is_temporary());
+  for (auto client : clients)
+    close(client);
+}
+
+TEST_F(acceptor_test, accept_budget) {
+  const v4_endpoint ep{v4_address::localhost, port};
+  auto clients = connect_clients(ep, 5);
+  util::config cfg;
+  cfg.add_config_entry("multiplexer.accept-budget", std::int64_t{2});
+  ASSERT_EQ(acc->init(cfg), util::none);
+  EXPECT_EQ(acc->handle_read_event(), event_result::ok);
+  EXPECT_EQ(mpx.num_added, 2);
+  EXPECT_EQ(acc->handle_read_event(), event_result::ok);
+  EXPECT_EQ(mpx.num_added, 4);
+  EXPECT_EQ(acc->handle_read_event(), event_result::ok);
+  EXPECT_EQ(mpx.num_added, 5);
+  EXPECT_EQ(mpx.last_error, util::none);
+  for (auto client : clients)
+    close(client);
+}
+
+TEST_F(acceptor_test, out_of_descriptors) {
+  const v4_endpoint ep{v4_address::localhost, port};
+  auto clients = connect_clients(ep, 1);
+  mpx.enable(acc.get(), operation::read);
+  rlimit limit{};
+  ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &limit), 0);
+  const auto prev = limit.rlim_cur;
+  limit.rlim_cur = 0;
+  ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &limit), 0);
+  const auto res = acc->handle_read_event();
+  limit.rlim_cur = prev;
+  ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &limit), 0);
+  // Running out of descriptors is no error, the connection stays pending
+  EXPECT_EQ(res, event_result::ok);
+  EXPECT_EQ(mpx.last_error, util::none);
+  EXPECT_EQ(mpx.num_added, 0);
+  // Accepting pauses until the retry timeout expires
+  EXPECT_EQ(acc->mask(), operation::none);
+  EXPECT_EQ(mpx.num_timeouts, 1);
+  EXPECT_EQ(acc->handle_timeout(1), event_result::ok);
+  EXPECT_EQ(acc->mask(), operation::read);
+  EXPECT_EQ(mpx.last_error, util::none);
+  EXPECT_EQ(acc->handle_read_event(), event_result::ok);
+  EXPECT_EQ(mpx.num_added, 1);
+  for (auto client : clients)
+    close(client);
+}
+
+TEST_F(acceptor_test, accept_error) {
+  // Accepting on a socket that does not listen fails permanently
+  auto res = make_tcp_accept_socket({v4_address::localhost, 0});
+  ASSERT_EQ(get_error(res), nullptr);
+  auto sock = std::get<acceptor_pair>(res).first;
+  ASSERT_EQ(::shutdown(sock.id, SHUT_RDWR), 0);
+  acceptor other{sock, &mpx, std::make_shared<dummy_factory>()};
+  EXPECT_EQ(other.handle_read_event(), event_result::ok);
+  EXPECT_NE(mpx.last_error, util::none);
+  EXPECT_EQ(mpx.num_added, 0);
+}
+
+TEST_F(acceptor_test, invalid_accept_budget) {
+  util::config cfg;
+  cfg.add_config_entry("multiplexer.accept-budget", std::int64_t{0});
+  EXPECT_NE(acc->init(cfg), util::none);
+}
+
 TEST_F(acceptor_test, handle_write_event) {
   EXPECT_EQ(acc->handle_write_event(), event_result::error);
   EXPECT_EQ(mpx.last_error, util::error(util::error_code::runtime_error));
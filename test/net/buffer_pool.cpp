@@ -0,0 +1,60 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      buffer_pool.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/buffer_pool.hpp"
+
+#include "util/byte_buffer.hpp"
+
+#include "net_test.hpp"
+
+#include <utility>
+
+using namespace net;
+
+TEST(buffer_pool, acquire_rounds_up_to_size_class) {
+  buffer_pool pool;
+  EXPECT_EQ(pool.acquire(1).capacity(), 4096);
+  EXPECT_EQ(pool.acquire(4097).capacity(), 16384);
+  EXPECT_EQ(pool.acquire(65536).capacity(), 65536);
+  EXPECT_GE(pool.acquire(100000).capacity(), 100000);
+  EXPECT_EQ(pool.num_cached(), 0);
+}
+
+TEST(buffer_pool, released_buffers_are_reused) {
+  buffer_pool pool;
+  auto buf = pool.acquire(1024);
+  buf.resize(128);
+  const auto* storage = buf.data();
+  pool.release(std::move(buf));
+  EXPECT_EQ(pool.num_cached(), 1);
+  auto reused = pool.acquire(2048);
+  EXPECT_EQ(reused.data(), storage);
+  EXPECT_TRUE(reused.empty());
+  EXPECT_EQ(pool.num_cached(), 0);
+}
+
+TEST(buffer_pool, small_and_huge_buffers_are_freed) {
+  buffer_pool pool;
+  util::byte_buffer small;
+  small.reserve(1024);
+  pool.release(std::move(small));
+  util::byte_buffer huge;
+  huge.reserve(1 << 20);
+  pool.release(std::move(huge));
+  EXPECT_EQ(pool.num_cached(), 0);
+}
+
+TEST(buffer_pool, cache_is_limited) {
+  buffer_pool pool{2};
+  for (int i = 0; i < 4; ++i) {
+    util::byte_buffer buf;
+    buf.reserve(4096);
+    pool.release(std::move(buf));
+  }
+  EXPECT_EQ(pool.num_cached(), 2);
+}
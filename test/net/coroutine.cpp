@@ -0,0 +1,217 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      coroutine.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/coroutine.hpp"
+
+#include "net/multiplexer.hpp"
+#include "net/multiplexer_impl.hpp"
+#include "net/receive_policy.hpp"
+#include "net/socket/stream_socket.hpp"
+#include "net/socket_manager_factory.hpp"
+#include "net/stream_transport.hpp"
+
+#include "util/byte_array.hpp"
+#include "util/config.hpp"
+#include "util/error.hpp"
+#include "util/error_or.hpp"
+#include "util/intrusive_ptr.hpp"
+
+#include "net_test.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace net;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct dummy_multiplexer : public multiplexer {
+  util::error init(socket_manager_factory_ptr, const util::config&) override {
+    return util::none;
+  }
+
+  void start() override {
+    // nop
+  }
+
+  void shutdown() override {
+    // nop
+  }
+
+  void join() override {
+    // nop
+  }
+
+  bool running() const override { return false; }
+
+  void handle_error(const util::error& err) override {
+    FAIL() << "There should be no errors! " << err << std::endl;
+  }
+
+  util::error poll_once(bool) override { return util::none; }
+
+  void add(socket_manager_ptr, operation) override {
+    // nop
+  }
+
+  void enable(socket_manager*, operation op) override {
+    if ((op & operation::read) == operation::read)
+      ++num_read_enables;
+  }
+
+  void disable(socket_manager*, operation op, bool remove) override {
+    if ((op & operation::read) == operation::read)
+      ++num_read_disables;
+    EXPECT_FALSE(remove);
+  }
+
+  uint64_t set_timeout(socket_manager*, time_point) override {
+    return ++num_timeouts;
+  }
+
+  void add_timeout(socket_manager*, time_point, uint64_t) override {}
+
+  bool cancel_timeout(uint64_t) override { return false; }
+
+  void post(offload_job_ptr) override {
+    // nop
+  }
+
+  uint64_t num_timeouts = 0;
+  size_t num_read_enables = 0;
+  size_t num_read_disables = 0;
+};
+
+/// Echoes frames of four bytes, sleeping after each frame.
+struct echo {
+  task operator()(connection& conn) {
+    for (;;) {
+      auto frame = co_await conn.read(receive_policy::exactly(4));
+      frames.emplace_back(frame.size());
+      co_await conn.write(frame);
+      co_await conn.sleep_for(1ms);
+    }
+  }
+
+  std::vector<size_t> frames;
+};
+
+using manager_type = stream_transport<coroutine_layer<echo>>;
+
+static_assert(framing_layer<coroutine_layer<echo>>);
+
+struct echo_factory : public socket_manager_factory {
+  socket_manager_ptr make(net::socket handle, multiplexer* mpx) override {
+    return util::make_intrusive<manager_type>(
+      socket_cast<stream_socket>(handle), mpx);
+  }
+};
+
+struct coroutine_test : public testing::Test {
+  coroutine_test() {
+    auto res = make_stream_socket_pair();
+    EXPECT_EQ(util::get_error(res), nullptr);
+    sockets = std::get<stream_socket_pair>(res);
+    EXPECT_TRUE(nonblocking(sockets.first, true));
+    for (size_t i = 0; i < data.size(); ++i)
+      data[i] = static_cast<std::byte>(i);
+  }
+
+  ~coroutine_test() override {
+    close(sockets.first);
+    close(sockets.second);
+  }
+
+  dummy_multiplexer mpx;
+  stream_socket_pair sockets;
+  util::byte_array<12> data;
+};
+
+} // namespace
+
+TEST_F(coroutine_test, read_write_sleep) {
+  manager_type mgr(sockets.first, &mpx);
+  ASSERT_EQ(mgr.init(util::config{}), util::none);
+  auto& frames = mgr.next_layer().handler().frames;
+  EXPECT_EQ(mpx.num_read_enables, 1);
+  // Partial frames stay buffered at the transport
+  ASSERT_EQ(write(sockets.second, std::span{data}.first(2)), 2);
+  EXPECT_EQ(mgr.handle_read_event(), event_result::ok);
+  EXPECT_TRUE(frames.empty());
+  ASSERT_EQ(write(sockets.second, std::span{data}.subspan(2)), 10);
+  // The coroutine sleeps after the first frame, reading pauses meanwhile
+  EXPECT_EQ(mgr.handle_read_event(), event_result::ok);
+  EXPECT_EQ(frames, std::vector<size_t>{4});
+  EXPECT_EQ(mpx.num_read_disables, 1);
+  EXPECT_EQ(mpx.num_timeouts, 1);
+  EXPECT_EQ(mgr.handle_timeout(1), event_result::ok);
+  EXPECT_EQ(mpx.num_read_enables, 2);
+  EXPECT_EQ(mgr.handle_read_event(), event_result::ok);
+  EXPECT_EQ(frames, (std::vector<size_t>{4, 4}));
+  EXPECT_EQ(mpx.num_read_disables, 2);
+  // Unknown timeouts do not resume the coroutine
+  EXPECT_EQ(mgr.handle_timeout(1), event_result::ok);
+  EXPECT_EQ(mgr.handle_timeout(2), event_result::ok);
+  EXPECT_EQ(mgr.handle_read_event(), event_result::ok);
+  EXPECT_EQ(frames, (std::vector<size_t>{4, 4, 4}));
+  EXPECT_EQ(mgr.handle_timeout(3), event_result::ok);
+  EXPECT_EQ(mgr.handle_write_event(), event_result::done);
+  util::byte_array<12> echoed;
+  ASSERT_EQ(read(sockets.second, echoed), echoed.size());
+  EXPECT_EQ(memcmp(data.data(), echoed.data(), data.size()), 0);
+}
+
+TEST_F(coroutine_test, frames_are_pooled) {
+  {
+    manager_type mgr(sockets.first, &mpx);
+    ASSERT_EQ(mgr.init(util::config{}), util::none);
+    EXPECT_EQ(mpx.pooled_managers().num_cached(), 0);
+  }
+  // The frame of the next coroutine reuses the memory of the previous one
+  EXPECT_EQ(mpx.pooled_managers().num_cached(), 1);
+  manager_type mgr(sockets.first, &mpx);
+  ASSERT_EQ(mgr.init(util::config{}), util::none);
+  EXPECT_EQ(mpx.pooled_managers().num_cached(), 0);
+}
+
+TEST(coroutine_multiplexer_test, sleep_keeps_the_connection) {
+  util::config cfg;
+  multiplexer_impl mpx;
+  ASSERT_EQ(mpx.init(std::make_shared<echo_factory>(), cfg), util::none);
+  mpx.set_thread_id(std::this_thread::get_id());
+  auto res = make_stream_socket_pair();
+  ASSERT_EQ(util::get_error(res), nullptr);
+  auto sockets = std::get<stream_socket_pair>(res);
+  auto mgr = util::make_intrusive<manager_type>(sockets.first, &mpx);
+  mpx.add(mgr, operation::read);
+  const auto num_managers = mpx.num_socket_managers();
+  ASSERT_TRUE(nonblocking(sockets.second, true));
+  util::byte_array<4> data{};
+  const auto echo_frame = [&] {
+    if (write(sockets.second, data) != 4)
+      return false;
+    util::byte_array<4> echoed{};
+    for (size_t i = 0; i < 100; ++i) {
+      EXPECT_EQ(mpx.poll_once(true), util::none);
+      if (read(sockets.second, echoed) == 4)
+        return true;
+    }
+    return false;
+  };
+  // Read, write and sleep, then read again after waking up
+  ASSERT_TRUE(echo_frame());
+  ASSERT_TRUE(echo_frame());
+  EXPECT_EQ(mgr->next_layer().handler().frames,
+            (std::vector<size_t>{4, 4}));
+  EXPECT_EQ(mpx.num_socket_managers(), num_managers);
+  close(sockets.second);
+}
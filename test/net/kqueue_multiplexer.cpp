@@ -70,11 +70,13 @@ struct dummy_socket_manager : public socket_manager {
   event_result handle_timeout(uint64_t timeout_id) override {
     handled_timeouts_.push_back(timeout_id);
     if (reset_timeout_) {
-      EXPECT_EQ(set_timeout_in(1ms), timeout_id + 1);
+      set_timeouts.push_back(set_timeout_in(1ms));
     }
     return event_result::ok;
   }
 
+  std::vector<uint64_t> set_timeouts;
+
 private:
   bool& handled_read_event_;
   bool& handled_write_event_;
@@ -219,8 +221,8 @@ TEST_F(kqueue_multiplexer_test, event_handling) {
 }
 
 TEST_F(kqueue_multiplexer_test, resetting_timeout) {
+  static constexpr size_t num_timeouts = 10;
   std::vector<uint64_t> handled_timeouts;
-  std::array<uint64_t, 10> expected_result{0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
   auto res = make_stream_socket_pair();
   ASSERT_EQ(get_error(res), nullptr);
   auto sockets = std::get<stream_socket_pair>(res);
@@ -228,18 +230,18 @@ TEST_F(kqueue_multiplexer_test, resetting_timeout) {
     sockets.first, &mpx, handled_read_event, handled_write_event,
     handled_timeouts, false, true);
   mpx.add(mgr, operation::read);
-  EXPECT_EQ(mgr->set_timeout_in(10ms), 0);
+  mgr->set_timeouts.push_back(mgr->set_timeout_in(10ms));
   ASSERT_TRUE(poll_until(
-    [&] { return handled_timeouts.size() >= expected_result.size(); }, true,
-    20));
-  EXPECT_EQ(handled_timeouts.size(), expected_result.size());
+    [&] { return handled_timeouts.size() >= num_timeouts; }, true, 20));
+  EXPECT_EQ(handled_timeouts.size(), num_timeouts);
+  // Each timeout sets the one handled next
   EXPECT_TRUE(std::equal(handled_timeouts.begin(), handled_timeouts.end(),
-                         expected_result.begin()));
+                         mgr->set_timeouts.begin()));
 }
 
 TEST_F(kqueue_multiplexer_test, multiple_timeouts) {
   std::vector<uint64_t> handled_timeouts;
-  std::array<uint64_t, 10> expected_result{0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  std::vector<uint64_t> expected_result;
   auto res = make_stream_socket_pair();
   ASSERT_EQ(get_error(res), nullptr);
   auto sockets = std::get<stream_socket_pair>(res);
@@ -248,16 +250,14 @@ TEST_F(kqueue_multiplexer_test, multiple_timeouts) {
     handled_timeouts, false, false);
   mpx.add(mgr, operation::read);
   auto duration = 10ms;
-  for (size_t i = 0; i < expected_result.size(); ++i) {
-    EXPECT_EQ(mgr->set_timeout_in(duration), i);
+  for (size_t i = 0; i < 10; ++i) {
+    expected_result.push_back(mgr->set_timeout_in(duration));
     duration += 10ms;
   }
   ASSERT_TRUE(poll_until(
     [&] { return handled_timeouts.size() >= expected_result.size(); }, true,
     20));
-  EXPECT_EQ(handled_timeouts.size(), expected_result.size());
-  EXPECT_TRUE(std::equal(handled_timeouts.begin(), handled_timeouts.end(),
-                         expected_result.begin()));
+  EXPECT_EQ(handled_timeouts, expected_result);
 }
 
 // TODO: Implement test that checks pipe-reading and  writing for adding and
@@ -0,0 +1,104 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      manager_pool.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/manager_pool.hpp"
+
+#include "util/intrusive_ptr.hpp"
+#include "util/ref_counted.hpp"
+
+#include "net_test.hpp"
+
+#include <cstddef>
+#include <thread>
+
+using namespace net;
+
+namespace {
+
+struct counted : public util::ref_counted {
+  counted(int value, std::size_t& destroyed)
+    : value(value), destroyed(destroyed) {
+    // nop
+  }
+
+  ~counted() override { ++destroyed; }
+
+  int value;
+  std::size_t& destroyed;
+};
+
+} // namespace
+
+TEST(manager_pool, blocks_are_reused_per_size) {
+  manager_pool pool;
+  auto* small = pool.allocate(64);
+  auto* large = pool.allocate(128);
+  pool.deallocate(small, 64);
+  pool.deallocate(large, 128);
+  EXPECT_EQ(pool.num_cached(), 2);
+  EXPECT_EQ(pool.allocate(128), large);
+  EXPECT_EQ(pool.allocate(64), small);
+  EXPECT_EQ(pool.num_cached(), 0);
+  pool.deallocate(small, 64);
+  pool.deallocate(large, 128);
+}
+
+TEST(manager_pool, max_cached) {
+  manager_pool pool{1};
+  auto* first = pool.allocate(64);
+  auto* second = pool.allocate(64);
+  pool.deallocate(first, 64);
+  pool.deallocate(second, 64);
+  EXPECT_EQ(pool.num_cached(), 1);
+}
+
+TEST(manager_pool, make_pooled) {
+  std::size_t destroyed = 0;
+  manager_pool pool;
+  auto ptr = make_pooled<counted>(pool, 42, destroyed);
+  EXPECT_EQ(ptr->value, 42);
+  EXPECT_EQ(ptr->ref_count(), 1);
+  const auto* storage = ptr.get();
+  // Dropping the last reference destroys the object and keeps its memory
+  auto copy = ptr;
+  ptr.reset();
+  EXPECT_EQ(destroyed, 0);
+  copy.reset();
+  EXPECT_EQ(destroyed, 1);
+  EXPECT_EQ(pool.num_cached(), 1);
+  auto reused = make_pooled<counted>(pool, 23, destroyed);
+  EXPECT_EQ(reused.get(), storage);
+  EXPECT_EQ(reused->value, 23);
+  EXPECT_EQ(pool.num_cached(), 0);
+}
+
+TEST(manager_pool, release_off_the_owning_thread) {
+  std::size_t destroyed = 0;
+  manager_pool pool;
+  auto ptr = make_pooled<counted>(pool, 42, destroyed);
+  // Only the owning thread may touch the free lists, others free the memory
+  std::thread{[&ptr] { ptr.reset(); }}.join();
+  EXPECT_EQ(destroyed, 1);
+  EXPECT_EQ(pool.num_cached(), 0);
+  ptr = make_pooled<counted>(pool, 23, destroyed);
+  pool.owner(std::thread::id{});
+  ptr.reset();
+  EXPECT_EQ(destroyed, 2);
+  EXPECT_EQ(pool.num_cached(), 0);
+}
+
+TEST(manager_pool, objects_outlive_the_pool) {
+  std::size_t destroyed = 0;
+  util::intrusive_ptr<counted> ptr;
+  {
+    manager_pool pool;
+    ptr = make_pooled<counted>(pool, 42, destroyed);
+  }
+  ptr.reset();
+  EXPECT_EQ(destroyed, 1);
+}
@@ -0,0 +1,231 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      multiplexer_group.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/multiplexer_group.hpp"
+
+#include "net/event_result.hpp"
+#include "net/ip/v4_address.hpp"
+#include "net/ip/v4_endpoint.hpp"
+#include "net/multiplexer.hpp"
+#include "net/multiplexer_impl.hpp"
+#include "net/offload_pool.hpp"
+#include "net/socket/stream_socket.hpp"
+#include "net/socket/tcp_stream_socket.hpp"
+#include "net/socket_manager.hpp"
+#include "net/socket_manager_factory.hpp"
+
+#include "util/byte_array.hpp"
+#include "util/config.hpp"
+#include "util/cpu_affinity.hpp"
+#include "util/error.hpp"
+#include "util/error_or.hpp"
+#include "util/intrusive_ptr.hpp"
+
+#include "net_test.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+
+using namespace net;
+using namespace net::ip;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct dummy_socket_manager : public socket_manager {
+  using socket_manager::socket_manager;
+
+  util::error init(const util::config&) override { return util::none; }
+
+  event_result handle_read_event() override {
+    util::byte_array<1024> buf;
+    return (read(handle<stream_socket>(), buf) > 0) ? event_result::ok
+                                                    : event_result::error;
+  }
+
+  event_result handle_write_event() override { return event_result::done; }
+
+  event_result handle_timeout(uint64_t) override { return event_result::ok; }
+};
+
+/// Records which threads accepted connections.
+struct dummy_factory : public socket_manager_factory {
+  socket_manager_ptr make(net::socket handle, multiplexer* mpx) override {
+    {
+      std::lock_guard<std::mutex> guard{mtx};
+      accepting_threads.insert(std::this_thread::get_id());
+    }
+#if defined(SO_INCOMING_CPU)
+    // Compare the cpu that received the connection to the accepting one
+    int incoming_cpu = -1;
+    socklen_t len = sizeof(incoming_cpu);
+    if ((::getsockopt(handle.id, SOL_SOCKET, SO_INCOMING_CPU, &incoming_cpu,
+                      &len)
+         == 0)
+        && (incoming_cpu != util::current_cpu()))
+      ++num_cross_cpu;
+#endif
+    ++num_accepted;
+    return util::make_intrusive<dummy_socket_manager>(handle, mpx);
+  }
+
+  std::atomic<size_t> num_accepted{0};
+  std::atomic<size_t> num_cross_cpu{0};
+  std::mutex mtx;
+  std::set<std::thread::id> accepting_threads;
+};
+
+struct multiplexer_group_test : public testing::Test {
+  multiplexer_group_test() : factory{std::make_shared<dummy_factory>()} {
+    cfg.add_config_entry("multiplexer.num-threads", std::int64_t{4});
+  }
+
+  util::config cfg;
+  std::shared_ptr<dummy_factory> factory;
+  multiplexer_group group;
+};
+
+void connect_clients(std::uint16_t port, size_t num_connections,
+                     std::vector<tcp_stream_socket>& clients) {
+  for (size_t i = 0; i < num_connections; ++i) {
+    auto res = make_connected_tcp_stream_socket(
+      v4_endpoint{v4_address::localhost, port});
+    ASSERT_EQ(get_error(res), nullptr);
+    clients.emplace_back(std::get<tcp_stream_socket>(res));
+  }
+}
+
+void await_accepted(dummy_factory& factory, size_t num_connections) {
+  for (size_t i = 0; (i < 500) && (factory.num_accepted < num_connections);
+       ++i)
+    std::this_thread::sleep_for(10ms);
+  EXPECT_EQ(factory.num_accepted, num_connections);
+}
+
+} // namespace
+
+TEST_F(multiplexer_group_test, init) {
+  ASSERT_EQ(group.init(factory, cfg), util::none);
+  EXPECT_EQ(group.size(), 4);
+  EXPECT_NE(group.port(), 0);
+  for (const auto& mpx : group.multiplexers())
+    EXPECT_EQ(mpx->port(), group.port());
+  EXPECT_FALSE(group.running());
+}
+
+TEST_F(multiplexer_group_test, invalid_num_threads) {
+  util::config invalid_cfg;
+  invalid_cfg.add_config_entry("multiplexer.num-threads", std::int64_t{0});
+  EXPECT_NE(group.init(factory, invalid_cfg), util::none);
+}
+
+TEST_F(multiplexer_group_test, accept_on_all_threads) {
+  static constexpr size_t num_connections = 64;
+  ASSERT_EQ(group.init(factory, cfg), util::none);
+  group.start();
+  EXPECT_TRUE(group.running());
+  std::vector<tcp_stream_socket> clients;
+  connect_clients(group.port(), num_connections, clients);
+  await_accepted(*factory, num_connections);
+  {
+    std::lock_guard<std::mutex> guard{factory->mtx};
+    EXPECT_GT(factory->accepting_threads.size(), 1);
+  }
+  for (auto client : clients)
+    close(client);
+  group.shutdown();
+  group.join();
+  EXPECT_FALSE(group.running());
+}
+
+TEST_F(multiplexer_group_test, shares_offload_pool) {
+  cfg.add_config_entry("multiplexer.offload-threads", std::int64_t{2});
+  ASSERT_EQ(group.init(factory, cfg), util::none);
+  auto* pool = group.multiplexers().front()->offload();
+  ASSERT_NE(pool, nullptr);
+  EXPECT_EQ(pool->num_workers(), 2);
+  for (const auto& mpx : group.multiplexers())
+    EXPECT_EQ(mpx->offload(), pool);
+}
+
+TEST_F(multiplexer_group_test, offload_after_destroying_a_multiplexer) {
+  static constexpr size_t num_jobs = 16;
+  // Shares a pool between two multiplexers, the same way the group does
+  auto pool = std::make_shared<offload_pool>(2);
+  auto make_member = [&](stream_socket handle) {
+    auto res = make_multiplexer(factory, cfg);
+    EXPECT_EQ(get_error(res), nullptr);
+    auto mpx = std::get<multiplexer_ptr>(res);
+    mpx->offload(pool);
+    mpx->start();
+    auto mgr = util::make_intrusive<dummy_socket_manager>(handle, mpx.get());
+    mpx->add(mgr, operation::read);
+    return std::make_pair(mpx, mgr);
+  };
+  auto first_res = make_stream_socket_pair();
+  auto second_res = make_stream_socket_pair();
+  ASSERT_EQ(get_error(first_res), nullptr);
+  ASSERT_EQ(get_error(second_res), nullptr);
+  auto first_sockets = std::get<stream_socket_pair>(first_res);
+  auto second_sockets = std::get<stream_socket_pair>(second_res);
+  auto [first, first_mgr] = make_member(first_sockets.first);
+  auto [second, second_mgr] = make_member(second_sockets.first);
+  // Destroys the first multiplexer while its jobs are running or queued
+  for (size_t i = 0; i < num_jobs; ++i)
+    pool->submit(
+      first_mgr.get(), [] { std::this_thread::sleep_for(1ms); }, [] {});
+  first->shutdown();
+  first->join();
+  first = nullptr;
+  EXPECT_EQ(first_mgr->ref_count(), 1);
+  // The remaining multiplexer keeps offloading
+  std::atomic<size_t> num_done{0};
+  for (size_t i = 0; i < num_jobs; ++i)
+    EXPECT_TRUE(pool->submit(
+      second_mgr.get(), [] { return size_t{1}; },
+      [&num_done](size_t n) { num_done += n; }));
+  for (size_t i = 0; (i < 500) && (num_done < num_jobs); ++i)
+    std::this_thread::sleep_for(10ms);
+  EXPECT_EQ(num_done, num_jobs);
+  second->shutdown();
+  second->join();
+  close(first_sockets.second);
+  close(second_sockets.second);
+}
+
+#if defined(__linux__)
+
+TEST_F(multiplexer_group_test, cpu_steering) {
+  static constexpr size_t num_connections = 64;
+  util::config steering_cfg;
+  steering_cfg.add_config_entry(
+    "multiplexer.num-threads",
+    std::int64_t{std::max(std::thread::hardware_concurrency(), 1u)});
+  steering_cfg.add_config_entry("multiplexer.cpu-steering", true);
+  ASSERT_EQ(group.init(factory, steering_cfg), util::none);
+  group.start();
+  std::vector<tcp_stream_socket> clients;
+  connect_clients(group.port(), num_connections, clients);
+  await_accepted(*factory, num_connections);
+  // Every connection is accepted on the cpu that received it
+  EXPECT_EQ(factory->num_cross_cpu, 0);
+  for (auto client : clients)
+    close(client);
+  group.shutdown();
+  group.join();
+}
+
+#endif
@@ -0,0 +1,598 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      multiplexer_impl.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net_test.hpp"
+
+#include "net/event_result.hpp"
+#include "net/ip/v4_address.hpp"
+#include "net/ip/v4_endpoint.hpp"
+#include "net/multiplexer.hpp"
+#include "net/multiplexer_impl.hpp"
+#include "net/socket/stream_socket.hpp"
+#include "net/socket/tcp_stream_socket.hpp"
+#include "net/socket_guard.hpp"
+#include "net/socket_manager.hpp"
+#include "net/socket_manager_factory.hpp"
+
+#include "util/error.hpp"
+#include "util/error_or.hpp"
+#include "util/intrusive_ptr.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <tuple>
+
+#include <unistd.h>
+
+using namespace net;
+using namespace net::ip;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct dummy_socket_manager : public socket_manager {
+  dummy_socket_manager(net::socket handle, multiplexer* parent,
+                       bool& handled_read_event, bool& handled_write_event,
+                       std::vector<uint64_t>& handled_timeouts,
+                       bool register_writing, bool reset_timeout)
+    : socket_manager(handle, parent),
+      handled_read_event_(handled_read_event),
+      handled_write_event_(handled_write_event),
+      handled_timeouts_(handled_timeouts),
+      register_writing_(register_writing),
+      reset_timeout_{reset_timeout} {
+    // nop
+  }
+
+  util::error init(const util::config&) override { return util::none; }
+
+  event_result handle_read_event() override {
+    util::byte_array<1024> buf;
+    handled_read_event_ = true;
+    if (register_writing_) {
+      this->register_writing();
+    }
+    return (read(handle<stream_socket>(), buf) > 0) ? event_result::ok
+                                                    : event_result::error;
+  }
+
+  event_result handle_write_event() override {
+    util::byte_array<1024> buf;
+    handled_write_event_ = true;
+    EXPECT_EQ(write(handle<stream_socket>(), buf), buf.size());
+    return event_result::done;
+  }
+
+  event_result handle_timeout(uint64_t timeout_id) override {
+    handled_timeouts_.push_back(timeout_id);
+    if (reset_timeout_) {
+      set_timeouts.push_back(set_timeout_in(1ms));
+    }
+    return event_result::ok;
+  }
+
+  std::vector<uint64_t> set_timeouts;
+
+private:
+  bool& handled_read_event_;
+  bool& handled_write_event_;
+  std::vector<uint64_t>& handled_timeouts_;
+  bool register_writing_ = false;
+  bool reset_timeout_ = false;
+};
+
+struct dummy_factory : public socket_manager_factory {
+  dummy_factory(bool& handled_read_event, bool& handled_write_event)
+    : handled_read_event_(handled_read_event),
+      handled_write_event_(handled_write_event) {}
+
+  socket_manager_ptr make(net::socket handle, multiplexer* mpx) override {
+    return util::make_intrusive<dummy_socket_manager>(
+      handle, mpx, handled_read_event_, handled_write_event_, handled_timeouts_,
+      register_writing_, false);
+  }
+
+  void enable_register_writing() { register_writing_ = true; }
+
+private:
+  bool& handled_read_event_;
+  bool& handled_write_event_;
+  std::vector<uint64_t> handled_timeouts_;
+  bool register_writing_ = false;
+};
+
+/// Deletes its peer from the multiplexer when handling a read event.
+struct deleting_socket_manager : public socket_manager {
+  deleting_socket_manager(net::socket handle, multiplexer* parent,
+                          size_t& num_read_events)
+    : socket_manager(handle, parent), num_read_events_(num_read_events) {
+    // nop
+  }
+
+  util::error init(const util::config&) override { return util::none; }
+
+  event_result handle_read_event() override {
+    ++num_read_events_;
+    if (peer) {
+      mpx()->disable(peer.get(), operation::read, true);
+      static_cast<deleting_socket_manager*>(peer.get())->peer = nullptr;
+      peer = nullptr;
+    }
+    return event_result::ok;
+  }
+
+  event_result handle_write_event() override { return event_result::done; }
+
+  event_result handle_timeout(uint64_t) override { return event_result::ok; }
+
+  socket_manager_ptr peer;
+
+private:
+  size_t& num_read_events_;
+};
+
+/// Reads a single byte per read event using edge-triggered events.
+struct edge_triggered_socket_manager : public socket_manager {
+  edge_triggered_socket_manager(net::socket handle, multiplexer* parent,
+                                size_t& num_read_events)
+    : socket_manager(handle, parent), num_read_events_(num_read_events) {
+    // nop
+  }
+
+  util::error init(const util::config&) override {
+    edge_triggered(true);
+    return util::none;
+  }
+
+  event_result handle_read_event() override {
+    ++num_read_events_;
+    util::byte_array<1> buf;
+    if (read(handle<stream_socket>(), buf) > 0)
+      return event_result::again;
+    return last_socket_error_is_temporary() ? event_result::ok
+                                            : event_result::error;
+  }
+
+  event_result handle_write_event() override { return event_result::done; }
+
+  event_result handle_timeout(uint64_t) override { return event_result::ok; }
+
+private:
+  size_t& num_read_events_;
+};
+
+/// Records how late its timeouts fire.
+struct timer_socket_manager : public socket_manager {
+  using socket_manager::socket_manager;
+
+  util::error init(const util::config&) override { return util::none; }
+
+  event_result handle_read_event() override { return event_result::ok; }
+
+  event_result handle_write_event() override { return event_result::done; }
+
+  event_result handle_timeout(uint64_t) override {
+    delays.push_back(multiplexer::clock_type::now() - deadline);
+    return event_result::ok;
+  }
+
+  multiplexer::time_point deadline;
+  std::vector<std::chrono::nanoseconds> delays;
+};
+
+/// Returns the median delay of timeouts on a multiplexer configured by `cfg`.
+std::chrono::nanoseconds median_timeout_delay(const util::config& cfg) {
+  static constexpr size_t num_timeouts = 50;
+  bool handled_read_event = false;
+  bool handled_write_event = false;
+  multiplexer_impl mpx;
+  EXPECT_EQ(mpx.init(std::make_shared<dummy_factory>(handled_read_event,
+                                                      handled_write_event),
+                     cfg),
+            util::none);
+  mpx.set_thread_id(std::this_thread::get_id());
+  auto res = make_stream_socket_pair();
+  EXPECT_EQ(get_error(res), nullptr);
+  auto sockets = std::get<stream_socket_pair>(res);
+  auto mgr = util::make_intrusive<timer_socket_manager>(sockets.first, &mpx);
+  mpx.add(mgr, operation::read);
+  for (size_t i = 0; i < num_timeouts; ++i) {
+    mgr->deadline = multiplexer::clock_type::now() + 300us;
+    mpx.set_timeout(mgr.get(), mgr->deadline);
+    while (mgr->delays.size() <= i)
+      EXPECT_EQ(mpx.poll_once(true), util::none);
+  }
+  close(sockets.second);
+  auto& delays = mgr->delays;
+  std::nth_element(delays.begin(), delays.begin() + delays.size() / 2,
+                   delays.end());
+  return delays[delays.size() / 2];
+}
+
+struct multiplexer_impl_test : public testing::Test {
+  multiplexer_impl_test()
+    : factory(std::make_shared<dummy_factory>(handled_read_event,
+                                              handled_write_event)) {
+    EXPECT_EQ(mpx.init(factory, cfg), util::none);
+    mpx.set_thread_id(std::this_thread::get_id());
+    default_num_socket_managers = mpx.num_socket_managers();
+  }
+
+  tcp_stream_socket connect_to_mpx() {
+    auto sock_res = make_connected_tcp_stream_socket(
+      v4_endpoint{v4_address::localhost, mpx.port()});
+    EXPECT_EQ(util::get_error(sock_res), nullptr);
+    return std::get<tcp_stream_socket>(sock_res);
+  }
+
+  bool poll_until(const std::function<bool()>& predicate, bool blocking = false,
+                  const std::size_t max_num_polls = 10) {
+    std::size_t num_polls = 0;
+    do {
+      EXPECT_EQ(mpx.poll_once(blocking), util::none);
+    } while (!predicate() && (num_polls++ < max_num_polls));
+    return predicate();
+  }
+
+  util::config cfg;
+  bool handled_read_event = false;
+  bool handled_write_event = false;
+  socket_manager_factory_ptr factory;
+  multiplexer_impl mpx;
+  size_t default_num_socket_managers;
+};
+
+bool write_all(net::tcp_stream_socket handle, util::byte_span data) {
+  while (!data.empty()) {
+    const auto res = write(handle, data);
+    if (res > 0) {
+      data = data.subspan(res);
+    } else if (!net::last_socket_error_is_temporary()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool read_all(net::tcp_stream_socket handle, util::byte_span data) {
+  while (!data.empty()) {
+    const auto res = read(handle, data);
+    if (res > 0) {
+      data = data.subspan(res);
+    } else if (!net::last_socket_error_is_temporary()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+TEST_F(multiplexer_impl_test, mpx_shuts_down_correctly) {
+  EXPECT_EQ(mpx.num_socket_managers(), default_num_socket_managers);
+  // Enforce a shutdown event being written to the pipe
+  mpx.set_thread_id();
+  mpx.shutdown();
+  // No shutdown should have been initiated - All managers must still be present
+  ASSERT_EQ(mpx.num_socket_managers(), default_num_socket_managers);
+  // Now become the mpx thread again and poll until all mgrs are deleted
+  mpx.set_thread_id(std::this_thread::get_id());
+  ASSERT_TRUE(poll_until([&] { return mpx.num_socket_managers() == 0; }));
+}
+
+TEST_F(multiplexer_impl_test, mpx_accepts_connections) {
+  std::array<tcp_stream_socket, 10> sockets;
+  for (auto& sock : sockets) {
+    const auto num_managers = mpx.num_socket_managers();
+    sock = connect_to_mpx();
+    ASSERT_TRUE(poll_until(
+      [&] { return mpx.num_socket_managers() == (num_managers + 1); }));
+  }
+  EXPECT_EQ(mpx.num_socket_managers(), default_num_socket_managers + 10);
+
+  for (auto sock : sockets) {
+    close(sock);
+  }
+}
+
+TEST_F(multiplexer_impl_test, manager_removed_after_disconnect) {
+  {
+    socket_guard guard{connect_to_mpx()};
+    ASSERT_TRUE(poll_until([&] {
+      return (mpx.num_socket_managers() == (default_num_socket_managers + 1));
+    }));
+  }
+  ASSERT_TRUE(poll_until([&] {
+    return (mpx.num_socket_managers() == default_num_socket_managers);
+  }));
+}
+
+TEST_F(multiplexer_impl_test, event_handling) {
+  // Connect to the multiplexer and trigger it for accepting the connection
+  const socket_guard guard{connect_to_mpx()};
+  std::static_pointer_cast<dummy_factory>(factory)->enable_register_writing();
+  ASSERT_TRUE(poll_until([this] {
+    return (mpx.num_socket_managers() == (default_num_socket_managers + 1));
+  }));
+  // Write all data and check if it will be received by the mpx
+  util::byte_array<1024> buf;
+  ASSERT_TRUE(write_all(guard.get(), buf));
+  ASSERT_TRUE(poll_until([this] { return handled_read_event; }));
+  ASSERT_FALSE(handled_write_event);
+  // Check the mgr was enabled for writing, trigger it and read from the
+  ASSERT_EQ(mpx.num_socket_managers(), default_num_socket_managers + 1);
+  ASSERT_TRUE(poll_until([this] { return handled_write_event; }));
+  ASSERT_TRUE(read_all(guard.get(), buf));
+}
+
+TEST_F(multiplexer_impl_test, resetting_timeout) {
+  static constexpr size_t num_timeouts = 10;
+  std::vector<uint64_t> handled_timeouts;
+  auto res = make_stream_socket_pair();
+  ASSERT_EQ(get_error(res), nullptr);
+  auto sockets = std::get<stream_socket_pair>(res);
+  auto mgr = util::make_intrusive<dummy_socket_manager>(
+    sockets.first, &mpx, handled_read_event, handled_write_event,
+    handled_timeouts, false, true);
+  mpx.add(mgr, operation::read);
+  mgr->set_timeouts.push_back(mgr->set_timeout_in(10ms));
+  ASSERT_TRUE(poll_until(
+    [&] { return handled_timeouts.size() >= num_timeouts; }, true, 20));
+  EXPECT_EQ(handled_timeouts.size(), num_timeouts);
+  // Each timeout sets the one handled next
+  EXPECT_TRUE(std::equal(handled_timeouts.begin(), handled_timeouts.end(),
+                         mgr->set_timeouts.begin()));
+}
+
+TEST_F(multiplexer_impl_test, multiple_timeouts) {
+  std::vector<uint64_t> handled_timeouts;
+  std::vector<uint64_t> expected_result;
+  auto res = make_stream_socket_pair();
+  ASSERT_EQ(get_error(res), nullptr);
+  auto sockets = std::get<stream_socket_pair>(res);
+  auto mgr = util::make_intrusive<dummy_socket_manager>(
+    sockets.first, &mpx, handled_read_event, handled_write_event,
+    handled_timeouts, false, false);
+  mpx.add(mgr, operation::read);
+  auto duration = 10ms;
+  for (size_t i = 0; i < 10; ++i) {
+    expected_result.push_back(mgr->set_timeout_in(duration));
+    duration += 10ms;
+  }
+  ASSERT_TRUE(poll_until(
+    [&] { return handled_timeouts.size() >= expected_result.size(); }, true,
+    20));
+  EXPECT_EQ(handled_timeouts, expected_result);
+}
+
+TEST_F(multiplexer_impl_test, cancel_timeout) {
+  std::vector<uint64_t> handled_timeouts;
+  auto res = make_stream_socket_pair();
+  ASSERT_EQ(get_error(res), nullptr);
+  auto sockets = std::get<stream_socket_pair>(res);
+  auto mgr = util::make_intrusive<dummy_socket_manager>(
+    sockets.first, &mpx, handled_read_event, handled_write_event,
+    handled_timeouts, false, false);
+  mpx.add(mgr, operation::read);
+  const auto cancelled = mgr->set_timeout_in(10ms);
+  const auto kept = mgr->set_timeout_in(10ms);
+  EXPECT_TRUE(mgr->cancel_timeout(cancelled));
+  EXPECT_FALSE(mgr->cancel_timeout(cancelled));
+  ASSERT_TRUE(
+    poll_until([&] { return !handled_timeouts.empty(); }, true, 20));
+  EXPECT_EQ(handled_timeouts, std::vector<uint64_t>{kept});
+  close(sockets.second);
+}
+
+TEST_F(multiplexer_impl_test, delete_during_event_batch) {
+  auto first_res = make_stream_socket_pair();
+  ASSERT_EQ(get_error(first_res), nullptr);
+  auto second_res = make_stream_socket_pair();
+  ASSERT_EQ(get_error(second_res), nullptr);
+  auto first = std::get<stream_socket_pair>(first_res);
+  auto second = std::get<stream_socket_pair>(second_res);
+  size_t num_read_events = 0;
+  auto first_mgr = util::make_intrusive<deleting_socket_manager>(
+    first.first, &mpx, num_read_events);
+  auto second_mgr = util::make_intrusive<deleting_socket_manager>(
+    second.first, &mpx, num_read_events);
+  first_mgr->peer = second_mgr;
+  second_mgr->peer = first_mgr;
+  mpx.add(first_mgr, operation::read);
+  mpx.add(second_mgr, operation::read);
+  first_mgr = nullptr;
+  second_mgr = nullptr;
+  // Both managers become readable in the same batch of events
+  util::byte_array<1> buf;
+  ASSERT_EQ(write(first.second, buf), buf.size());
+  ASSERT_EQ(write(second.second, buf), buf.size());
+  EXPECT_EQ(mpx.poll_once(false), util::none);
+  // The manager handled first deleted the other one, which must not be called
+  EXPECT_EQ(num_read_events, 1);
+  EXPECT_EQ(mpx.num_socket_managers(), default_num_socket_managers + 1);
+  close(first.second);
+  close(second.second);
+}
+
+TEST_F(multiplexer_impl_test, loop_clock_is_cached) {
+  const auto start = mpx.now();
+  std::this_thread::sleep_for(1ms);
+  // The loop time only advances once per iteration
+  EXPECT_EQ(mpx.now(), start);
+  EXPECT_EQ(mpx.poll_once(false), util::none);
+  EXPECT_GE(mpx.now() - start, 1ms);
+}
+
+TEST_F(multiplexer_impl_test, high_resolution_timers) {
+  util::config high_res_cfg;
+  high_res_cfg.add_config_entry("multiplexer.high-resolution-timers", true);
+  util::config timerfd_cfg{high_res_cfg};
+  timerfd_cfg.add_config_entry("multiplexer.timerfd", true);
+  const auto default_delay = median_timeout_delay(cfg);
+  const auto pwait2_delay = median_timeout_delay(high_res_cfg);
+  const auto timerfd_delay = median_timeout_delay(timerfd_cfg);
+  // Millisecond timeouts round the 300us up to a full millisecond
+  EXPECT_GE(default_delay, 0ns);
+  EXPECT_LT(pwait2_delay, default_delay);
+  EXPECT_LT(timerfd_delay, default_delay);
+  EXPECT_LT(pwait2_delay, 250us);
+  EXPECT_LT(timerfd_delay, 250us);
+}
+
+TEST_F(multiplexer_impl_test, control_from_other_thread) {
+  std::vector<uint64_t> handled_timeouts;
+  auto res = make_stream_socket_pair();
+  ASSERT_EQ(get_error(res), nullptr);
+  auto sockets = std::get<stream_socket_pair>(res);
+  auto mgr = util::make_intrusive<dummy_socket_manager>(
+    sockets.first, &mpx, handled_read_event, handled_write_event,
+    handled_timeouts, false, false);
+  mpx.add(mgr, operation::read);
+  uint64_t timeout_id = 0;
+  std::thread{[&] {
+    mpx.enable(mgr.get(), operation::write);
+    timeout_id = mpx.set_timeout(mgr.get(),
+                                 multiplexer::clock_type::now() + 1ms);
+    const auto cancelled = mpx.set_timeout(mgr.get(), mpx.now() + 1ms);
+    EXPECT_TRUE(mpx.cancel_timeout(cancelled));
+  }}.join();
+  // Nothing happens until the multiplexer handled the commands
+  EXPECT_EQ(mgr->mask(), operation::read);
+  ASSERT_TRUE(poll_until([&] { return handled_write_event; }));
+  // The timeout may have expired already, blocking would never return then
+  if (handled_timeouts.empty()) {
+    ASSERT_TRUE(
+      poll_until([&] { return !handled_timeouts.empty(); }, true, 20));
+  }
+  EXPECT_EQ(handled_timeouts, std::vector<uint64_t>{timeout_id});
+  close(sockets.second);
+}
+
+TEST_F(multiplexer_impl_test, coalesces_updates) {
+  std::vector<uint64_t> handled_timeouts;
+  auto res = make_stream_socket_pair();
+  ASSERT_EQ(get_error(res), nullptr);
+  auto sockets = std::get<stream_socket_pair>(res);
+  auto mgr = util::make_intrusive<dummy_socket_manager>(
+    sockets.first, &mpx, handled_read_event, handled_write_event,
+    handled_timeouts, false, false);
+  mpx.add(mgr, operation::read);
+  // Changes that cancel each other out never reach epoll
+  for (size_t i = 0; i < 4; ++i) {
+    mpx.enable(mgr.get(), operation::write);
+    mpx.disable(mgr.get(), operation::write, false);
+  }
+  EXPECT_EQ(mpx.poll_once(false), util::none);
+  EXPECT_FALSE(handled_write_event);
+  EXPECT_EQ(mpx.num_coalesced_updates(), 8);
+  // Only the net change is applied
+  mpx.enable(mgr.get(), operation::write);
+  mpx.disable(mgr.get(), operation::read, false);
+  mpx.enable(mgr.get(), operation::read);
+  EXPECT_TRUE(poll_until([this] { return handled_write_event; }));
+  EXPECT_EQ(mpx.num_coalesced_updates(), 10);
+  close(sockets.second);
+}
+
+TEST_F(multiplexer_impl_test, edge_triggered_ready_list) {
+  auto res = make_stream_socket_pair();
+  ASSERT_EQ(get_error(res), nullptr);
+  auto sockets = std::get<stream_socket_pair>(res);
+  ASSERT_TRUE(nonblocking(sockets.first, true));
+  size_t num_read_events = 0;
+  mpx.add(util::make_intrusive<edge_triggered_socket_manager>(
+            sockets.first, &mpx, num_read_events),
+          operation::read);
+  util::byte_array<3> buf;
+  ASSERT_EQ(write(sockets.second, buf), buf.size());
+  // The manager is handled once per iteration until its socket would block,
+  // although epoll reports the data only once
+  for (size_t i = 1; i <= buf.size() + 1; ++i) {
+    EXPECT_EQ(mpx.poll_once(false), util::none);
+    EXPECT_EQ(num_read_events, i);
+  }
+  EXPECT_EQ(mpx.poll_once(false), util::none);
+  EXPECT_EQ(num_read_events, buf.size() + 1);
+  close(sockets.second);
+}
+
+TEST_F(multiplexer_impl_test, enable_after_removal) {
+  std::vector<uint64_t> handled_timeouts;
+  auto res = make_stream_socket_pair();
+  ASSERT_EQ(get_error(res), nullptr);
+  auto sockets = std::get<stream_socket_pair>(res);
+  auto mgr = util::make_intrusive<dummy_socket_manager>(
+    sockets.first, &mpx, handled_read_event, handled_write_event,
+    handled_timeouts, false, false);
+  mpx.add(mgr, operation::read);
+  mpx.disable(mgr.get(), operation::read, true);
+  EXPECT_EQ(mpx.poll_once(false), util::none);
+  EXPECT_EQ(mpx.num_socket_managers(), default_num_socket_managers);
+  // Late calls on a removed manager are ignored and keep no reference to it
+  mpx.enable(mgr.get(), operation::write);
+  mpx.set_timeout(mgr.get(), mpx.now());
+  EXPECT_EQ(mgr->mask(), operation::none);
+  EXPECT_EQ(mgr->ref_count(), 1);
+  mgr = nullptr;
+  EXPECT_EQ(mpx.poll_once(false), util::none);
+  EXPECT_FALSE(handled_write_event);
+  EXPECT_TRUE(handled_timeouts.empty());
+  close(sockets.second);
+}
+
+TEST_F(multiplexer_impl_test, reused_handle_drops_stale_timeouts) {
+  std::vector<uint64_t> handled_timeouts;
+  auto res = make_stream_socket_pair();
+  ASSERT_EQ(get_error(res), nullptr);
+  auto sockets = std::get<stream_socket_pair>(res);
+  auto mgr = util::make_intrusive<dummy_socket_manager>(
+    sockets.first, &mpx, handled_read_event, handled_write_event,
+    handled_timeouts, false, false);
+  mpx.add(mgr, operation::read);
+  mpx.set_timeout(mgr.get(), mpx.now() + 5ms);
+  mpx.disable(mgr.get(), operation::read, true);
+  mgr = nullptr;
+  // Destroying the manager closes its socket
+  EXPECT_EQ(mpx.poll_once(false), util::none);
+  // The next socket gets the same id
+  auto other = make_stream_socket_pair();
+  ASSERT_EQ(get_error(other), nullptr);
+  auto reused = std::get<stream_socket_pair>(other);
+  if (reused.first != sockets.first) {
+    ASSERT_EQ(::dup2(reused.first.id, sockets.first.id), sockets.first.id);
+    close(reused.first);
+  }
+  mgr = util::make_intrusive<dummy_socket_manager>(
+    sockets.first, &mpx, handled_read_event, handled_write_event,
+    handled_timeouts, false, false);
+  mpx.add(mgr, operation::read);
+  std::this_thread::sleep_for(10ms);
+  EXPECT_EQ(mpx.poll_once(false), util::none);
+  EXPECT_TRUE(handled_timeouts.empty());
+  close(sockets.second);
+  close(reused.second);
+}
+
+TEST_F(multiplexer_impl_test, register_writing_from_other_thread) {
+  std::vector<uint64_t> handled_timeouts;
+  auto res = make_stream_socket_pair();
+  ASSERT_EQ(get_error(res), nullptr);
+  auto sockets = std::get<stream_socket_pair>(res);
+  auto mgr = util::make_intrusive<dummy_socket_manager>(
+    sockets.first, &mpx, handled_read_event, handled_write_event,
+    handled_timeouts, false, false);
+  mpx.add(mgr, operation::read_write);
+  // The multiplexer may disable writing before it sees the request, which is
+  // therefore forwarded although the mask still contains the write bit
+  std::thread{[&] { mgr->register_writing(); }}.join();
+  EXPECT_EQ(mgr->ref_count(), 3);
+  EXPECT_TRUE(poll_until([&] { return mgr->ref_count() == 2; }));
+  close(sockets.second);
+}
@@ -0,0 +1,181 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      offload_pool.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/offload_pool.hpp"
+
+#include "net/event_result.hpp"
+#include "net/multiplexer.hpp"
+#include "net/socket_manager.hpp"
+
+#include "util/config.hpp"
+#include "util/error.hpp"
+#include "util/intrusive_ptr.hpp"
+
+#include "net_test.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace net;
+using namespace std::chrono_literals;
+
+namespace {
+
+/// Collects the jobs posted by the workers, which the test completes.
+struct dummy_multiplexer : public multiplexer {
+  util::error init(socket_manager_factory_ptr, const util::config&) override {
+    return util::none;
+  }
+
+  void start() override {
+    // nop
+  }
+
+  void shutdown() override {
+    // nop
+  }
+
+  void join() override {
+    // nop
+  }
+
+  bool running() const override { return false; }
+
+  void handle_error(const util::error& err) override {
+    FAIL() << "There should be no errors! " << err << std::endl;
+  }
+
+  util::error poll_once(bool) override { return util::none; }
+
+  void add(socket_manager_ptr, operation) override {
+    // nop
+  }
+
+  void enable(socket_manager*, operation) override {
+    // nop
+  }
+
+  void disable(socket_manager*, operation, bool) override {
+    // nop
+  }
+
+  uint64_t set_timeout(socket_manager*, time_point) override { return 0; }
+
+  void add_timeout(socket_manager*, time_point, uint64_t) override {}
+
+  bool cancel_timeout(uint64_t) override { return false; }
+
+  void post(offload_job_ptr job) override {
+    std::lock_guard<std::mutex> guard{mtx};
+    posted.emplace_back(std::move(job));
+  }
+
+  /// Completes all jobs posted so far and returns their number.
+  size_t complete_posted() {
+    std::vector<offload_job_ptr> jobs;
+    {
+      std::lock_guard<std::mutex> guard{mtx};
+      jobs.swap(posted);
+    }
+    for (auto& job : jobs)
+      job->complete();
+    return jobs.size();
+  }
+
+  /// Completes posted jobs until `n` jobs were completed in total.
+  bool await_completed(size_t n) {
+    const auto deadline = clock_type::now() + 5s;
+    while (completed < n && clock_type::now() < deadline) {
+      completed += complete_posted();
+      std::this_thread::yield();
+    }
+    return completed == n;
+  }
+
+  std::mutex mtx;
+  std::vector<offload_job_ptr> posted;
+  size_t completed = 0;
+};
+
+struct dummy_manager : public socket_manager {
+  using socket_manager::socket_manager;
+
+  util::error init(const util::config&) override { return util::none; }
+
+  event_result handle_read_event() override { return event_result::done; }
+
+  event_result handle_write_event() override { return event_result::done; }
+
+  event_result handle_timeout(uint64_t) override { return event_result::done; }
+};
+
+struct offload_pool_test : public testing::Test {
+  offload_pool_test()
+    : mgr{util::make_intrusive<dummy_manager>(invalid_socket, &mpx)} {
+    // nop
+  }
+
+  dummy_multiplexer mpx;
+  util::intrusive_ptr<dummy_manager> mgr;
+};
+
+} // namespace
+
+TEST_F(offload_pool_test, completes_on_posting_thread) {
+  static constexpr size_t num_jobs = 100;
+  offload_pool pool{2};
+  const auto self = std::this_thread::get_id();
+  std::set<std::thread::id> workers;
+  size_t num_completed = 0;
+  for (size_t i = 0; i < num_jobs; ++i)
+    pool.submit(
+      mgr.get(), [] { return std::this_thread::get_id(); },
+      [&](std::thread::id worker) {
+        EXPECT_EQ(std::this_thread::get_id(), self);
+        workers.emplace(worker);
+        ++num_completed;
+      });
+  ASSERT_TRUE(mpx.await_completed(num_jobs));
+  EXPECT_EQ(num_completed, num_jobs);
+  EXPECT_FALSE(workers.contains(self));
+  EXPECT_LE(workers.size(), 2);
+  // Completed jobs released their reference to the manager
+  EXPECT_EQ(mgr->ref_count(), 1);
+}
+
+TEST_F(offload_pool_test, idle_workers_steal_jobs) {
+  static constexpr size_t num_children = 16;
+  offload_pool pool{4};
+  std::mutex mtx;
+  std::set<std::thread::id> workers;
+  auto child = [&] {
+    std::this_thread::sleep_for(1ms);
+    std::lock_guard<std::mutex> guard{mtx};
+    workers.emplace(std::this_thread::get_id());
+  };
+  // Jobs submitted by a job are queued at its own worker
+  pool.submit(
+    mgr.get(),
+    [&] {
+      for (size_t i = 0; i < num_children; ++i)
+        pool.submit(mgr.get(), child, [] {});
+    },
+    [] {});
+  ASSERT_TRUE(mpx.await_completed(num_children + 1));
+  EXPECT_GT(workers.size(), 1);
+}
+
+TEST_F(offload_pool_test, rejects_jobs_after_stop) {
+  offload_pool pool{1};
+  pool.stop();
+  EXPECT_FALSE(pool.submit(mgr.get(), [] {}, [] {}));
+  EXPECT_EQ(mgr->ref_count(), 1);
+}
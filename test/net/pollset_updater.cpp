@@ -10,18 +10,24 @@
 
 #include "net/event_result.hpp"
 #include "net/multiplexer.hpp"
+#include "net/offload_pool.hpp"
 #include "net/operation.hpp"
-#include "net/socket/pipe_socket.hpp"
 #include "net/socket_manager.hpp"
 #include "net/socket_manager_factory.hpp"
 
-#include "util/binary_serializer.hpp"
-#include "util/byte_buffer.hpp"
 #include "util/config.hpp"
 #include "util/error.hpp"
+#include "util/error_or.hpp"
 
 #include "net_test.hpp"
 
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
 using namespace net;
 
 namespace {
@@ -44,23 +50,48 @@ struct dummy_multiplexer : public multiplexer {
   util::error poll_once(bool) override { return util::none; }
 
   void add(socket_manager_ptr mgr, operation initial) override {
-    add_called = true;
+    ++num_added;
     last_manager = mgr.get();
     initial_operation = initial;
   }
 
-  void enable(socket_manager_ptr, operation) override {}
+  void enable(socket_manager*, operation op) override {
+    enabled_operation = op;
+  }
 
-  void disable(socket_manager_ptr, operation, bool) override {}
+  void disable(socket_manager*, operation op, bool remove) override {
+    disabled_operation = op;
+    removed = remove;
+  }
 
-  uint64_t set_timeout(socket_manager_ptr,
-                       std::chrono::system_clock::time_point) override {
+  uint64_t set_timeout(socket_manager*, time_point) override {
     return 0;
   }
 
+  void add_timeout(socket_manager*, time_point when,
+                   uint64_t timeout_id) override {
+    timeout = when;
+    added_timeout_id = timeout_id;
+  }
+
+  bool cancel_timeout(uint64_t timeout_id) override {
+    cancelled_timeout_id = timeout_id;
+    return true;
+  }
+
+  void post(offload_job_ptr) override {
+    // nop
+  }
+
   util::error last_error;
   bool shutdown_called{false};
-  bool add_called{false};
+  size_t num_added{0};
+  operation enabled_operation{operation::none};
+  operation disabled_operation{operation::none};
+  bool removed{false};
+  time_point timeout{};
+  uint64_t added_timeout_id{0};
+  uint64_t cancelled_timeout_id{0};
   operation initial_operation{operation::none};
   socket_manager* last_manager{nullptr};
 };
@@ -84,66 +115,160 @@ public:
 
 struct pollset_updater_test : public ::testing::Test, public dummy_multiplexer {
   pollset_updater_test() {
-    auto pipe_res = make_pipe();
-    EXPECT_EQ(util::get_error(pipe_res), nullptr);
-    auto [reader, writer] = std::get<pipe_socket_pair>(pipe_res);
-    pipe_reader = reader;
-    pipe_writer = writer;
+    auto res = make_pollset_updater(this);
+    EXPECT_EQ(util::get_error(res), nullptr);
+    updater = std::get<pollset_updater_ptr>(res);
+    EXPECT_EQ(updater->init(util::config{}), util::none);
   }
 
-  template <class... Ts>
-  void write_to_pipe(Ts&&... ts) {
-    util::byte_buffer buf;
-    util::binary_serializer sink{buf};
-    sink(std::forward<Ts>(ts)...);
-    EXPECT_EQ(write(pipe_writer, buf), static_cast<ptrdiff_t>(buf.size()));
+  /// Checks whether the updater was woken up.
+  bool signalled() {
+    pollfd pfd{updater->handle().id, POLLIN, 0};
+    return ::poll(&pfd, 1, 0) == 1;
   }
 
-  pipe_socket pipe_reader;
-  pipe_socket pipe_writer;
+  pollset_updater_ptr updater;
 };
 
 } // namespace
 
 TEST_F(pollset_updater_test, init) {
-  pollset_updater updater{pipe_reader, this};
-  EXPECT_EQ(updater.init(util::config{}), util::none);
+  EXPECT_EQ(updater->init(util::config{}), util::none);
 }
 
 TEST_F(pollset_updater_test, handle_shutdown) {
-  pollset_updater updater{pipe_reader, this};
-  EXPECT_EQ(updater.init(util::config{}), util::none);
-  write_to_pipe(pollset_updater::shutdown_code);
-  updater.handle_read_event();
+  updater->request_shutdown();
+  EXPECT_EQ(updater->handle_read_event(), event_result::done);
   EXPECT_EQ(last_error, util::none);
   EXPECT_TRUE(shutdown_called);
 }
 
 TEST_F(pollset_updater_test, handle_add) {
-  pollset_updater updater{pipe_reader, this};
-  EXPECT_EQ(updater.init(util::config{}), util::none);
   auto mgr = util::make_intrusive<dummy_manager>(invalid_socket, this);
   mgr->ref();
   EXPECT_EQ(mgr->ref_count(), 2);
-  write_to_pipe(pollset_updater::add_code, mgr.get(), operation::read);
-  updater.handle_read_event();
+  updater->push({pollset_updater::add_code, mgr.get(), operation::read});
+  EXPECT_EQ(updater->handle_read_event(), event_result::ok);
   EXPECT_EQ(mgr->ref_count(), 1);
   EXPECT_EQ(last_error, util::none);
-  EXPECT_TRUE(add_called);
+  EXPECT_EQ(num_added, 1);
   EXPECT_EQ(last_manager, mgr.get());
   EXPECT_EQ(initial_operation, operation::read);
 }
 
+TEST_F(pollset_updater_test, handle_control_commands) {
+  auto mgr = util::make_intrusive<dummy_manager>(invalid_socket, this);
+  const auto when = clock_type::now();
+  for (size_t i = 0; i < 3; ++i)
+    mgr->ref();
+  updater->push({pollset_updater::enable_code, mgr.get(), operation::write});
+  updater->push(
+    {pollset_updater::disable_code, mgr.get(), operation::read, true});
+  updater->push({pollset_updater::set_timeout_code, mgr.get(),
+                 operation::none, false, 42, when});
+  updater->push({pollset_updater::cancel_timeout_code, nullptr,
+                 operation::none, false, 42});
+  EXPECT_EQ(updater->handle_read_event(), event_result::ok);
+  EXPECT_EQ(mgr->ref_count(), 1);
+  EXPECT_EQ(enabled_operation, operation::write);
+  EXPECT_EQ(disabled_operation, operation::read);
+  EXPECT_TRUE(removed);
+  EXPECT_EQ(timeout, when);
+  EXPECT_EQ(added_timeout_id, 42);
+  EXPECT_EQ(cancelled_timeout_id, 42);
+}
+
+TEST_F(pollset_updater_test, handle_complete) {
+  auto mgr = util::make_intrusive<dummy_manager>(invalid_socket, this);
+  bool completed = false;
+  auto job = make_offload_job(
+    mgr.get(), [] { return 42; },
+    [&completed](int result) { completed = (result == 42); });
+  job->run();
+  EXPECT_EQ(mgr->ref_count(), 2);
+  updater->push({pollset_updater::complete_code, nullptr, operation::none,
+                 false, 0, {}, job.release()});
+  EXPECT_EQ(updater->handle_read_event(), event_result::ok);
+  EXPECT_TRUE(completed);
+  // Completing the job released it along with its manager reference
+  EXPECT_EQ(mgr->ref_count(), 1);
+}
+
+TEST_F(pollset_updater_test, releases_pending_commands) {
+  auto mgr = util::make_intrusive<dummy_manager>(invalid_socket, this);
+  mgr->ref();
+  updater->push({pollset_updater::enable_code, mgr.get(), operation::write});
+  auto job = make_offload_job(mgr.get(), [] {}, [] {});
+  updater->push({pollset_updater::complete_code, nullptr, operation::none,
+                 false, 0, {}, job.release()});
+  EXPECT_EQ(mgr->ref_count(), 3);
+  updater = nullptr;
+  EXPECT_EQ(mgr->ref_count(), 1);
+}
+
+TEST_F(pollset_updater_test, drains_all_commands) {
+  static constexpr size_t num_commands = 100;
+  auto mgr = util::make_intrusive<dummy_manager>(invalid_socket, this);
+  for (size_t i = 0; i < num_commands; ++i) {
+    mgr->ref();
+    updater->push({pollset_updater::add_code, mgr.get(), operation::read});
+  }
+  EXPECT_EQ(updater->handle_read_event(), event_result::ok);
+  EXPECT_EQ(num_added, num_commands);
+  EXPECT_EQ(mgr->ref_count(), 1);
+}
+
+TEST_F(pollset_updater_test, signals_when_empty) {
+  auto mgr = util::make_intrusive<dummy_manager>(invalid_socket, this);
+  EXPECT_FALSE(signalled());
+  for (size_t i = 0; i < 3; ++i) {
+    mgr->ref();
+    updater->push({pollset_updater::add_code, mgr.get(), operation::read});
+  }
+  EXPECT_TRUE(signalled());
+#if defined(__linux__)
+  // The eventfd was only written once
+  std::uint64_t value = 0;
+  EXPECT_EQ(::read(updater->handle().id, &value, sizeof(value)),
+            static_cast<ssize_t>(sizeof(value)));
+  EXPECT_EQ(value, 1);
+#endif
+  EXPECT_EQ(updater->handle_read_event(), event_result::ok);
+  EXPECT_FALSE(signalled());
+  // Draining the queue re-enables the wakeup
+  mgr->ref();
+  updater->push({pollset_updater::add_code, mgr.get(), operation::read});
+  EXPECT_TRUE(signalled());
+  EXPECT_EQ(updater->handle_read_event(), event_result::ok);
+  EXPECT_EQ(num_added, 4);
+}
+
+TEST_F(pollset_updater_test, concurrent_producers) {
+  static constexpr size_t num_threads = 4;
+  static constexpr size_t num_commands = 10000;
+  auto mgr = util::make_intrusive<dummy_manager>(invalid_socket, this);
+  std::vector<std::thread> producers;
+  for (size_t i = 0; i < num_threads; ++i) {
+    producers.emplace_back([&] {
+      for (size_t j = 0; j < num_commands; ++j) {
+        mgr->ref();
+        updater->push({pollset_updater::add_code, mgr.get(), operation::read});
+      }
+    });
+  }
+  while (num_added < num_threads * num_commands)
+    EXPECT_EQ(updater->handle_read_event(), event_result::ok);
+  for (auto& producer : producers)
+    producer.join();
+  EXPECT_EQ(num_added, num_threads * num_commands);
+}
+
 TEST_F(pollset_updater_test, handle_write_event) {
-  pollset_updater updater{pipe_reader, this};
-  EXPECT_EQ(updater.init(util::config{}), util::none);
-  EXPECT_EQ(updater.handle_write_event(), event_result::error);
+  EXPECT_EQ(updater->handle_write_event(), event_result::error);
   EXPECT_EQ(last_error.code(), util::error_code::runtime_error);
 }
 
 TEST_F(pollset_updater_test, handle_timeout) {
-  pollset_updater updater{pipe_reader, this};
-  EXPECT_EQ(updater.init(util::config{}), util::none);
-  EXPECT_EQ(updater.handle_timeout(42), event_result::error);
+  EXPECT_EQ(updater->handle_timeout(42), event_result::error);
   EXPECT_EQ(last_error.code(), util::error_code::runtime_error);
 }
@@ -18,10 +18,12 @@
 #include "net_test.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <numeric>
 
 using namespace net;
+using namespace std::chrono_literals;
 
 namespace {
 
@@ -50,25 +52,37 @@ struct dummy_multiplexer : public multiplexer {
 
   util::error poll_once(bool) override { return util::none; }
 
+  bool is_multiplexer_thread() const override { return on_multiplexer_thread_; }
+
   void add(socket_manager_ptr, operation) override {
     // nop
   }
 
-  void enable(socket_manager_ptr mgr, operation op) override {
+  void enable(socket_manager* mgr, operation op) override {
     mgr->mask_add(op);
     last_enabled_socket_ = mgr->handle();
     last_enabled_operation_ = op;
   }
 
-  void disable(socket_manager_ptr, operation, bool) override {
+  void disable(socket_manager*, operation, bool) override {
     // nop
   }
 
-  uint64_t set_timeout(socket_manager_ptr,
-                       std::chrono::system_clock::time_point) override {
+  uint64_t set_timeout(socket_manager*, time_point when) override {
+    last_timeout_ = when;
     return 0;
   }
 
+  void add_timeout(socket_manager*, time_point, uint64_t) override {}
+
+  bool cancel_timeout(uint64_t) override { return false; }
+
+  void post(offload_job_ptr) override {
+    // nop
+  }
+
+  void set_loop_time(time_point when) { now_ = when; }
+
   void clear_last_enabled_state() {
     last_enabled_socket_ = invalid_socket;
     last_enabled_operation_ = operation::none;
@@ -77,6 +91,8 @@ struct dummy_multiplexer : public multiplexer {
   util::error last_handled_error_;
   net::socket last_enabled_socket_ = invalid_socket;
   operation last_enabled_operation_ = operation::none;
+  time_point last_timeout_;
+  bool on_multiplexer_thread_ = true;
 };
 
 // Implements all pure virtual functions from the socket_manager class
@@ -156,6 +172,19 @@ TEST_F(socket_manager_test, mask_operations) {
   ASSERT_EQ(mgr.mask(), operation::none);
 }
 
+TEST_F(socket_manager_test, dirty_marks) {
+  dummy_manager mgr{sockets.first, &mpx};
+  EXPECT_FALSE(mgr.dirty());
+  // Only the first change records the mask known to the pollset
+  EXPECT_TRUE(mgr.mark_dirty(operation::read));
+  EXPECT_FALSE(mgr.mark_dirty(operation::read_write));
+  EXPECT_TRUE(mgr.dirty());
+  EXPECT_EQ(mgr.clear_dirty(), operation::read);
+  EXPECT_FALSE(mgr.dirty());
+  EXPECT_TRUE(mgr.mark_dirty(operation::write));
+  EXPECT_EQ(mgr.clear_dirty(), operation::write);
+}
+
 TEST_F(socket_manager_test, register_operations) {
   dummy_manager mgr{sockets.first, &mpx};
   mgr.register_writing();
@@ -184,3 +213,15 @@ TEST_F(socket_manager_test, handle_error) {
   mgr.handle_error(err);
   ASSERT_EQ(mpx.last_handled_error_, err);
 }
+
+TEST_F(socket_manager_test, set_timeout_in) {
+  dummy_manager mgr{sockets.first, &mpx};
+  mpx.set_loop_time(multiplexer::time_point{});
+  mgr.set_timeout_in(10ms);
+  ASSERT_EQ(mpx.last_timeout_, multiplexer::time_point{} + 10ms);
+  // Other threads do not use the loop time of the multiplexer
+  mpx.on_multiplexer_thread_ = false;
+  const auto before = multiplexer::clock_type::now();
+  mgr.set_timeout_in(10ms);
+  ASSERT_GE(mpx.last_timeout_, before + 10ms);
+}
@@ -16,6 +16,7 @@
 #include "util/byte_span.hpp"
 #include "util/config.hpp"
 #include "util/error.hpp"
+#include "util/shared_buffer.hpp"
 
 #include "net_test.hpp"
 
@@ -23,6 +24,7 @@
 #include <cstring>
 #include <numeric>
 #include <thread>
+#include <vector>
 
 using namespace net;
 
@@ -47,8 +49,12 @@ struct dummy_multiplexer : public multiplexer {
 
   bool running() const override { return false; }
 
+  bool is_multiplexer_thread() const override { return on_multiplexer_thread; }
+
   void handle_error(const util::error& err) override {
-    FAIL() << "There should be no errors! " << err << std::endl;
+    if (!expect_errors)
+      FAIL() << "There should be no errors! " << err << std::endl;
+    last_error = err;
   }
 
   util::error poll_once(bool) override { return util::none; }
@@ -57,18 +63,31 @@ struct dummy_multiplexer : public multiplexer {
     // nop
   }
 
-  void enable(socket_manager_ptr, operation) override {
-    // nop
+  void enable(socket_manager*, operation op) override {
+    if ((op & operation::write) == operation::write)
+      ++num_write_enables;
   }
 
-  void disable(socket_manager_ptr, operation, bool) override {
+  void disable(socket_manager*, operation, bool) override {
     // nop
   }
 
-  uint64_t set_timeout(socket_manager_ptr,
-                       std::chrono::system_clock::time_point) override {
+  uint64_t set_timeout(socket_manager*, time_point) override {
     return 0;
   }
+
+  void add_timeout(socket_manager*, time_point, uint64_t) override {}
+
+  bool cancel_timeout(uint64_t) override { return false; }
+
+  void post(offload_job_ptr) override {
+    // nop
+  }
+
+  size_t num_write_enables = 0;
+  bool on_multiplexer_thread = true;
+  bool expect_errors = false;
+  util::error last_error;
 };
 
 struct dummy_application {
@@ -109,6 +128,55 @@ private:
 
 using manager_type = stream_transport<dummy_application>;
 
+/// Consumes frames of `frame_size` bytes, leaving partial frames buffered.
+struct framing_application {
+  static constexpr size_t frame_size = 3;
+
+  framing_application(transport& parent, std::vector<size_t>& frame_sizes,
+                      util::byte_buffer& received)
+    : frame_sizes_(frame_sizes), received_(received), parent_(parent) {
+    // nop
+  }
+
+  util::error init(const util::config&) {
+    parent_.configure_next_read(receive_policy::up_to(8));
+    return util::none;
+  }
+
+  event_result produce() { return event_result::ok; }
+
+  bool has_more_data() { return false; }
+
+  std::ptrdiff_t consume(util::const_byte_span data) {
+    if (data.size() < frame_size)
+      return 0;
+    frame_sizes_.push_back(data.size());
+    received_.insert(received_.end(), data.begin(),
+                     data.begin() + frame_size);
+    return frame_size;
+  }
+
+  static event_result handle_timeout(uint64_t) { return event_result::ok; }
+
+private:
+  std::vector<size_t>& frame_sizes_;
+  util::byte_buffer& received_;
+
+  transport& parent_;
+};
+
+/// Claims to have used more data than it received.
+struct overconsuming_application : framing_application {
+  using framing_application::framing_application;
+
+  std::ptrdiff_t consume(util::const_byte_span data) {
+    return static_cast<std::ptrdiff_t>(data.size()) + 1;
+  }
+};
+
+static_assert(event_layer<dummy_application>);
+static_assert(framing_layer<framing_application>);
+
 struct stream_transport_test : public testing::Test {
   stream_transport_test()
     : sockets{stream_socket{invalid_socket_id},
@@ -116,6 +184,7 @@ struct stream_transport_test : public testing::Test {
     auto socket_res = make_stream_socket_pair();
     EXPECT_EQ(get_error(socket_res), nullptr);
     sockets = std::get<stream_socket_pair>(socket_res);
+    EXPECT_TRUE(nonblocking(sockets.first, true));
     uint8_t b = 0;
     for (auto& val :
          std::span{reinterpret_cast<uint8_t*>(data.data()), data.size()})
@@ -183,3 +252,179 @@ TEST_F(stream_transport_test, disconnect) {
   close(sockets.second);
   EXPECT_EQ(mgr.handle_read_event(), event_result::error);
 }
+
+TEST_F(stream_transport_test, register_writing) {
+  manager_type mgr(sockets.first, &mpx, std::span{data}, received_data);
+  ASSERT_EQ(mgr.init(util::config{}), util::none);
+  mgr.register_writing();
+  EXPECT_EQ(mpx.num_write_enables, 1);
+}
+
+TEST_F(stream_transport_test, write_through) {
+  util::config cfg;
+  cfg.add_config_entry("transport.write-through", true);
+  util::byte_array<1024> buf;
+  manager_type mgr(sockets.first, &mpx, std::span{data}.first(buf.size()),
+                   received_data);
+  ASSERT_EQ(mgr.init(cfg), util::none);
+  mgr.register_writing();
+  EXPECT_EQ(mpx.num_write_enables, 0);
+  ASSERT_EQ(read(sockets.second, buf), buf.size());
+  EXPECT_EQ(memcmp(data.data(), buf.data(), buf.size()), 0);
+}
+
+TEST_F(stream_transport_test, write_through_partial_write) {
+  util::config cfg;
+  cfg.add_config_entry("transport.write-through", true);
+  cfg.add_config_entry("transport.max-consecutive-writes", std::int64_t{1});
+  manager_type mgr(sockets.first, &mpx, std::span{data}, received_data);
+  ASSERT_EQ(mgr.init(cfg), util::none);
+  mgr.register_writing();
+  EXPECT_EQ(mpx.num_write_enables, 1);
+}
+
+TEST_F(stream_transport_test, write_through_from_other_thread) {
+  util::config cfg;
+  cfg.add_config_entry("transport.write-through", true);
+  manager_type mgr(sockets.first, &mpx, std::span{data}.first(1024),
+                   received_data);
+  ASSERT_EQ(mgr.init(cfg), util::none);
+  mpx.on_multiplexer_thread = false;
+  // Only the multiplexer thread may touch the write queue and the socket
+  mgr.register_writing();
+  EXPECT_EQ(mpx.num_write_enables, 1);
+  util::byte_array<1024> buf;
+  ASSERT_TRUE(nonblocking(sockets.second, true));
+  EXPECT_LT(read(sockets.second, buf), 0);
+}
+
+TEST_F(stream_transport_test, write_through_error) {
+  util::config cfg;
+  cfg.add_config_entry("transport.write-through", true);
+  manager_type mgr(sockets.first, &mpx, std::span{data}.first(1024),
+                   received_data);
+  ASSERT_EQ(mgr.init(cfg), util::none);
+  close(sockets.second);
+  mpx.expect_errors = true;
+  mgr.register_writing();
+  EXPECT_NE(mpx.last_error, util::none);
+  EXPECT_EQ(mpx.num_write_enables, 0);
+}
+
+TEST_F(stream_transport_test, enqueue_keeps_order) {
+  manager_type mgr(sockets.first, &mpx, util::const_byte_span{},
+                   received_data);
+  ASSERT_EQ(mgr.init(util::config{}), util::none);
+  const auto bytes = std::span{data}.first(1024);
+  bool done = false;
+  // Copied, owned, borrowed, and copied data is sent in the order it was
+  // enqueued
+  mgr.enqueue(bytes.first(256));
+  mgr.enqueue(util::byte_buffer(bytes.begin() + 256, bytes.begin() + 512));
+  mgr.enqueue(bytes.subspan(512, 256), [&done] { done = true; });
+  mgr.enqueue(bytes.subspan(768));
+  EXPECT_EQ(mgr.handle_write_event(), event_result::done);
+  EXPECT_TRUE(done);
+  util::byte_array<1024> buf;
+  ASSERT_EQ(read(sockets.second, buf), buf.size());
+  EXPECT_EQ(memcmp(bytes.data(), buf.data(), buf.size()), 0);
+}
+
+TEST_F(stream_transport_test, enqueue_shared_slice) {
+  auto res = make_stream_socket_pair();
+  ASSERT_EQ(get_error(res), nullptr);
+  auto other = std::get<stream_socket_pair>(res);
+  manager_type first(sockets.first, &mpx, util::const_byte_span{},
+                     received_data);
+  manager_type second(other.first, &mpx, util::const_byte_span{},
+                      received_data);
+  ASSERT_EQ(first.init(util::config{}), util::none);
+  ASSERT_EQ(second.init(util::config{}), util::none);
+  // The same frame is sent to both sockets without copying it
+  const auto slice = util::make_shared_slice(
+    util::const_byte_span{std::span{data}.first(1024)});
+  first.enqueue(slice);
+  second.enqueue(slice);
+  EXPECT_EQ(slice.buffer()->ref_count(), 3);
+  EXPECT_EQ(first.handle_write_event(), event_result::done);
+  EXPECT_EQ(second.handle_write_event(), event_result::done);
+  EXPECT_EQ(slice.buffer()->ref_count(), 1);
+  for (auto sock : {sockets.second, other.second}) {
+    util::byte_array<1024> buf;
+    ASSERT_EQ(read(sock, buf), buf.size());
+    EXPECT_EQ(memcmp(data.data(), buf.data(), buf.size()), 0);
+  }
+  close(other.second);
+}
+
+TEST_F(stream_transport_test, partial_frames_stay_buffered) {
+  std::vector<size_t> sizes;
+  stream_transport<framing_application> mgr(sockets.first, &mpx, sizes,
+                                             received_data);
+  ASSERT_EQ(mgr.init(util::config{}), util::none);
+  // The first read ends in the middle of the third frame, which is completed
+  // after the buffer was compacted
+  ASSERT_EQ(write(sockets.second, std::span{data}.first(8)), 8);
+  EXPECT_EQ(mgr.handle_read_event(), event_result::ok);
+  EXPECT_EQ(sizes, (std::vector<size_t>{8, 5}));
+  ASSERT_EQ(write(sockets.second, std::span{data}.subspan(8, 4)), 4);
+  EXPECT_EQ(mgr.handle_read_event(), event_result::ok);
+  EXPECT_EQ(sizes, (std::vector<size_t>{8, 5, 6, 3}));
+  ASSERT_EQ(received_data.size(), 12);
+  EXPECT_EQ(memcmp(data.data(), received_data.data(), 12), 0);
+}
+
+TEST_F(stream_transport_test, overconsumption_is_an_error) {
+  std::vector<size_t> sizes;
+  stream_transport<overconsuming_application> mgr(sockets.first, &mpx, sizes,
+                                                  received_data);
+  ASSERT_EQ(mgr.init(util::config{}), util::none);
+  ASSERT_EQ(write(sockets.second, std::span{data}.first(8)), 8);
+  mpx.expect_errors = true;
+  EXPECT_EQ(mgr.handle_read_event(), event_result::error);
+  EXPECT_NE(mpx.last_error, util::none);
+}
+
+TEST_F(stream_transport_test, pooled_buffers) {
+  util::config cfg;
+  cfg.add_config_entry("transport.pooled-buffers", true);
+  manager_type mgr(sockets.first, &mpx, std::span{data}.first(2048),
+                   received_data);
+  ASSERT_EQ(mgr.init(cfg), util::none);
+  // Buffers are only borrowed while there is data to read or write
+  util::byte_array<1024> buf;
+  ASSERT_EQ(write(sockets.second, buf), buf.size());
+  EXPECT_EQ(mgr.handle_read_event(), event_result::ok);
+  EXPECT_EQ(received_data.size(), buf.size());
+  EXPECT_EQ(mpx.buffers().num_cached(), 1);
+  EXPECT_EQ(mgr.handle_write_event(), event_result::done);
+  EXPECT_EQ(mpx.buffers().num_cached(), 2);
+  util::byte_array<2048> sent;
+  ASSERT_EQ(read(sockets.second, sent), sent.size());
+  EXPECT_EQ(memcmp(data.data(), sent.data(), sent.size()), 0);
+}
+
+TEST_F(stream_transport_test, scratch_reads) {
+  util::config cfg;
+  cfg.add_config_entry("transport.scratch-reads", true);
+  cfg.add_config_entry("transport.pooled-buffers", true);
+  std::vector<size_t> sizes;
+  stream_transport<framing_application> mgr(sockets.first, &mpx, sizes,
+                                             received_data);
+  ASSERT_EQ(mgr.init(cfg), util::none);
+  // Complete frames are consumed from the scratch buffer
+  ASSERT_EQ(write(sockets.second, std::span{data}.first(6)), 6);
+  EXPECT_EQ(mgr.handle_read_event(), event_result::ok);
+  EXPECT_EQ(sizes, (std::vector<size_t>{6, 3}));
+  EXPECT_EQ(mpx.buffers().num_cached(), 0);
+  // Only the start of the incomplete frame is copied into the read_buffer
+  ASSERT_EQ(write(sockets.second, std::span{data}.subspan(6, 8)), 8);
+  EXPECT_EQ(mgr.handle_read_event(), event_result::ok);
+  EXPECT_EQ(sizes, (std::vector<size_t>{6, 3, 8, 5}));
+  ASSERT_EQ(write(sockets.second, std::span{data}.subspan(14, 4)), 4);
+  EXPECT_EQ(mgr.handle_read_event(), event_result::ok);
+  EXPECT_EQ(sizes, (std::vector<size_t>{6, 3, 8, 5, 6, 3}));
+  EXPECT_EQ(mpx.buffers().num_cached(), 1);
+  ASSERT_EQ(received_data.size(), 18);
+  EXPECT_EQ(memcmp(data.data(), received_data.data(), 18), 0);
+}
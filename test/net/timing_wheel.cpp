@@ -0,0 +1,152 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      timing_wheel.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/timing_wheel.hpp"
+
+#include "net_test.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+using namespace net;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct timing_wheel_test : public testing::Test {
+  /// Advances the wheel to `now` and returns the ids of all due timeouts.
+  std::vector<std::uint64_t> expire(timing_wheel::time_point now) {
+    wheel.advance(now);
+    std::vector<std::uint64_t> ids;
+    while (auto timeout = wheel.pop())
+      ids.push_back(timeout->id);
+    return ids;
+  }
+
+  timing_wheel wheel;
+  const timing_wheel::time_point start = timing_wheel::clock_type::now();
+};
+
+using id_list = std::vector<std::uint64_t>;
+
+} // namespace
+
+TEST_F(timing_wheel_test, expires_in_order) {
+  const auto first = wheel.add(1, start + 30ms);
+  const auto second = wheel.add(2, start + 10ms);
+  const auto third = wheel.add(3, start + 20ms);
+  EXPECT_EQ(wheel.size(), 3);
+  EXPECT_EQ(expire(start + 5ms), id_list{});
+  EXPECT_EQ(expire(start + 20ms), (id_list{second, third}));
+  EXPECT_EQ(expire(start + 30ms), id_list{first});
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST_F(timing_wheel_test, same_deadline) {
+  id_list ids;
+  for (std::uint64_t i = 0; i < 5; ++i)
+    ids.push_back(wheel.add(1, start + 10ms));
+  EXPECT_EQ(expire(start + 10ms), ids);
+}
+
+TEST_F(timing_wheel_test, past_deadline) {
+  const auto id = wheel.add(1, start - 1s);
+  EXPECT_EQ(expire(start), id_list{id});
+}
+
+TEST_F(timing_wheel_test, cancel) {
+  const auto first = wheel.add(1, start + 10ms);
+  const auto second = wheel.add(2, start + 10ms);
+  EXPECT_TRUE(wheel.cancel(first));
+  EXPECT_FALSE(wheel.cancel(first));
+  EXPECT_EQ(wheel.size(), 1);
+  EXPECT_EQ(expire(start + 10ms), id_list{second});
+  EXPECT_FALSE(wheel.cancel(second));
+}
+
+TEST_F(timing_wheel_test, cancel_due) {
+  const auto first = wheel.add(1, start + 10ms);
+  const auto second = wheel.add(2, start + 10ms);
+  wheel.advance(start + 10ms);
+  EXPECT_TRUE(wheel.cancel(second));
+  auto timeout = wheel.pop();
+  ASSERT_TRUE(timeout.has_value());
+  EXPECT_EQ(timeout->id, first);
+  EXPECT_EQ(timeout->handle, 1);
+  EXPECT_FALSE(wheel.pop().has_value());
+}
+
+TEST_F(timing_wheel_test, cancel_all) {
+  wheel.add(1, start + 10ms);
+  const auto other = wheel.add(2, start + 10ms);
+  wheel.add(1, start + 20ms);
+  wheel.add(1, start + 5ms);
+  wheel.advance(start + 5ms);
+  // Due timeouts of the handle are cancelled as well
+  EXPECT_EQ(wheel.cancel_all(1), 3);
+  EXPECT_EQ(wheel.cancel_all(1), 0);
+  EXPECT_EQ(wheel.size(), 1);
+  EXPECT_EQ(expire(start + 20ms), id_list{other});
+  const auto next = wheel.add(1, start + 30ms);
+  EXPECT_EQ(expire(start + 30ms), id_list{next});
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST_F(timing_wheel_test, reused_nodes_get_new_ids) {
+  const auto first = wheel.add(1, start + 10ms);
+  EXPECT_TRUE(wheel.cancel(first));
+  // The next timeout reuses the node of the first one
+  const auto second = wheel.add(1, start + 10ms);
+  EXPECT_NE(second, first);
+  EXPECT_FALSE(wheel.cancel(first));
+  EXPECT_FALSE(wheel.cancel(timing_wheel::invalid_id));
+  EXPECT_EQ(expire(start + 10ms), id_list{second});
+  EXPECT_FALSE(wheel.cancel(second));
+}
+
+TEST_F(timing_wheel_test, reserved_ids) {
+  const auto reserved = timing_wheel::reserved_id | 42;
+  wheel.add(1, start + 10ms, reserved);
+  const auto other = wheel.add(1, start + 20ms);
+  EXPECT_EQ(wheel.size(), 2);
+  EXPECT_TRUE(wheel.cancel(reserved));
+  EXPECT_FALSE(wheel.cancel(reserved));
+  wheel.add(2, start + 10ms, reserved);
+  EXPECT_EQ(expire(start + 20ms), (id_list{reserved, other}));
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST_F(timing_wheel_test, cascades_upper_levels) {
+  const std::vector<std::chrono::milliseconds> durations{300ms, 1min, 5h,
+                                                        1000h, 100000h};
+  id_list ids;
+  for (auto duration : durations)
+    ids.push_back(wheel.add(1, start + duration));
+  for (size_t i = 0; i < durations.size(); ++i) {
+    EXPECT_EQ(expire(start + durations[i] - 1ms), id_list{});
+    EXPECT_EQ(expire(start + durations[i]), id_list{ids[i]});
+  }
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST_F(timing_wheel_test, next_expiry) {
+  EXPECT_FALSE(wheel.next_expiry().has_value());
+  wheel.add(1, start + 10ms);
+  auto next = wheel.next_expiry();
+  ASSERT_TRUE(next.has_value());
+  EXPECT_LE(*next, start + 10ms);
+  EXPECT_GT(*next, start + 9ms);
+  // Far timeouts wake the wheel up for cascading before they expire
+  wheel.add(1, start + 1h);
+  expire(start + 10ms);
+  next = wheel.next_expiry();
+  ASSERT_TRUE(next.has_value());
+  EXPECT_LE(*next, start + 1h);
+  EXPECT_GT(*next, start + 10ms);
+}
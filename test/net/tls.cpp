@@ -7,11 +7,9 @@
  */
 
 #include "net/tls.hpp"
-#include "net/layer.hpp"
 #include "net/multiplexer.hpp"
 #include "net/stream_transport.hpp"
 #include "net/transport.hpp"
-#include "net/transport_adaptor.hpp"
 
 #include "util/config.hpp"
 #include "util/error.hpp"
@@ -71,18 +69,25 @@ struct dummy_multiplexer : public multiplexer {
     // nop
   }
 
-  void enable(socket_manager_ptr, operation) override {
+  void enable(socket_manager*, operation) override {
     // nop
   }
 
-  void disable(socket_manager_ptr, operation, bool) override {
+  void disable(socket_manager*, operation, bool) override {
     // nop
   }
 
-  uint64_t set_timeout(socket_manager_ptr,
-                       std::chrono::system_clock::time_point) override {
+  uint64_t set_timeout(socket_manager*, time_point) override {
     return 0;
   }
+
+  void add_timeout(socket_manager*, time_point, uint64_t) override {}
+
+  bool cancel_timeout(uint64_t) override { return false; }
+
+  void post(offload_job_ptr) override {
+    // nop
+  }
 };
 
 template <class NextLayer>
@@ -158,13 +163,14 @@ private:
 
 // -- Dummy application layer --------------------------------------------------
 
+template <class Parent>
 struct dummy_application {
-  dummy_application(layer& parent, application_vars& vars)
+  dummy_application(Parent& parent, application_vars& vars)
     : parent_(parent), vars_{vars} {
     // nop
   }
 
-  util::error init() {
+  util::error init(const util::config&) {
     vars_.initialized = true;
     return util::none;
   }
@@ -191,12 +197,12 @@ struct dummy_application {
   }
 
 private:
-  layer& parent_;
+  Parent& parent_;
   application_vars& vars_;
 };
 
 struct tls_test : public testing::Test {
-  using stack_type = dummy_transport<transport_adaptor<tls<dummy_application>>>;
+  using stack_type = dummy_transport<tls<dummy_application>>;
 
   tls_test() {
     auto maybe_sockets = make_stream_socket_pair();
@@ -259,11 +265,11 @@ TEST_F(tls_test, roundtrip) {
   EXPECT_NO_ERROR(server.init(util::config{}));
 
   // Handle the handshake between both peers
-  EXPECT_FALSE(client.next_layer().next_layer().handshake_done());
-  EXPECT_FALSE(server.next_layer().next_layer().handshake_done());
+  EXPECT_FALSE(client.next_layer().handshake_done());
+  EXPECT_FALSE(server.next_layer().handshake_done());
   handle_handshake(client, server);
-  ASSERT_TRUE(client.next_layer().next_layer().handshake_done());
-  ASSERT_TRUE(server.next_layer().next_layer().handshake_done());
+  ASSERT_TRUE(client.next_layer().handshake_done());
+  ASSERT_TRUE(server.next_layer().handshake_done());
 
   // Transmit data from client to server and check result
   transmit_between(client, server);
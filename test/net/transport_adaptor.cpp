@@ -7,7 +7,6 @@
  */
 
 #include "net/transport_adaptor.hpp"
-#include "net/layer.hpp"
 #include "net/receive_policy.hpp"
 #include "net/stream_transport.hpp"
 #include "net/transport.hpp"
@@ -102,8 +101,9 @@ private:
 
 // -- Dummy application layer --------------------------------------------------
 
+template <class Parent>
 struct dummy_application {
-  dummy_application(layer& parent, application_vars& vars)
+  dummy_application(Parent& parent, application_vars& vars)
     : parent_(parent), vars_{vars} {
     // nop
   }
@@ -135,7 +135,7 @@ struct dummy_application {
   }
 
 private:
-  layer& parent_;
+  Parent& parent_;
   application_vars& vars_;
 };
 
@@ -0,0 +1,193 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      uring_stream_transport.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/uring_stream_transport.hpp"
+
+#include "net/receive_policy.hpp"
+#include "net/socket/stream_socket.hpp"
+#include "net/socket_manager_factory.hpp"
+#include "net/uring_multiplexer.hpp"
+
+#include "util/byte_array.hpp"
+#include "util/byte_span.hpp"
+#include "util/config.hpp"
+#include "util/error.hpp"
+#include "util/intrusive_ptr.hpp"
+
+#include "net_test.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+using namespace net;
+using namespace std::chrono_literals;
+
+namespace {
+
+struct dummy_application {
+  dummy_application(transport& parent, util::const_byte_span data,
+                    util::byte_buffer& received)
+    : received_(received), data_(data), parent_(parent) {
+    // nop
+  }
+
+  util::error init(const util::config&) {
+    parent_.configure_next_read(receive_policy::exactly(1024));
+    return util::none;
+  }
+
+  event_result produce() {
+    auto size = std::min(size_t{1024}, data_.size());
+    parent_.enqueue({data_.data(), size});
+    data_ = data_.subspan(size);
+    return event_result::ok;
+  }
+
+  bool has_more_data() { return !data_.empty(); }
+
+  event_result consume(util::const_byte_span data) {
+    EXPECT_EQ(data.size(), 1024);
+    received_.insert(received_.end(), data.begin(), data.end());
+    parent_.configure_next_read(receive_policy::exactly(1024));
+    return event_result::ok;
+  }
+
+  static event_result handle_timeout(uint64_t) { return event_result::ok; }
+
+private:
+  util::byte_buffer& received_;
+  util::const_byte_span data_;
+
+  transport& parent_;
+};
+
+using manager_type = uring_stream_transport<dummy_application>;
+
+struct socket_manager_factory_stub : public socket_manager_factory {
+  socket_manager_ptr make(net::socket, multiplexer*) override {
+    return nullptr;
+  }
+};
+
+struct uring_stream_transport_test : public testing::Test {
+  uring_stream_transport_test()
+    : sockets{stream_socket{invalid_socket_id},
+              stream_socket{invalid_socket_id}} {
+    EXPECT_EQ(mpx.init(std::make_shared<socket_manager_factory_stub>(), cfg),
+              util::none);
+    mpx.set_thread_id(std::this_thread::get_id());
+    default_num_socket_managers = mpx.num_socket_managers();
+    auto socket_res = make_stream_socket_pair();
+    EXPECT_EQ(get_error(socket_res), nullptr);
+    sockets = std::get<stream_socket_pair>(socket_res);
+    uint8_t b = 0;
+    for (auto& val :
+         std::span{reinterpret_cast<uint8_t*>(data.data()), data.size()})
+      val = b++;
+  }
+
+  void poll_until(auto predicate) {
+    // Bounded by time, the writer thread may lag behind arbitrarily
+    const auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (!predicate() && (std::chrono::steady_clock::now() < deadline))
+      ASSERT_EQ(mpx.poll_once(false), util::none);
+    ASSERT_TRUE(predicate());
+  }
+
+  // The multiplexer keeps a reference to its config
+  util::config cfg;
+  uring_multiplexer mpx;
+  uint16_t default_num_socket_managers = 0;
+  stream_socket_pair sockets;
+  util::byte_array<262144> data;
+
+  util::byte_buffer received_data;
+};
+
+} // namespace
+
+TEST_F(uring_stream_transport_test, receive_from_buffer_ring) {
+  util::const_byte_span nothing;
+  mpx.add(util::make_intrusive<manager_type>(sockets.first, &mpx, nothing,
+                                             received_data),
+          operation::read);
+  std::thread writer([this] {
+    util::const_byte_span remaining{data};
+    while (!remaining.empty()) {
+      const auto res = write(sockets.second, remaining);
+      ASSERT_GT(res, 0);
+      remaining = remaining.subspan(res);
+    }
+  });
+  poll_until([this] { return received_data.size() == data.size(); });
+  writer.join();
+  EXPECT_TRUE(
+    std::equal(received_data.begin(), received_data.end(), data.begin()));
+}
+
+TEST_F(uring_stream_transport_test, disable_reading) {
+  util::const_byte_span nothing;
+  auto mgr = util::make_intrusive<manager_type>(sockets.first, &mpx, nothing,
+                                                received_data);
+  mpx.add(mgr, operation::read);
+  ASSERT_EQ(mpx.poll_once(false), util::none);
+  // Disabling reading cancels the multishot recv, data stays in the socket
+  mpx.disable(mgr.get(), operation::read, false);
+  for (size_t i = 0; i < 10; ++i)
+    ASSERT_EQ(mpx.poll_once(false), util::none);
+  ASSERT_EQ(write(sockets.second, std::span{data}.first(1024)), 1024);
+  for (size_t i = 0; i < 100; ++i)
+    ASSERT_EQ(mpx.poll_once(false), util::none);
+  EXPECT_TRUE(received_data.empty());
+  mpx.enable(mgr.get(), operation::read);
+  poll_until([this] { return received_data.size() == 1024; });
+  EXPECT_TRUE(std::equal(received_data.begin(), received_data.end(),
+                         data.begin()));
+}
+
+TEST_F(uring_stream_transport_test, linked_sends) {
+  auto mgr = util::make_intrusive<manager_type>(sockets.first, &mpx,
+                                                std::span{data}, received_data);
+  mpx.add(mgr, operation::read);
+  mgr->register_writing();
+  ASSERT_TRUE(nonblocking(sockets.second, true));
+  util::byte_buffer buf(data.size());
+  size_t received = 0;
+  poll_until([&] {
+    const auto res = read(sockets.second,
+                          std::span{buf.data() + received,
+                                    buf.size() - received});
+    if (res > 0)
+      received += res;
+    return received == data.size();
+  });
+  EXPECT_EQ(std::memcmp(buf.data(), data.data(), data.size()), 0);
+  poll_until([&] { return mgr->mask() == operation::read; });
+}
+
+TEST_F(uring_stream_transport_test, disconnect) {
+  util::const_byte_span nothing;
+  mpx.add(util::make_intrusive<manager_type>(sockets.first, &mpx, nothing,
+                                             received_data),
+          operation::read);
+  EXPECT_EQ(mpx.num_socket_managers(), default_num_socket_managers + 1);
+  close(sockets.second);
+  poll_until([this] {
+    return mpx.num_socket_managers() == default_num_socket_managers;
+  });
+}
+
+TEST(uring_stream_transport, requires_uring_multiplexer) {
+  util::byte_buffer received_data;
+  manager_type mgr(stream_socket{invalid_socket_id}, nullptr,
+                   util::const_byte_span{}, received_data);
+  EXPECT_NE(mgr.init(util::config{}), util::none);
+}
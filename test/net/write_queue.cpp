@@ -0,0 +1,119 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      write_queue.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "net/write_queue.hpp"
+
+#include "net/socket/stream_socket.hpp"
+
+#include "util/byte_array.hpp"
+#include "util/byte_buffer.hpp"
+#include "util/byte_span.hpp"
+#include "util/error.hpp"
+#include "util/error_or.hpp"
+#include "util/intrusive_ptr.hpp"
+#include "util/ref_counted.hpp"
+
+#include "net_test.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+using namespace net;
+
+namespace {
+
+struct shared_bytes : public util::ref_counted {
+  util::byte_buffer data;
+};
+
+util::byte_buffer make_bytes(std::size_t size, std::uint8_t first) {
+  util::byte_buffer buf(size);
+  for (auto& b : buf)
+    b = std::byte{first++};
+  return buf;
+}
+
+struct write_queue_test : public testing::Test {
+  write_queue_test() {
+    auto res = make_stream_socket_pair();
+    EXPECT_EQ(get_error(res), nullptr);
+    sockets = std::get<stream_socket_pair>(res);
+  }
+
+  ~write_queue_test() override {
+    close(sockets.first);
+    close(sockets.second);
+  }
+
+  stream_socket_pair sockets{invalid_socket_id, invalid_socket_id};
+  write_queue queue;
+};
+
+} // namespace
+
+TEST_F(write_queue_test, writes_all_segment_kinds_in_order) {
+  const auto owned = make_bytes(16, 0);
+  auto shared = util::make_intrusive<shared_bytes>();
+  shared->data = make_bytes(32, 16);
+  const auto borrowed = make_bytes(8, 48);
+  bool done = false;
+  queue.push(util::byte_buffer{owned});
+  queue.push(shared, shared->data);
+  queue.push(borrowed, [&done] { done = true; });
+  EXPECT_EQ(queue.num_segments(), 3);
+  EXPECT_EQ(queue.size(), 56);
+  EXPECT_EQ(shared->ref_count(), 2);
+  ASSERT_EQ(queue.write(sockets.first), 56);
+  EXPECT_TRUE(queue.empty());
+  EXPECT_TRUE(done);
+  EXPECT_EQ(shared->ref_count(), 1);
+  util::byte_array<56> buf;
+  ASSERT_EQ(read(sockets.second, buf), buf.size());
+  const auto expected = make_bytes(56, 0);
+  EXPECT_TRUE(std::equal(buf.begin(), buf.end(), expected.begin()));
+}
+
+TEST_F(write_queue_test, partial_writes_keep_segments_in_place) {
+  const auto borrowed = make_bytes(16, 0);
+  size_t num_done = 0;
+  queue.push(borrowed, [&num_done] { ++num_done; });
+  queue.push(make_bytes(16, 16));
+  queue.consume(10);
+  EXPECT_EQ(queue.size(), 22);
+  EXPECT_EQ(num_done, 0);
+  queue.consume(6);
+  EXPECT_EQ(queue.num_segments(), 1);
+  EXPECT_EQ(num_done, 1);
+  queue.consume(4);
+  util::byte_buffer rest;
+  queue.move_to(rest);
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(rest, make_bytes(12, 20));
+}
+
+TEST_F(write_queue_test, clear_releases_borrowed_segments) {
+  const auto borrowed = make_bytes(16, 0);
+  bool done = false;
+  queue.push(borrowed, [&done] { done = true; });
+  queue.clear();
+  EXPECT_TRUE(done);
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(queue.size(), 0);
+}
+
+TEST_F(write_queue_test, reuses_written_buffers) {
+  auto buf = make_bytes(64, 0);
+  const auto* storage = buf.data();
+  queue.push(std::move(buf));
+  ASSERT_EQ(queue.write(sockets.first), 64);
+  const auto spare = queue.take_spare();
+  EXPECT_TRUE(spare.empty());
+  EXPECT_EQ(spare.data(), storage);
+  EXPECT_EQ(queue.take_spare().capacity(), 0);
+}
@@ -65,6 +65,15 @@ TEST(config, add_config_entry) {
     EXPECT_EQ(dict.at(p.first), p.second);
 }
 
+TEST(config, set_config_entry) {
+  util::config cfg = create_sample_config();
+  cfg.add_config_entry(key3, std::int64_t{42});
+  EXPECT_EQ(cfg.get_or(key3, std::int64_t{0}), 123456789);
+  cfg.set_config_entry(key3, std::int64_t{42});
+  EXPECT_EQ(cfg.get_or(key3, std::int64_t{0}), 42);
+  EXPECT_EQ(cfg.get_entries().size(), sample_entries.size());
+}
+
 TEST(config, get) {
   const util::config cfg = create_sample_config();
 
@@ -0,0 +1,86 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      default_init_allocator.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "util/default_init_allocator.hpp"
+
+#include "util/binary_serializer.hpp"
+#include "util/byte_buffer.hpp"
+
+#include "net_test.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+constexpr auto pattern = std::byte{0xAB};
+
+/// Fills newly allocated memory with `pattern`.
+template <class T>
+struct pattern_allocator : std::allocator<T> {
+  template <class U>
+  struct rebind {
+    using other = pattern_allocator<U>;
+  };
+
+  pattern_allocator() = default;
+
+  template <class U>
+  pattern_allocator(const pattern_allocator<U>&) noexcept {
+    // nop
+  }
+
+  T* allocate(std::size_t n) {
+    auto ptr = std::allocator<T>::allocate(n);
+    std::memset(static_cast<void*>(ptr), static_cast<int>(pattern),
+                n * sizeof(T));
+    return ptr;
+  }
+};
+
+bool all_of_pattern(const auto& buf) {
+  return std::all_of(buf.begin(), buf.end(),
+                     [](std::byte b) { return b == pattern; });
+}
+
+} // namespace
+
+TEST(default_init_allocator, resize_leaves_memory_untouched) {
+  std::vector<std::byte, pattern_allocator<std::byte>> zeroed;
+  zeroed.resize(64);
+  EXPECT_TRUE(std::all_of(zeroed.begin(), zeroed.end(),
+                          [](std::byte b) { return b == std::byte{0}; }));
+  std::vector<std::byte,
+              util::default_init_allocator<std::byte,
+                                           pattern_allocator<std::byte>>>
+    buf;
+  buf.resize(64);
+  EXPECT_TRUE(all_of_pattern(buf));
+}
+
+TEST(default_init_allocator, arguments_are_forwarded) {
+  util::byte_buffer buf(16, std::byte{1});
+  EXPECT_TRUE(std::all_of(buf.begin(), buf.end(),
+                          [](std::byte b) { return b == std::byte{1}; }));
+  buf.clear();
+  EXPECT_GE(buf.capacity(), 16);
+}
+
+TEST(default_init_allocator, serializer_grows_byte_buffer) {
+  util::byte_buffer buf;
+  util::binary_serializer serializer{buf};
+  serializer(std::uint32_t{42}, std::uint16_t{7});
+  ASSERT_EQ(buf.size(), 6);
+  std::uint32_t value = 0;
+  std::memcpy(&value, buf.data(), sizeof(value));
+  EXPECT_EQ(value, 42);
+}
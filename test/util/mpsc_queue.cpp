@@ -0,0 +1,67 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      mpsc_queue.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "util/mpsc_queue.hpp"
+
+#include "net_test.hpp"
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+TEST(mpsc_queue, capacity) {
+  EXPECT_EQ(util::mpsc_queue<int>{0}.capacity(), 2);
+  EXPECT_EQ(util::mpsc_queue<int>{4}.capacity(), 4);
+  EXPECT_EQ(util::mpsc_queue<int>{5}.capacity(), 8);
+}
+
+TEST(mpsc_queue, fifo) {
+  util::mpsc_queue<int> queue{4};
+  EXPECT_FALSE(queue.pop().has_value());
+  for (int i = 0; i < 4; ++i)
+    EXPECT_TRUE(queue.try_push(i));
+  EXPECT_FALSE(queue.try_push(4));
+  for (int i = 0; i < 4; ++i)
+    EXPECT_EQ(queue.pop(), i);
+  EXPECT_FALSE(queue.pop().has_value());
+}
+
+TEST(mpsc_queue, wraps_around) {
+  util::mpsc_queue<int> queue{2};
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(queue.try_push(i));
+    EXPECT_EQ(queue.pop(), i);
+  }
+}
+
+TEST(mpsc_queue, multiple_producers) {
+  static constexpr std::size_t num_threads = 4;
+  static constexpr int num_values = 10000;
+  util::mpsc_queue<int> queue{64};
+  std::vector<std::thread> producers;
+  for (std::size_t i = 0; i < num_threads; ++i) {
+    producers.emplace_back([&queue] {
+      for (int value = 0; value < num_values; ++value) {
+        while (!queue.try_push(value))
+          std::this_thread::yield();
+      }
+    });
+  }
+  // Every producer pushes the same values
+  long long sum = 0;
+  for (std::size_t received = 0; received < num_threads * num_values;) {
+    if (auto value = queue.pop()) {
+      sum += *value;
+      ++received;
+    }
+  }
+  for (auto& producer : producers)
+    producer.join();
+  EXPECT_EQ(sum, static_cast<long long>(num_threads) * num_values
+                   * (num_values - 1) / 2);
+}
@@ -6,6 +6,7 @@
  *             the GNU GPL3 License.
  */
 
+#include "util/intrusive_ptr.hpp"
 #include "util/ref_counted.hpp"
 
 #include "net_test.hpp"
@@ -23,6 +24,14 @@ private:
   bool& deleted_;
 };
 
+struct local_dummy_obj : public util::local_ref_counted {
+  local_dummy_obj(bool& deleted) : deleted_{deleted} {}
+  ~local_dummy_obj() override { deleted_ = true; }
+
+private:
+  bool& deleted_;
+};
+
 } // namespace
 
 TEST(ref_counted_test, ref_counting) {
@@ -45,3 +54,16 @@ TEST(ref_counted_test, ref_counting) {
   obj->deref();
   EXPECT_TRUE(deleted);
 }
+
+TEST(ref_counted_test, local_ref_counting) {
+  bool deleted = false;
+  auto obj = util::make_intrusive(new local_dummy_obj(deleted), false);
+  EXPECT_EQ(obj->ref_count(), 1);
+  auto copy = obj;
+  EXPECT_EQ(obj->ref_count(), 2);
+  copy.reset();
+  EXPECT_EQ(obj->ref_count(), 1);
+  EXPECT_FALSE(deleted);
+  obj.reset();
+  EXPECT_TRUE(deleted);
+}
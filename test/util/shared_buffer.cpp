@@ -0,0 +1,57 @@
+/**
+ *  @author    Jakob Otto
+ *  @file      shared_buffer.cpp
+ *  @copyright Copyright 2023 Jakob Otto. All rights reserved.
+ *             This file is part of the network-driver project, released under
+ *             the GNU GPL3 License.
+ */
+
+#include "util/shared_buffer.hpp"
+
+#include "util/byte_buffer.hpp"
+
+#include "net_test.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace {
+
+util::byte_buffer make_bytes(std::size_t size) {
+  util::byte_buffer buf(size);
+  for (std::size_t i = 0; i < size; ++i)
+    buf[i] = static_cast<std::byte>(i);
+  return buf;
+}
+
+} // namespace
+
+TEST(shared_buffer, slice_covers_buffer) {
+  const auto bytes = make_bytes(32);
+  const auto slice = util::make_shared_slice(util::const_byte_span{bytes});
+  ASSERT_EQ(slice.size(), bytes.size());
+  EXPECT_TRUE(std::equal(bytes.begin(), bytes.end(), slice.bytes().begin()));
+  EXPECT_NE(slice.bytes().data(), bytes.data());
+  EXPECT_TRUE(util::shared_slice{}.empty());
+}
+
+TEST(shared_buffer, subslice) {
+  const auto slice = util::make_shared_slice(make_bytes(32));
+  const auto sub = slice.subslice(8, 4);
+  ASSERT_EQ(sub.size(), 4);
+  EXPECT_EQ(sub.bytes().data(), slice.bytes().data() + 8);
+  EXPECT_EQ(sub.bytes()[0], std::byte{8});
+  EXPECT_EQ(sub.buffer().get(), slice.buffer().get());
+}
+
+TEST(shared_buffer, slices_keep_buffer_alive) {
+  auto slice = util::make_shared_slice(make_bytes(32));
+  auto* buf = slice.buffer().get();
+  EXPECT_EQ(buf->ref_count(), 1);
+  {
+    auto copy = slice;
+    auto sub = slice.subslice(0, 16);
+    EXPECT_EQ(buf->ref_count(), 3);
+  }
+  EXPECT_EQ(buf->ref_count(), 1);
+}